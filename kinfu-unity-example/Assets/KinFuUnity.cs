@@ -21,9 +21,87 @@ public static class KinFuUnity
     public static ConnectToDefaultDevice connectToDefaultDevice = null;
     public delegate bool ConnectToDefaultDevice();
 
+    // Mirrors k4a_depth_mode_t
+    public enum DepthMode
+    {
+        Off = 0,
+        NFOV2x2Binned,
+        NFOVUnbinned,
+        WFOV2x2Binned,
+        WFOVUnbinned
+    }
+
+    // Mirrors k4a_color_resolution_t
+    public enum ColorResolution
+    {
+        Off = 0,
+        Res720p,
+        Res1080p,
+        Res1440p,
+        Res1536p,
+        Res2160p,
+        Res3072p
+    }
+
+    // Mirrors the color formats of k4a_image_format_t
+    public enum ColorFormat
+    {
+        MJPG = 0,
+        NV12,
+        YUY2,
+        BGRA32
+    }
+
+    // Mirrors k4a_fps_t
+    public enum CameraFps
+    {
+        Fps5 = 0,
+        Fps15,
+        Fps30
+    }
+
+    // Mirrors kinfu_capture_profile_t
+    [StructLayout(LayoutKind.Sequential)]
+    public struct CaptureProfile
+    {
+        public DepthMode depthMode;
+        public ColorResolution colorResolution;
+        public ColorFormat colorFormat;
+        public CameraFps fps;
+        public int depthOnly;
+        public int synchronizedImagesOnly;
+    }
+
+    // Mirrors kinfu_capture_info_t
+    [StructLayout(LayoutKind.Sequential)]
+    public struct CaptureInfo
+    {
+        public DepthMode depthMode;
+        public int depthWidth;
+        public int depthHeight;
+        public ColorResolution colorResolution;
+        public int colorWidth;
+        public int colorHeight;
+        public ColorFormat colorFormat;
+        public int fps;
+        public int synchronizedImagesOnly;
+    }
+
+    [PluginFunctionAttr("setCaptureProfile")]
+    public static SetCaptureProfile setCaptureProfile = null;
+    public delegate bool SetCaptureProfile(ref CaptureProfile profile);
+
     [PluginFunctionAttr("connectAndStartCameras")]
     public static ConnectAndStartCameras connectAndStartCameras = null;
-    public delegate int ConnectAndStartCameras();
+    public delegate int ConnectAndStartCameras(ref CaptureProfile profile);
+
+    [PluginFunctionAttr("getCaptureInfo")]
+    public static GetCaptureInfo getCaptureInfo = null;
+    public delegate bool GetCaptureInfo(out CaptureInfo info);
+
+    [PluginFunctionAttr("openPlayback")]
+    public static OpenPlayback openPlayback = null;
+    public delegate int OpenPlayback(string path, bool realtime);
 
     [PluginFunctionAttr("setupConfigAndCalibrate")]
     public static SetupConfigAndCalibrate setupConfigAndCalibrate = null;
@@ -37,6 +115,18 @@ public static class KinFuUnity
     public static CaptureFrame captureFrame = null;
     public delegate int CaptureFrame(IntPtr color_data, IntPtr point_data, IntPtr pose_matrix_data);
 
+    [PluginFunctionAttr("startCaptureThread")]
+    public static StartCaptureThread startCaptureThread = null;
+    public delegate bool StartCaptureThread();
+
+    [PluginFunctionAttr("stopCaptureThread")]
+    public static StopCaptureThread stopCaptureThread = null;
+    public delegate void StopCaptureThread();
+
+    [PluginFunctionAttr("pollFrame")]
+    public static PollFrame pollFrame = null;
+    public delegate int PollFrame(IntPtr color_data, IntPtr point_data, IntPtr pose_matrix_data, out int num_points);
+
     [PluginFunctionAttr("closeDevice")]
     public static CloseDevice closeDevice = null;
     public delegate void CloseDevice();
@@ -49,14 +139,353 @@ public static class KinFuUnity
     public static CaptureColorImage captureColorImage = null;
     public delegate int CaptureColorImage(IntPtr color_data);
 
+    [PluginFunctionAttr("setColorImageFlip")]
+    public static SetColorImageFlip setColorImageFlip = null;
+    public delegate void SetColorImageFlip(bool flip);
+
     [PluginFunctionAttr("capturePointCloud")]
     public static CapturePointCloud capturePointCloud = null;
     public delegate int CapturePointCloud(IntPtr point_data);
 
+    [PluginFunctionAttr("setPointCloudLayout")]
+    public static SetPointCloudLayout setPointCloudLayout = null;
+    public delegate bool SetPointCloudLayout(int floatsPerPoint);
+
+    [PluginFunctionAttr("getPointCloudSize")]
+    public static GetPointCloudSize getPointCloudSize = null;
+    public delegate int GetPointCloudSize(out ulong generation);
+
+    [PluginFunctionAttr("copyPointCloud")]
+    public static CopyPointCloud copyPointCloud = null;
+    public delegate int CopyPointCloud(IntPtr point_data, int offset, int count);
+
+    [PluginFunctionAttr("copyPointCloudColors")]
+    public static CopyPointCloudColors copyPointCloudColors = null;
+    public delegate int CopyPointCloudColors(IntPtr color_data, int offset, int count);
+
+    [PluginFunctionAttr("setCloudExtractionPolicy")]
+    public static SetCloudExtractionPolicy setCloudExtractionPolicy = null;
+    public delegate void SetCloudExtractionPolicy(float maxRateHz, int minIntegratedFrames);
+
+    [PluginFunctionAttr("pointCloudChangedSince")]
+    public static PointCloudChangedSince pointCloudChangedSince = null;
+    public delegate bool PointCloudChangedSince(ulong generation);
+
+    [PluginFunctionAttr("setPointCloudLods")]
+    public static SetPointCloudLods setPointCloudLods = null;
+    public delegate bool SetPointCloudLods(float[] cell_sizes, int count);
+
+    [PluginFunctionAttr("selectPointCloudLod")]
+    public static SelectPointCloudLod selectPointCloudLod = null;
+    public delegate bool SelectPointCloudLod(int level);
+
+    // Mirrors kinfu_cull_region_t, planes as a, b, c, d in volume coordinates
+    [StructLayout(LayoutKind.Sequential)]
+    public struct CullRegion
+    {
+        public int planeCount;
+        [MarshalAs(UnmanagedType.ByValArray, SizeConst = 8 * 4)]
+        public float[] planes;
+    }
+
+    [PluginFunctionAttr("getFrustumCullRegion")]
+    public static GetFrustumCullRegion getFrustumCullRegion = null;
+    public delegate bool GetFrustumCullRegion(float[] pose, float near_distance, float far_distance, out CullRegion region);
+
+    [PluginFunctionAttr("getBoxCullRegion")]
+    public static GetBoxCullRegion getBoxCullRegion = null;
+    public delegate void GetBoxCullRegion(float[] pose, float[] half_extents, out CullRegion region);
+
+    [PluginFunctionAttr("cullPointCloud")]
+    public static CullPointCloud cullPointCloud = null;
+    public delegate int CullPointCloud(ref CullRegion region);
+
+    [PluginFunctionAttr("setPointCloudBlockSize")]
+    public static SetPointCloudBlockSize setPointCloudBlockSize = null;
+    public delegate bool SetPointCloudBlockSize(float block_size);
+
+    // Mirrors kinfu_cloud_delta_t
+    [StructLayout(LayoutKind.Sequential)]
+    public struct CloudDelta
+    {
+        public ulong generation;
+        public ulong since;
+        public int full;
+        public int blockCount;
+        public int removedCount;
+        public int pointCount;
+        public float blockSize;
+    }
+
+    // Mirrors kinfu_cloud_block_t, a cube from (x, y, z) * blockSize in volume coordinates
+    [StructLayout(LayoutKind.Sequential)]
+    public struct CloudBlock
+    {
+        public int x;
+        public int y;
+        public int z;
+        public int firstPoint;
+        public int pointCount;
+        public int removed;
+        public ulong hash;
+    }
+
+    [PluginFunctionAttr("getPointCloudDelta")]
+    public static GetPointCloudDelta getPointCloudDelta = null;
+    public delegate int GetPointCloudDelta(ulong since, out CloudDelta delta);
+
+    [PluginFunctionAttr("copyPointCloudBlocks")]
+    public static CopyPointCloudBlocks copyPointCloudBlocks = null;
+    public delegate int CopyPointCloudBlocks([Out] CloudBlock[] blocks, int offset, int count);
+
+    [PluginFunctionAttr("getDepthFrameCloudSize")]
+    public static GetDepthFrameCloudSize getDepthFrameCloudSize = null;
+    public delegate bool GetDepthFrameCloudSize(int downsample, out int width, out int height);
+
+    [PluginFunctionAttr("exportDepthFrameCloud")]
+    public static ExportDepthFrameCloud exportDepthFrameCloud = null;
+    public delegate int ExportDepthFrameCloud(IntPtr points, IntPtr normals, int downsample, float[] pose);
+
+    [PluginFunctionAttr("renderPreview")]
+    public static RenderPreview renderPreview = null;
+    public delegate int RenderPreview(IntPtr rgba, int width, int height, float[] pose);
+
+    [PluginFunctionAttr("requestPreview")]
+    public static RequestPreview requestPreview = null;
+    public delegate bool RequestPreview(int width, int height, float[] pose);
+
+    [PluginFunctionAttr("pollPreview")]
+    public static PollPreview pollPreview = null;
+    public delegate int PollPreview(IntPtr rgba, int width, int height);
+
+    // Mirrors kinfu_vertex_color_format_t
+    public enum VertexColorFormat
+    {
+        RGBA32,
+        RGBAFloat
+    }
+
+    // Mirrors kinfu_vertex_format_t, offsets in bytes and -1 to leave an attribute out
+    [StructLayout(LayoutKind.Sequential)]
+    public struct VertexFormat
+    {
+        public int stride;
+        public int positionOffset;
+        public int normalOffset;
+        public int colorOffset;
+        public VertexColorFormat colorFormat;
+        public int sizeOffset;
+        public float size;
+        public uint color;
+        public int flipY;
+    }
+
+    [PluginFunctionAttr("setPointCloudNormals")]
+    public static SetPointCloudNormals setPointCloudNormals = null;
+    public delegate void SetPointCloudNormals(bool enabled);
+
+    [PluginFunctionAttr("exportPointCloudVertices")]
+    public static ExportPointCloudVertices exportPointCloudVertices = null;
+    public delegate int ExportPointCloudVertices(IntPtr vertex_data, int offset, int count, ref VertexFormat format);
+
+    // Mirrors kinfu_quantized_flags_t
+    [Flags]
+    public enum QuantizedFlags
+    {
+        None = 0,
+        Normals = 1,
+        Colors = 2
+    }
+
+    // Mirrors kinfu_quantized_cloud_t
+    [StructLayout(LayoutKind.Sequential)]
+    public struct QuantizedCloud
+    {
+        public uint count;
+        public QuantizedFlags flags;
+        [MarshalAs(UnmanagedType.ByValArray, SizeConst = 3)]
+        public float[] origin;
+        [MarshalAs(UnmanagedType.ByValArray, SizeConst = 3)]
+        public float[] scale;
+        public float maxPositionError;
+        public float maxNormalError;
+    }
+
+    [PluginFunctionAttr("exportQuantizedPointCloud")]
+    public static ExportQuantizedPointCloud exportQuantizedPointCloud = null;
+    public delegate int ExportQuantizedPointCloud(IntPtr data, int capacity, QuantizedFlags flags, out QuantizedCloud header);
+
+    [PluginFunctionAttr("decodeQuantizedPointCloud")]
+    public static DecodeQuantizedPointCloud decodeQuantizedPointCloud = null;
+    public delegate int DecodeQuantizedPointCloud(IntPtr data, ref QuantizedCloud header, IntPtr points, IntPtr normals, IntPtr colors);
+
     [PluginFunctionAttr("updateKinectFusion")]
     public static UpdateKinectFusion updateKinectFusion = null;
     public delegate int UpdateKinectFusion();
 
+    // Mirrors kinfu_volume_type_t
+    public enum VolumeType
+    {
+        TSDF,
+        HashTSDF,
+        Submaps,
+        ColoredTSDF
+    }
+
+    // Mirrors kinfu_volume_params_t, zero fields keep KinFu's defaults
+    [StructLayout(LayoutKind.Sequential)]
+    public struct VolumeParams
+    {
+        public VolumeType volumeType;
+        public float voxelSize;
+        public int volumeResolution;
+        public int unitResolution;
+        public float truncationDistance;
+    }
+
+    // Mirrors kinfu_volume_info_t
+    [StructLayout(LayoutKind.Sequential)]
+    public struct VolumeInfo
+    {
+        public VolumeType volumeType;
+        public float voxelSize;
+        public float truncationDistance;
+        public int volumeResolution;
+        public int unitResolution;
+        public int volumeUnits;
+        public ulong residentBytes;
+    }
+
+    [PluginFunctionAttr("setVolumeParams")]
+    public static SetVolumeParams setVolumeParams = null;
+    public delegate bool SetVolumeParams(ref VolumeParams volume);
+
+    [PluginFunctionAttr("getVolumeInfo")]
+    public static GetVolumeInfo getVolumeInfo = null;
+    public delegate bool GetVolumeInfo(out VolumeInfo info);
+
+    // Mirrors kinfu_quality_policy_t
+    [StructLayout(LayoutKind.Sequential)]
+    public struct QualityPolicy
+    {
+        public float targetMs;
+        public float raiseFraction;
+        public int lowerFrames;
+        public int raiseFrames;
+        public int rebuild;
+    }
+
+    // Mirrors kinfu_quality_state_t
+    [StructLayout(LayoutKind.Sequential)]
+    public struct QualityState
+    {
+        public int level;
+        public int createdLevel;
+        public float frameMs;
+        [MarshalAs(UnmanagedType.ByValArray, SizeConst = 4)]
+        public int[] icpIterations;
+        public int pyramidLevels;
+        public int bilateralKernelSize;
+        public float raycastStepFactor;
+        public float minCameraMovement;
+        public int frameStride;
+    }
+
+    // Mirrors kinfu_quality_event_t
+    [StructLayout(LayoutKind.Sequential)]
+    public struct QualityEvent
+    {
+        public ulong frame;
+        public float frameMs;
+        public float targetMs;
+        public int fromLevel;
+        public int toLevel;
+        public int applied;
+    }
+
+    [PluginFunctionAttr("setQualityPolicy")]
+    public static SetQualityPolicy setQualityPolicy = null;
+    public delegate bool SetQualityPolicy(ref QualityPolicy policy);
+
+    [PluginFunctionAttr("getQualityState")]
+    public static GetQualityState getQualityState = null;
+    public delegate bool GetQualityState(out QualityState state);
+
+    [PluginFunctionAttr("pollQualityEvents")]
+    public static PollQualityEvents pollQualityEvents = null;
+    public delegate int PollQualityEvents([Out] QualityEvent[] events, int capacity);
+
+    [PluginFunctionAttr("getAllocationCount")]
+    public static GetAllocationCount getAllocationCount = null;
+    public delegate ulong GetAllocationCount();
+
+    // Mirrors kinfu_stage_t
+    public enum PipelineStage
+    {
+        Capture = 0,
+        Color,
+        Remap,
+        Register,
+        Update,
+        GetCloud,
+        Export,
+        Frame,
+        Count
+    }
+
+    // Mirrors kinfu_stage_stats_t, times in milliseconds
+    [StructLayout(LayoutKind.Sequential)]
+    public struct StageStats
+    {
+        public ulong count;
+        public float lastMs;
+        public float meanMs;
+        public float maxMs;
+        public float p50Ms;
+        public float p95Ms;
+        public float p99Ms;
+    }
+
+    // Mirrors kinfu_pipeline_stats_t, stages are indexed by PipelineStage
+    [StructLayout(LayoutKind.Sequential)]
+    public struct PipelineStats
+    {
+        [MarshalAs(UnmanagedType.ByValArray, SizeConst = (int)PipelineStage.Count)]
+        public StageStats[] stages;
+
+        public ulong frames;
+        public ulong successfulUpdates;
+        public ulong failedUpdates;
+        public ulong droppedFrames;
+        public ulong captureTimeouts;
+        public ulong captureFailures;
+        public ulong colorFailures;
+    }
+
+    [PluginFunctionAttr("getPipelineStats")]
+    public static GetPipelineStats getPipelineStats = null;
+    public delegate void GetPipelineStats(out PipelineStats stats);
+
+    [PluginFunctionAttr("resetPipelineStats")]
+    public static ResetPipelineStats resetPipelineStats = null;
+    public delegate void ResetPipelineStats();
+
+    [PluginFunctionAttr("setPipelineStatsEnabled")]
+    public static SetPipelineStatsEnabled setPipelineStatsEnabled = null;
+    public delegate void SetPipelineStatsEnabled(bool enabled);
+
+    [PluginFunctionAttr("setTracingEnabled")]
+    public static SetTracingEnabled setTracingEnabled = null;
+    public delegate void SetTracingEnabled(bool enabled);
+
+    [PluginFunctionAttr("writeTrace")]
+    public static WriteTrace writeTrace = null;
+    public delegate int WriteTrace(string path);
+
+    [PluginFunctionAttr("clearTrace")]
+    public static ClearTrace clearTrace = null;
+    public delegate void ClearTrace();
+
     [PluginFunctionAttr("requestPose")]
     public static RequestPose requestPose = null;
     public delegate void RequestPose(IntPtr pose_matrix_data);
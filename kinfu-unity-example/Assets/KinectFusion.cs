@@ -3,7 +3,6 @@ using System;
 using System.Collections;
 using System.Collections.Generic;
 using System.Runtime.InteropServices;
-using System.Threading;
 
 using UnityEngine;
 using UnityEngine.Events;
@@ -18,10 +17,6 @@ public class KinectFusion : MonoBehaviour
         private set;
     }
 
-    [Range(50, 500)]
-    [Tooltip("How long to sleep Kinect update thread")]
-    public int SleepTime = 100;
-
     public enum KinFuLogLevels
     {
         Critical = 0,
@@ -34,9 +29,81 @@ public class KinectFusion : MonoBehaviour
     [Tooltip("Logging level from K4A library")]
     public KinFuLogLevels logLevel = KinFuLogLevels.Warning;
 
+    [Tooltip("Flip the color image vertically in the plugin")]
+    public bool flipColorImage = false;
+
+    [Header("Capture")]
+    [Tooltip("Depth mode, binned modes trade resolution for range and run WFOV at 30 fps")]
+    public KinFuUnity.DepthMode depthMode = KinFuUnity.DepthMode.NFOVUnbinned;
+    [Tooltip("Color resolution, ignored when depthOnly")]
+    public KinFuUnity.ColorResolution colorResolution = KinFuUnity.ColorResolution.Res1080p;
+    [Tooltip("Color format, NV12 and YUY2 are only captured at 720p and colored volumes need BGRA32")]
+    public KinFuUnity.ColorFormat colorFormat = KinFuUnity.ColorFormat.BGRA32;
+    [Tooltip("Camera frame rate, KinFu tracks every frame")]
+    public KinFuUnity.CameraFps cameraFps = KinFuUnity.CameraFps.Fps5;
+    [Tooltip("Leave the color camera off")]
+    public bool depthOnly = false;
+    [Tooltip("Only deliver captures holding both the depth and color images")]
+    public bool synchronizedImagesOnly = false;
+
+    [Header("Volume")]
+    [Tooltip("Dense cube, hashed units that only take memory near surfaces, LargeKinfu submaps for spaces bigger than one volume (clouds in the current submap's frame, no frustum culling), or a dense cube that also fuses color. Applied when the cameras start")]
+    public KinFuUnity.VolumeType volumeType = KinFuUnity.VolumeType.TSDF;
+    [Tooltip("Voxel edge in metres, 0 for KinFu's default (3 m / 512)")]
+    public float voxelSize = 0f;
+    [Tooltip("Truncation distance in metres, 0 for 7 voxels")]
+    public float truncationDistance = 0f;
+
+    [Header("Quality")]
+    [Tooltip("Fusion time per captured frame to hold in ms by coarsening tracking and then skipping frames, 0 to keep KinFu's defaults")]
+    public float frameBudgetMs = 0f;
+    [Tooltip("Recreate KinFu as soon as the tracking settings change, dropping the model. Otherwise only frame skipping is used until the next reset")]
+    public bool rebuildOnQualityChange = false;
+
+    [Header("Point Cloud")]
+    [Tooltip("Most point cloud refreshes per second, 0 for no limit")]
+    public float cloudRefreshRate = 4f;
+    [Tooltip("Fused frames needed before the point cloud is refreshed")]
+    public int cloudRefreshFrames = 1;
+    [Tooltip("Send the cloud to pointCloudVerticesUpdated as position + size texels written by the plugin, instead of a List to pointCloudUpdated")]
+    public bool exportVertices = false;
+    [Tooltip("Size written with each vertex when exporting vertices")]
+    public float vertexPointSize = 0.01f;
+    [Tooltip("Cell sizes in metres of the voxel-grid LODs built with each cloud, increasing, up to 4")]
+    public float[] cloudLodCellSizes = new float[0];
+    [Tooltip("LOD to read, 0 for the full cloud or n for the nth cell size. Can be changed while running")]
+    public int cloudLod = 0;
+
+    public enum CloudCulling
+    {
+        None,
+        CameraFrustum,
+        WorkingArea
+    }
+    [Tooltip("Only read the points the camera sees, or the points inside workingArea")]
+    public CloudCulling cloudCulling = CloudCulling.None;
+    [Tooltip("Furthest distance in metres kept by CameraFrustum culling")]
+    public float cullFarDistance = 4f;
+    [Tooltip("Box kept by WorkingArea culling, a unit cube scaled and placed by this transform in the volume's space")]
+    public Transform workingArea;
+
+    [Header("Preview")]
+    [Tooltip("Shows a shaded render of the volume made by the plugin, cheaper than drawing the cloud")]
+    public RawImage previewImage;
+    [Tooltip("Size of the preview render")]
+    public Vector2Int previewSize = new Vector2Int(320, 288);
+
+    [Header("Playback")]
+    [Tooltip("Azure Kinect recording (.mkv) to play back instead of connecting to a device")]
+    public string playbackPath = "";
+    [Tooltip("Pace playback like the recording, otherwise run as fast as possible")]
+    public bool playbackRealtime = true;
+
     [Header("Events")]
     [Tooltip("Called when point cloud data has updated")]
     public UnityEvent<List<Vector3>> pointCloudUpdated;
+    [Tooltip("Called with x, y, z, size floats per point (already in Unity axes) and the point count")]
+    public UnityEvent<float[], int> pointCloudVerticesUpdated;
     [Tooltip("Called when Camera Matrix has updated")]
     public UnityEvent<Matrix4x4> poseUpdated;
 
@@ -51,48 +118,9 @@ public class KinectFusion : MonoBehaviour
     Coroutine updateConnectedDevices;
 
 
-    #region Threading
-    // Handle to the Update Thread
-    Thread updateThread;
-
-    // Lock object to ensure we do not have problems
-    static object threadLock = new object();
-    // Safety catch to stop update thread
-    static bool runUpdateThread = true;
-
-    // Whether the Color image has been updated
-    bool updateImage = false;
-    // Number of points captured from Point Cloud last frames
-    int numPoints = 0;
-
-    // Main update thread loop.
-    static void UpdateKinectThread()
-    {
-        while (runUpdateThread)
-        {
-            lock (threadLock)
-            {
-                var updateSuccess = KinFuUnity.captureFrame(
-                    Instance.pixelPtr,
-                    Instance.pointsPtr,
-                    Instance.poseMatrixArrayPtr
-                );
-
-                // This is a fatal status and we need to close the device
-                // K4A_WAIT_RESULT_FAILED
-                if (updateSuccess == -2)
-                {
-                    Instance.CloseCamera();
-                    break;
-                }
-
-                Instance.updateImage = updateSuccess > 0;
-                Instance.numPoints = updateSuccess;
-            }
-
-            Thread.Sleep(Instance.SleepTime);
-        }
-    }
+    #region Capture State
+    // Whether the native capture thread is running
+    bool capturing = false;
     #endregion
 
     #region Pointers
@@ -106,10 +134,27 @@ public class KinectFusion : MonoBehaviour
     /// UI Component to display it
     public RawImage colorImage;
 
-    /// Point cloud points
+    /// Point cloud points, grown to fit the cloud
     private float[] points;
     private GCHandle pointsHandle;
     private IntPtr pointsPtr;
+    /// Generation of the cloud last read, so unchanged clouds are not read again
+    private ulong pointCloudGeneration = 0;
+    /// LOD the plugin pins, cloudLod is applied when it differs
+    private int selectedLod = 0;
+    /// Culling the cloud was last read with, a change reads the same generation again
+    private CloudCulling fetchedCulling = CloudCulling.None;
+    private float fetchedFarDistance = 0f;
+    private Matrix4x4 fetchedCullMatrix = Matrix4x4.identity;
+    /// Latest camera pose from the plugin, what CameraFrustum culling follows
+    private Matrix4x4 cameraPose = Matrix4x4.identity;
+
+    /// Preview render Texture, rendered on the plugin's preview thread
+    private Texture2D previewTex;
+    private Color32[] previewPixels;
+    private GCHandle previewHandle;
+    // Whether a render was requested and not polled yet, the next one waits for it
+    private bool previewPending = false;
 
     /// Camera Transform
     private float[] poseMatrixArray;
@@ -138,8 +183,7 @@ public class KinectFusion : MonoBehaviour
 
         Instance = this;
 
-        InitTexture();
-        InitPointsArray();
+        InitPointsArray(65536);
         InitPoseMatrixArray();
 
         StartCheckingForDevices();
@@ -147,27 +191,60 @@ public class KinectFusion : MonoBehaviour
 
     private void Update()
     {
-        if (updateThread != null && updateThread.IsAlive)
+        if (!capturing)
         {
-            if (updateImage)
-            {
-                UpdateColorImage();
+            return;
+        }
 
-                UpdateCameraPose();
-            }
+        // Never blocks, the native capture thread publishes frames as they arrive
+        // Points are fetched separately below, sized to whatever the cloud is
+        var status = KinFuUnity.pollFrame(pixelPtr, IntPtr.Zero, poseMatrixArrayPtr, out int numPoints);
 
-            if (numPoints > 0)
-            {
-                ProcessPoints(numPoints);
-            }
+        // This is a fatal status and we need to close the device
+        // K4A_WAIT_RESULT_FAILED
+        if (status == -2)
+        {
+            CloseCamera();
+            return;
+        }
+
+        // Played back the whole recording
+        if (status == -3)
+        {
+            Debug.Log("Playback finished");
+            CloseCamera();
+            return;
+        }
+
+        if (status > 0)
+        {
+            UpdateColorImage();
+
+            UpdateCameraPose();
+        }
+
+        // numPoints is 0 while the cloud is unchanged, but a new LOD or cull region still needs reading,
+        // so the generation decides instead
+        FetchPointCloud();
+
+        if (previewImage != null)
+        {
+            UpdatePreview();
         }
     }
 
     private void OnApplicationQuit()
     {
         CloseCamera();
-        pixelHandle.Free();
+        if (pixelHandle.IsAllocated)
+        {
+            pixelHandle.Free();
+        }
         pointsHandle.Free();
+        if (previewTex != null)
+        {
+            previewHandle.Free();
+        }
         poseMatrixArrayHandle.Free();
     }
 
@@ -175,15 +252,26 @@ public class KinectFusion : MonoBehaviour
 
     #region Init Functions
 
-    void InitTexture()
+    // Sized from getCaptureInfo to match the color images the plugin writes, none without color
+    void InitTexture(int width, int height)
     {
-        // NOTE: This is created to MATCH the Kinect buffers - and should either
-        // a) be updated if this changes in the DLL
-        // b) be passed into the DLL somehow to configure
-        // c) be passed OUT of the DLL then created
-        // 
-        // But these are all tasks for later
-        tex = new Texture2D(1920, 1080, TextureFormat.RGBA32, false);
+        if (pixelHandle.IsAllocated)
+        {
+            pixelHandle.Free();
+        }
+        pixelPtr = IntPtr.Zero;
+        if (tex != null)
+        {
+            Destroy(tex);
+            tex = null;
+        }
+
+        if (width == 0 || height == 0)
+        {
+            return;
+        }
+
+        tex = new Texture2D(width, height, TextureFormat.RGBA32, false);
         pixel32 = tex.GetPixels32();
         //Pin pixel32 array
         pixelHandle = GCHandle.Alloc(pixel32, GCHandleType.Pinned);
@@ -197,9 +285,14 @@ public class KinectFusion : MonoBehaviour
         }
     }
 
-    private void InitPointsArray()
+    private void InitPointsArray(int capacity)
     {
-        points = new float[1000000 * 3];
+        if (points != null)
+        {
+            pointsHandle.Free();
+        }
+
+        points = new float[capacity * 3];
         //Pin points array
         pointsHandle = GCHandle.Alloc(points, GCHandleType.Pinned);
         //Get the pinned address
@@ -263,6 +356,154 @@ public class KinectFusion : MonoBehaviour
     #endregion
 
     #region Process Kinect Data
+    private void FetchPointCloud()
+    {
+        if (cloudLod != selectedLod)
+        {
+            if (KinFuUnity.selectPointCloudLod(cloudLod))
+            {
+                selectedLod = cloudLod;
+                // Read the same generation again at the new level
+                pointCloudGeneration = 0;
+            }
+            else
+            {
+                cloudLod = selectedLod;
+            }
+        }
+
+        if (CullRegionChanged())
+        {
+            // Cull the same generation again with the new region
+            pointCloudGeneration = 0;
+        }
+
+        if (!KinFuUnity.pointCloudChangedSince(pointCloudGeneration))
+        {
+            return;
+        }
+
+        int size = KinFuUnity.getPointCloudSize(out ulong generation);
+        if (size <= 0 || generation == pointCloudGeneration)
+        {
+            return;
+        }
+
+        pointCloudGeneration = generation;
+
+        if (cloudCulling != CloudCulling.None)
+        {
+            size = CullPointCloud();
+            if (size <= 0)
+            {
+                return;
+            }
+        }
+
+        if (exportVertices)
+        {
+            ExportVertices(size);
+            return;
+        }
+
+        // Grow with some headroom, as the cloud keeps growing while scanning
+        if (points.Length < size * 3)
+        {
+            InitPointsArray(size + size / 4);
+        }
+
+        ProcessPoints(KinFuUnity.copyPointCloud(pointsPtr, 0, size));
+    }
+
+    // Whether the culling mode or region moved since the cloud was last read, remembering the new one
+    private bool CullRegionChanged()
+    {
+        Matrix4x4 cullMatrix = Matrix4x4.identity;
+        if (cloudCulling == CloudCulling.CameraFrustum)
+        {
+            cullMatrix = cameraPose;
+        }
+        else if (cloudCulling == CloudCulling.WorkingArea && workingArea != null)
+        {
+            cullMatrix = Matrix4x4.TRS(workingArea.localPosition, workingArea.localRotation, workingArea.localScale);
+        }
+
+        if (cloudCulling == fetchedCulling && cullFarDistance == fetchedFarDistance && cullMatrix == fetchedCullMatrix)
+        {
+            return false;
+        }
+
+        fetchedCulling = cloudCulling;
+        fetchedFarDistance = cullFarDistance;
+        fetchedCullMatrix = cullMatrix;
+        return true;
+    }
+
+    // Narrows the pinned cloud to the camera frustum or working area, returning the points left
+    private int CullPointCloud()
+    {
+        KinFuUnity.CullRegion region;
+        if (cloudCulling == CloudCulling.CameraFrustum)
+        {
+            if (!KinFuUnity.getFrustumCullRegion(null, 0f, cullFarDistance, out region))
+            {
+                return 0;
+            }
+        }
+        else
+        {
+            if (workingArea == null)
+            {
+                return 0;
+            }
+
+            // Into OpenCV's axes, where +Y is down, on both sides of the box transform
+            Matrix4x4 flip = Matrix4x4.Scale(new Vector3(1, -1, 1));
+            Matrix4x4 box = flip * Matrix4x4.TRS(workingArea.localPosition, workingArea.localRotation, Vector3.one) * flip;
+
+            var pose = new float[16];
+            for (int row = 0; row < 4; row++)
+            {
+                for (int col = 0; col < 4; col++)
+                {
+                    pose[row * 4 + col] = box[row, col];
+                }
+            }
+
+            var halfExtents = new float[] { workingArea.localScale.x * 0.5f, workingArea.localScale.y * 0.5f, workingArea.localScale.z * 0.5f };
+            KinFuUnity.getBoxCullRegion(pose, halfExtents, out region);
+        }
+
+        return KinFuUnity.cullPointCloud(ref region);
+    }
+
+    // Has the plugin write x, y, z, size per point, flipped into Unity axes,
+    // so the array can go straight into an RGBAFloat texture or GraphicsBuffer
+    private void ExportVertices(int size)
+    {
+        if (points.Length < size * 4)
+        {
+            InitPointsArray((size + size / 4) * 4 / 3 + 1);
+        }
+
+        var format = new KinFuUnity.VertexFormat
+        {
+            stride = 4 * sizeof(float),
+            positionOffset = 0,
+            normalOffset = -1,
+            colorOffset = -1,
+            sizeOffset = 3 * sizeof(float),
+            size = vertexPointSize,
+            flipY = 1
+        };
+
+        int written = KinFuUnity.exportPointCloudVertices(pointsPtr, 0, size, ref format);
+        if (written > 0 && pointCloudVerticesUpdated != null)
+        {
+            pointCloudVerticesUpdated.Invoke(points, written);
+        }
+    }
+
     private void ProcessPoints(int numPoints)
     {
         if (numPoints <= 0)
@@ -271,35 +512,66 @@ public class KinectFusion : MonoBehaviour
             return;
         }
 
-        List<Vector3> positions = new List<Vector3>(numPoints / 3);
-        lock (threadLock)
+        List<Vector3> positions = new List<Vector3>(numPoints);
+        for (int i = 0; i < numPoints; i++)
         {
-            for (int i = 0; i < numPoints - 3; i += 3)
-            {
-                // As mentioned below - flip the Y position as OpenCV uses +Y as down
-                var point = new Vector3(points[i * 3], -points[i * 3 + 1], points[i * 3 + 2]);
+            // As mentioned below - flip the Y position as OpenCV uses +Y as down
+            var point = new Vector3(points[i * 3], -points[i * 3 + 1], points[i * 3 + 2]);
 
-                positions.Add(point);
-            }
+            positions.Add(point);
         }
 
         if (Instance.pointCloudUpdated != null)
         {
             Instance.pointCloudUpdated.Invoke(positions);
         }
+    }
+
+    // Shows the last finished render and only then asks for the next, so rendering never blocks the frame
+    // and the preview thread takes the volume away from fusion at most once per polled image
+    void UpdatePreview()
+    {
+        if (previewTex == null || previewTex.width != previewSize.x || previewTex.height != previewSize.y)
+        {
+            if (previewTex != null)
+            {
+                previewHandle.Free();
+            }
+
+            previewTex = new Texture2D(previewSize.x, previewSize.y, TextureFormat.RGBA32, false);
+            previewPixels = previewTex.GetPixels32();
+            previewHandle = GCHandle.Alloc(previewPixels, GCHandleType.Pinned);
+            previewImage.texture = previewTex;
+        }
+
+        int polled = KinFuUnity.pollPreview(previewHandle.AddrOfPinnedObject(), previewSize.x, previewSize.y);
+        if (polled == 1)
+        {
+            previewTex.SetPixels32(previewPixels);
+            previewTex.Apply();
+        }
 
-        this.numPoints = 0;
+        // A render at an old size never matches, so ask again at the new one
+        if (polled != 0)
+        {
+            previewPending = false;
+        }
+
+        if (!previewPending)
+        {
+            previewPending = KinFuUnity.requestPreview(previewSize.x, previewSize.y, null);
+        }
     }
 
     void UpdateColorImage()
     {
-        lock (threadLock)
+        if (tex == null)
         {
-            tex.SetPixels32(pixel32);
-            tex.Apply();
+            return;
         }
 
-        updateImage = false;
+        tex.SetPixels32(pixel32);
+        tex.Apply();
     }
 
     // Converts the matrix from the raw OpenCV
@@ -314,16 +586,14 @@ public class KinectFusion : MonoBehaviour
     {
         Matrix4x4 poseMatrix = new Matrix4x4();
 
-        lock (threadLock)
+        for (int row = 0; row < 4; row++)
         {
-            for (int row = 0; row < 4; row++)
+            for (int col = 0; col < 4; col++)
             {
-                for (int col = 0; col < 4; col++)
-                {
-                    poseMatrix[row, col] = poseMatrixArray[row * 4 + col];
-                }
+                poseMatrix[row, col] = poseMatrixArray[row * 4 + col];
             }
         }
+        cameraPose = poseMatrix;
 
         if (Instance.poseUpdated != null)
         {
@@ -336,37 +606,92 @@ public class KinectFusion : MonoBehaviour
     #region Kinect Control 
     public void ConnectAndStartCameras()
     {
-        var success = KinFuUnity.connectAndStartCameras();
-        Debug.LogFormat("connectAndStartCameras: {0} ({1})", success == 0, success);
+        var volume = new KinFuUnity.VolumeParams
+        {
+            volumeType = volumeType,
+            voxelSize = voxelSize,
+            truncationDistance = truncationDistance
+        };
+        if (!KinFuUnity.setVolumeParams(ref volume))
+        {
+            Debug.LogWarning("Invalid volume settings, keeping the previous volume");
+        }
+
+        var quality = new KinFuUnity.QualityPolicy
+        {
+            targetMs = frameBudgetMs,
+            raiseFraction = 0.7f,
+            lowerFrames = 15,
+            raiseFrames = 60,
+            rebuild = rebuildOnQualityChange ? 1 : 0
+        };
+        if (!KinFuUnity.setQualityPolicy(ref quality))
+        {
+            Debug.LogWarning("Invalid quality settings, keeping the previous policy");
+        }
+
+        if (!string.IsNullOrEmpty(playbackPath))
+        {
+            var opened = KinFuUnity.openPlayback(playbackPath, playbackRealtime);
+            Debug.LogFormat("openPlayback: {0} ({1})", opened == 0, opened);
+        }
+        else
+        {
+            var profile = new KinFuUnity.CaptureProfile
+            {
+                depthMode = depthMode,
+                colorResolution = colorResolution,
+                colorFormat = colorFormat,
+                fps = cameraFps,
+                depthOnly = depthOnly ? 1 : 0,
+                synchronizedImagesOnly = synchronizedImagesOnly ? 1 : 0
+            };
+            var success = KinFuUnity.connectAndStartCameras(ref profile);
+            Debug.LogFormat("connectAndStartCameras: {0} ({1})", success == 0, success);
+        }
+
+        // Size the color texture from what was actually configured, a recording may differ from the profile
+        if (KinFuUnity.getCaptureInfo(out KinFuUnity.CaptureInfo capture))
+        {
+            Debug.LogFormat("Capture: {0} depth {1}x{2}, color {3}x{4} {5}, {6} fps", capture.depthMode, capture.depthWidth, capture.depthHeight,
+                capture.colorWidth, capture.colorHeight, capture.colorFormat, capture.fps);
+            InitTexture(capture.colorWidth, capture.colorHeight);
+        }
 
         StopCheckingForDevices();
 
-        updateThread = new Thread(new ThreadStart(UpdateKinectThread));
-        Debug.LogFormat("Starting update thread");
-        runUpdateThread = true;
-        updateThread.Start();
+        KinFuUnity.setColorImageFlip(flipColorImage);
+        KinFuUnity.setCloudExtractionPolicy(cloudRefreshRate, cloudRefreshFrames);
+        KinFuUnity.setPointCloudLods(cloudLodCellSizes, cloudLodCellSizes.Length);
+
+        if (KinFuUnity.getVolumeInfo(out KinFuUnity.VolumeInfo info))
+        {
+            Debug.LogFormat("Volume: {0}, {1:F1} mm voxels, {2:F0} MB", info.volumeType, info.voxelSize * 1000f, info.residentBytes / (1024f * 1024f));
+        }
+
+        Debug.LogFormat("Starting capture thread");
+        capturing = KinFuUnity.startCaptureThread();
     }
 
     public void CloseCamera()
     {
-        if (updateThread != null && updateThread.IsAlive)
+        if (capturing)
         {
-            runUpdateThread = false;
-            updateThread.Join();
-            updateThread = null;
+            KinFuUnity.stopCaptureThread();
+            capturing = false;
         }
 
         KinFuUnity.closeDevice();
+        // Closing stops the preview thread, dropping a render still asked for
+        previewPending = false;
         Debug.Log("Device Closed");
         StartCheckingForDevices();
     }
 
     public void ResetDevice()
     {
-        lock (threadLock)
-        {
-            KinFuUnity.resetDevice();
-        }
+        // Applied by the capture thread before its next frame
+        KinFuUnity.resetDevice();
 
         Debug.Log("Device Reset");
     }
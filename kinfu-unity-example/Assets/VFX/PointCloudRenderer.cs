@@ -121,6 +121,30 @@ public class PointCloudRenderer : MonoBehaviour
         toUpdate = true;
     }
 
+    /// Creates the particles straight from x, y, z, size floats per point, as written by
+    /// exportPointCloudVertices, without touching each point. Particles use a constant color
+    /// and the bounds set in the inspector
+    public void SetParticleVertices(float[] posScale, int count) {
+        int width = count > (int)resolution ? (int)resolution : count;
+        int height = Mathf.Clamp(count / (int)resolution, 1, (int)resolution);
+
+        if (texPosScale == null || texPosScale.width != width || texPosScale.height != height) {
+            texPosScale = new Texture2D(width, height, TextureFormat.RGBAFloat, false);
+            texColor = new Texture2D(width, height, TextureFormat.RGBAFloat, false);
+
+            var white = new Color[width * height];
+            for (int i = 0; i < white.Length; i++) white[i] = Color.white;
+            texColor.SetPixels(white);
+            texColor.Apply();
+        }
+
+        texPosScale.SetPixelData(posScale, 0);
+        texPosScale.Apply();
+
+        particleCount = (uint)(width * height);
+        toUpdate = true;
+    }
+
     /// Updates visual effect shader properties if needed
     void UpdateParticles() {
         toUpdate = false;
@@ -0,0 +1,548 @@
+#include "benchmark.h"
+
+#include "../kinfu-cloud.h"
+#include "../kinfu-quantize.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <set>
+#include <stdint.h>
+
+////
+//
+// Point cloud export of a 1M point cloud from KinFu's x, y, z, padding layout
+//
+////
+
+// The original capturePointCloud export, kept as the baseline:
+// copy point by point into a global intermediate, then copy that out
+static void legacy_export(const float* points, int count, float* intermediate, float* dst)
+{
+    for (int i = 0; i < count; i++)
+    {
+        intermediate[i * 3 + 0] = points[i * 4 + 0];
+        intermediate[i * 3 + 1] = points[i * 4 + 1];
+        intermediate[i * 3 + 2] = points[i * 4 + 2];
+    }
+
+    std::memcpy(dst, intermediate, sizeof(float) * 3 * count);
+}
+
+int run_cloud_benchmark(int iterations)
+{
+    const int count = 1000000;
+
+    std::vector<float> points((size_t)count * 4);
+    for (size_t i = 0; i < points.size(); i++)
+        points[i] = (i % 4 == 3) ? 0.f : (float)(i % 1021) * 0.01f;
+
+    std::vector<float> intermediate((size_t)count * 3);
+    std::vector<float> dst((size_t)count * 4);
+
+    printf("point cloud export, %d points\n", count);
+
+    print_result("legacy (copy + intermediate)",
+        time_iterations(iterations, [&]() { legacy_export(points.data(), count, intermediate.data(), dst.data()); }),
+        (double)count * 16);
+
+    const struct
+    {
+        const char* name;
+        cloud_layout_t layout;
+        simd_level_t level;
+    } kernels[] = {
+        { "xyz scalar", CLOUD_LAYOUT_XYZ, SIMD_SCALAR },
+        { "xyz sse", CLOUD_LAYOUT_XYZ, SIMD_SSSE3 },
+        { "xyzw scalar", CLOUD_LAYOUT_XYZW, SIMD_SCALAR },
+        { "xyzw sse", CLOUD_LAYOUT_XYZW, SIMD_SSSE3 },
+    };
+
+    int status = 0;
+    for (const auto& kernel : kernels)
+    {
+        if (kernel.level > get_simd_level())
+        {
+            printf("%-32s not supported on this CPU\n", kernel.name);
+            continue;
+        }
+
+        const int components = (int)kernel.layout;
+        std::fill(dst.begin(), dst.end(), -1.f);
+        export_cloud_points(points.data(), count, dst.data(), kernel.layout, kernel.level);
+
+        for (int i = 0; i < count && status == 0; i++)
+        {
+            for (int c = 0; c < components; c++)
+            {
+                const float expected = c < 3 ? points[(size_t)i * 4 + c] : 1.f;
+                if (dst[(size_t)i * components + c] != expected)
+                {
+                    printf("%-32s MISMATCH at point %d\n", kernel.name, i);
+                    status = 1;
+                    break;
+                }
+            }
+        }
+
+        // Bytes read plus bytes written
+        print_result(kernel.name,
+            time_iterations(iterations, [&]() {
+                export_cloud_points(points.data(), count, dst.data(), kernel.layout, kernel.level);
+            }),
+            (double)count * (16 + 4 * components));
+    }
+
+    // Interleaved vertices straight from a snapshot, as Unity would upload them
+    std::vector<float> normals(points.size(), 0.5f);
+    cloud_snapshot_t cloud;
+    cloud.points = cv::Mat(count, 1, CV_32FC4, points.data());
+    cloud.normals = cv::Mat(count, 1, CV_32FC4, normals.data());
+    cloud.generation = 1;
+
+    kinfu_vertex_format_t pos_size = {};
+    pos_size.stride = 16;
+    pos_size.position_offset = 0;
+    pos_size.normal_offset = -1;
+    pos_size.color_offset = -1;
+    pos_size.size_offset = 12;
+    pos_size.size = 0.01f;
+    pos_size.flip_y = 1;
+
+    kinfu_vertex_format_t mesh = {};
+    mesh.stride = 28;
+    mesh.position_offset = 0;
+    mesh.normal_offset = 12;
+    mesh.color_offset = 24;
+    mesh.color_format = KINFU_VERTEX_COLOR_RGBA32;
+    mesh.color = 0xff8040c0;
+    mesh.size_offset = -1;
+    mesh.flip_y = 1;
+
+    const struct
+    {
+        const char* name;
+        const kinfu_vertex_format_t* format;
+    } formats[] = {
+        { "vertices position + size", &pos_size },
+        { "vertices position + normal + color", &mesh },
+    };
+
+    std::vector<uint8_t> vertices((size_t)count * 28);
+    for (const auto& format : formats)
+    {
+        if (export_cloud_vertices(cloud, 0, count, vertices.data(), *format.format) != count)
+        {
+            printf("%-32s FAILED\n", format.name);
+            status = 1;
+            continue;
+        }
+
+        // Spot check the flip and the constant attributes of the last vertex
+        float position[3];
+        memcpy(position, vertices.data() + (size_t)(count - 1) * format.format->stride, sizeof(position));
+        if (position[1] != -points[(size_t)(count - 1) * 4 + 1] ||
+            (format.format->color_offset >= 0 && vertices[(size_t)(count - 1) * format.format->stride + format.format->color_offset] != 0xc0))
+        {
+            printf("%-32s MISMATCH\n", format.name);
+            status = 1;
+        }
+
+        print_result(format.name,
+            time_iterations(iterations, [&]() {
+                export_cloud_vertices(cloud, 0, count, vertices.data(), *format.format);
+            }),
+            (double)count * (16 + format.format->stride + (format.format->normal_offset >= 0 ? 16 : 0)));
+    }
+
+    // Quantized positions and normals over a 3 m volume, with normals pointing every way
+    for (int i = 0; i < count; i++)
+    {
+        const float theta = (float)(i % 997) * 0.0063f, phi = (float)(i % 1009) * 0.0031f;
+        normals[(size_t)i * 4 + 0] = std::sin(phi) * std::cos(theta);
+        normals[(size_t)i * 4 + 1] = std::sin(phi) * std::sin(theta);
+        normals[(size_t)i * 4 + 2] = std::cos(phi);
+    }
+
+    const float box_min[3] = { 0.f, 0.f, 0.f };
+    const float box_max[3] = { 10.21f, 10.21f, 10.21f };
+    std::vector<uint8_t> quantized(quantized_cloud_size(count, KINFU_QUANTIZED_NORMALS));
+    std::vector<float> decoded_points((size_t)count * 3), decoded_normals((size_t)count * 3);
+
+    const struct
+    {
+        const char* name;
+        simd_level_t level;
+    } quantizers[] = {
+        { "quantize scalar", SIMD_SCALAR },
+        { "quantize sse", SIMD_SSSE3 },
+    };
+
+    for (const auto& quantizer : quantizers)
+    {
+        if (quantizer.level > get_simd_level())
+        {
+            printf("%-32s not supported on this CPU\n", quantizer.name);
+            continue;
+        }
+
+        kinfu_quantized_cloud_t header = {};
+        header.flags = KINFU_QUANTIZED_NORMALS;
+        set_quantized_bounds(box_min, box_max, &header);
+        encode_quantized_cloud(points.data(), normals.data(), NULL, count, quantized.data(), &header, quantizer.level);
+        decode_quantized_cloud(quantized.data(), header, decoded_points.data(), decoded_normals.data(), NULL, quantizer.level);
+
+        // Every decoded point must be within the error the encoder reported
+        for (int i = 0; i < count && status == 0; i++)
+        {
+            float distance2 = 0.f, dot = 0.f;
+            for (int c = 0; c < 3; c++)
+            {
+                const float d = decoded_points[(size_t)i * 3 + c] - points[(size_t)i * 4 + c];
+                distance2 += d * d;
+                dot += decoded_normals[(size_t)i * 3 + c] * normals[(size_t)i * 4 + c];
+            }
+
+            const float angle = std::acos(std::min(dot, 1.f)) * 57.2958f;
+            if (std::sqrt(distance2) > header.max_position_error * 1.001f + 1e-6f || angle > header.max_normal_error + 0.1f)
+            {
+                printf("%-32s MISMATCH at point %d\n", quantizer.name, i);
+                status = 1;
+            }
+        }
+
+        printf("%-32s %zu bytes, max error %.3f mm, %.2f degrees\n", quantizer.name, quantized.size(),
+            header.max_position_error * 1000.f, header.max_normal_error);
+
+        // Points and normals read, codes written
+        print_result("  encode",
+            time_iterations(iterations, [&]() {
+                encode_quantized_cloud(points.data(), normals.data(), NULL, count, quantized.data(), &header, quantizer.level);
+            }),
+            (double)count * (32 + 8));
+
+        print_result("  decode",
+            time_iterations(iterations, [&]() {
+                decode_quantized_cloud(quantized.data(), header, decoded_points.data(), decoded_normals.data(), NULL, quantizer.level);
+            }),
+            (double)count * (8 + 24));
+    }
+
+    // LODs of a wavy 3 x 3 m surface sampled every 3 mm, as a scanned wall would look
+    std::vector<float> surface((size_t)count * 4);
+    for (int i = 0; i < count; i++)
+    {
+        const float x = (i % 1000) * 0.003f, y = (i / 1000) * 0.003f;
+        surface[(size_t)i * 4 + 0] = x;
+        surface[(size_t)i * 4 + 1] = y;
+        surface[(size_t)i * 4 + 2] = 1.5f + 0.2f * std::sin(x * 3.f) * std::cos(y * 2.f);
+        surface[(size_t)i * 4 + 3] = 0.f;
+    }
+
+    cloud_snapshot_t scan = {};
+    scan.points = cv::Mat(count, 1, CV_32FC4, surface.data());
+    scan.normals = cloud.normals;
+    scan.generation = 1;
+
+    const float cell_sizes[] = { 0.01f, 0.02f, 0.05f, 0.1f };
+    build_cloud_lods(scan, cell_sizes, 4);
+
+    for (size_t level = 0; level < scan.lods.size(); level++)
+    {
+        // Every occupied cell must be kept exactly once
+        const cloud_snapshot_t& source = level == 0 ? scan : *scan.lods[level - 1];
+        const cloud_snapshot_t& lod = *scan.lods[level];
+        const float cell = cell_sizes[level];
+
+        std::set<int64_t> source_cells, lod_cells;
+        for (int i = 0; i < source.points.rows; i++)
+        {
+            const float* p = source.points.ptr<float>(i);
+            source_cells.insert(((int64_t)std::floor(p[0] * (1.f / cell)) * 4096 + (int64_t)std::floor(p[1] * (1.f / cell))) * 4096 + (int64_t)std::floor(p[2] * (1.f / cell)));
+        }
+        for (int i = 0; i < lod.points.rows; i++)
+        {
+            const float* p = lod.points.ptr<float>(i);
+            lod_cells.insert(((int64_t)std::floor(p[0] * (1.f / cell)) * 4096 + (int64_t)std::floor(p[1] * (1.f / cell))) * 4096 + (int64_t)std::floor(p[2] * (1.f / cell)));
+        }
+
+        if (lod_cells.size() != (size_t)lod.points.rows || lod_cells != source_cells || lod.normals.rows != lod.points.rows)
+        {
+            printf("lod %.2f m MISMATCH\n", cell);
+            status = 1;
+        }
+
+        printf("lod %.2f m                       %d points\n", cell, lod.points.rows);
+    }
+
+    cv::Mat filtered_points, filtered_normals, filtered_colors;
+    const struct
+    {
+        const char* name;
+        simd_level_t level;
+    } filters[] = {
+        { "voxel filter 1 cm scalar", SIMD_SCALAR },
+        { "voxel filter 1 cm sse", SIMD_SSSE3 },
+    };
+
+    for (const auto& filter : filters)
+    {
+        if (filter.level > get_simd_level())
+        {
+            printf("%-32s not supported on this CPU\n", filter.name);
+            continue;
+        }
+
+        voxel_filter_cloud(scan.points, scan.normals, scan.colors, cell_sizes[0], filtered_points, filtered_normals, filtered_colors, filter.level);
+        if (filtered_points.rows != scan.lods[0]->points.rows ||
+            memcmp(filtered_points.ptr(), scan.lods[0]->points.ptr(), (size_t)filtered_points.rows * 16) != 0)
+        {
+            printf("%-32s MISMATCH\n", filter.name);
+            status = 1;
+        }
+
+        print_result(filter.name,
+            time_iterations(iterations, [&]() {
+                voxel_filter_cloud(scan.points, scan.normals, scan.colors, cell_sizes[0], filtered_points, filtered_normals, filtered_colors, filter.level);
+            }),
+            (double)count * 32);
+    }
+
+    print_result("lods 1, 2, 5, 10 cm",
+        time_iterations(iterations, [&]() { build_cloud_lods(scan, cell_sizes, 4); }),
+        (double)count * 32);
+
+    // Cull to a box over a quarter of the scan, and to a camera 1.5 m back looking at it
+    const float half_extents[3] = { 0.75f, 0.75f, 0.5f };
+    kinfu_cull_region_t box, frustum;
+    make_box_region(cv::Matx44f(1, 0, 0, 0.75f, 0, 1, 0, 0.75f, 0, 0, 1, 1.5f, 0, 0, 0, 1), half_extents, box);
+    make_frustum_region(cv::Matx44f(1, 0, 0, 1.5f, 0, 1, 0, 1.5f, 0, 0, 1, 0.f, 0, 0, 0, 1),
+        cv::Matx33f(504.f, 0, 320.f, 0, 504.f, 288.f, 0, 0, 1), cv::Size(640, 576), 0.5f, 1.6f, frustum);
+
+    const struct
+    {
+        const char* name;
+        const kinfu_cull_region_t* region;
+        simd_level_t level;
+    } culls[] = {
+        { "cull box scalar", &box, SIMD_SCALAR },
+        { "cull box sse", &box, SIMD_SSSE3 },
+        { "cull frustum scalar", &frustum, SIMD_SCALAR },
+        { "cull frustum sse", &frustum, SIMD_SSSE3 },
+    };
+
+    cloud_snapshot_t culled = {};
+    for (const auto& cull : culls)
+    {
+        if (cull.level > get_simd_level())
+        {
+            printf("%-32s not supported on this CPU\n", cull.name);
+            continue;
+        }
+
+        // Count the points inside every plane the slow way
+        int expected = 0;
+        for (int i = 0; i < count; i++)
+        {
+            bool in = true;
+            for (int p = 0; p < cull.region->plane_count; p++)
+            {
+                const float* plane = cull.region->planes[p];
+                in = in && plane[0] * surface[(size_t)i * 4] + plane[1] * surface[(size_t)i * 4 + 1] + plane[2] * surface[(size_t)i * 4 + 2] + plane[3] >= 0.f;
+            }
+            expected += in;
+        }
+
+        cull_cloud(scan, *cull.region, culled, cull.level);
+        if (culled.points.rows != expected || culled.normals.rows != expected)
+        {
+            printf("%-32s MISMATCH %d vs %d points\n", cull.name, culled.points.rows, expected);
+            status = 1;
+        }
+
+        printf("%-32s %d points\n", cull.name, culled.points.rows);
+        print_result("  cull",
+            time_iterations(iterations, [&]() { cull_cloud(scan, *cull.region, culled, cull.level); }),
+            (double)count * 16 + (double)culled.points.rows * 32);
+    }
+
+    // 5 cm blocks of the same surface, then a delta after a bump is pushed into one corner of it
+    const float block_size = 0.05f;
+    cloud_block_history_t history = {};
+    cloud_snapshot_t blocked = {};
+    blocked.points = scan.points;
+    blocked.normals = scan.normals;
+    blocked.generation = 1;
+    partition_cloud_blocks(blocked, block_size, SIMD_SCALAR);
+    update_block_history(history, blocked);
+
+    int blocked_points = 0;
+    bool blocks_ok = blocked.block_points.size() == (size_t)count;
+    for (size_t b = 0; b < blocked.blocks.size() && blocks_ok; b++)
+    {
+        const cloud_block_t& block = blocked.blocks[b];
+        blocks_ok = block.offset == blocked_points && (b == 0 || blocked.blocks[b - 1].key < block.key);
+
+        int coords[3];
+        unpack_block_key(block.key, coords);
+        for (int k = block.offset; k < block.offset + block.count && blocks_ok; k++)
+        {
+            const float* p = blocked.points.ptr<float>(blocked.block_points[k]);
+            for (int c = 0; c < 3; c++)
+                blocks_ok = blocks_ok && (int)std::floor(p[c] * (1.f / block_size)) == coords[c];
+        }
+        blocked_points += block.count;
+    }
+
+    const simd_level_t block_levels[] = { SIMD_SCALAR, SIMD_SSSE3 };
+    for (simd_level_t level : block_levels)
+    {
+        const char* name = level == SIMD_SCALAR ? "blocks 5 cm scalar" : "blocks 5 cm sse";
+        if (level > get_simd_level())
+        {
+            printf("%-32s not supported on this CPU\n", name);
+            continue;
+        }
+
+        cloud_snapshot_t partitioned = {};
+        partitioned.points = scan.points;
+        partitioned.generation = 1;
+        partition_cloud_blocks(partitioned, block_size, level);
+        bool same = partitioned.blocks.size() == blocked.blocks.size() && partitioned.block_points == blocked.block_points;
+        for (size_t b = 0; b < blocked.blocks.size() && same; b++)
+            same = partitioned.blocks[b].key == blocked.blocks[b].key && partitioned.blocks[b].hash == blocked.blocks[b].hash;
+
+        if (!blocks_ok || blocked_points != count || !same)
+        {
+            printf("%-32s MISMATCH\n", name);
+            status = 1;
+            continue;
+        }
+
+        printf("%-32s %zu blocks\n", name, partitioned.blocks.size());
+        print_result("  partition",
+            time_iterations(iterations, [&]() {
+                partitioned.points = scan.points;
+                partition_cloud_blocks(partitioned, block_size, level);
+            }),
+            (double)count * (16 + 4));
+    }
+
+    std::vector<float> bumped(surface);
+    for (int i = 0; i < count; i++)
+    {
+        float* p = &bumped[(size_t)i * 4];
+        if (p[0] < 0.3f && p[1] < 0.3f)
+            p[2] += 0.01f;
+    }
+
+    cloud_snapshot_t next = {};
+    next.points = cv::Mat(count, 1, CV_32FC4, bumped.data());
+    next.generation = 2;
+    partition_cloud_blocks(next, block_size);
+    update_block_history(history, next);
+
+    // Every block that lost or gained a point or had one moved has to be listed, and no other
+    std::set<uint64_t> before_keys, after_keys, expected_keys;
+    for (const cloud_block_t& block : blocked.blocks)
+        before_keys.insert(block.key);
+    for (const cloud_block_t& block : next.blocks)
+    {
+        after_keys.insert(block.key);
+        const auto previous = std::lower_bound(blocked.blocks.begin(), blocked.blocks.end(), block,
+            [](const cloud_block_t& a, const cloud_block_t& b) { return a.key < b.key; });
+        bool moved = previous == blocked.blocks.end() || previous->key != block.key || previous->count != block.count;
+        for (int k = 0; k < block.count && !moved; k++)
+        {
+            moved = memcmp(blocked.points.ptr<float>(blocked.block_points[previous->offset + k]),
+                next.points.ptr<float>(next.block_points[block.offset + k]), 12) != 0;
+        }
+        if (moved)
+            expected_keys.insert(block.key);
+    }
+
+    cloud_snapshot_t delta = {};
+    std::vector<kinfu_cloud_block_t> delta_blocks;
+    kinfu_cloud_delta_t delta_header;
+    extract_cloud_delta(next, 1, delta, delta_blocks, delta_header);
+
+    int expected_removed = 0;
+    for (uint64_t key : before_keys)
+        expected_removed += after_keys.count(key) == 0;
+
+    bool delta_ok = !delta_header.full && delta_header.removed_count == expected_removed &&
+        delta_header.block_count - delta_header.removed_count == (int)expected_keys.size();
+    for (int b = 0; b < delta_header.block_count - delta_header.removed_count && delta_ok; b++)
+    {
+        const kinfu_cloud_block_t& entry = delta_blocks[b];
+        const uint64_t key = ((uint64_t)(entry.x + (1 << 20)) << 42) | ((uint64_t)(entry.y + (1 << 20)) << 21) | (uint64_t)(entry.z + (1 << 20));
+        delta_ok = expected_keys.count(key) == 1;
+    }
+
+    if (!delta_ok)
+    {
+        printf("delta                            MISMATCH\n");
+        status = 1;
+    }
+    else
+    {
+        printf("delta after a 30 cm bump         %d of %zu blocks, %d removed, %d points\n",
+            delta_header.block_count - delta_header.removed_count, next.blocks.size(), delta_header.removed_count, delta_header.point_count);
+        print_result("  history",
+            time_iterations(iterations, [&]() { update_block_history(history, next); }),
+            (double)next.blocks.size() * sizeof(cloud_block_t));
+        print_result("  extract",
+            time_iterations(iterations, [&]() { extract_cloud_delta(next, 1, delta, delta_blocks, delta_header); }),
+            (double)delta_header.point_count * 32);
+    }
+
+    // Organized back-projection of an NFOV unbinned depth frame, with a hole every 7th pixel
+    const cv::Size frame_size(640, 576);
+    std::vector<uint16_t> depth_pixels((size_t)frame_size.area());
+    for (size_t i = 0; i < depth_pixels.size(); i++)
+        depth_pixels[i] = i % 7 == 0 ? 0 : (uint16_t)(800 + i % 2000);
+
+    const cv::Mat depth(frame_size.height, frame_size.width, CV_16UC1, depth_pixels.data());
+    const cv::Matx33f intrinsics(504.f, 0, 320.f, 0, 504.f, 288.f, 0, 0, 1);
+    const cv::Matx44f camera_pose(0.f, -1.f, 0.f, 0.1f, 1.f, 0.f, 0.f, 0.2f, 0.f, 0.f, 1.f, 0.3f, 0.f, 0.f, 0.f, 1.f);
+    std::vector<float> reference((size_t)frame_size.area() * 4), organized((size_t)frame_size.area() * 4);
+
+    for (int downsample = 1; downsample <= 3; downsample++)
+    {
+        const cv::Size map_size = organized_map_size(frame_size, downsample);
+        const size_t floats = (size_t)map_size.area() * 4;
+        backproject_depth(depth, intrinsics, 1000.f, camera_pose, downsample, reference.data(), SIMD_SCALAR);
+
+        const simd_level_t levels[] = { SIMD_SCALAR, SIMD_SSSE3 };
+        for (simd_level_t level : levels)
+        {
+            char name[64];
+            snprintf(name, sizeof(name), "organized /%d %s", downsample, level == SIMD_SCALAR ? "scalar" : "sse");
+            if (level > get_simd_level())
+            {
+                printf("%-32s not supported on this CPU\n", name);
+                continue;
+            }
+
+            backproject_depth(depth, intrinsics, 1000.f, camera_pose, downsample, organized.data(), level);
+            for (size_t i = 0; i < floats && status == 0; i++)
+            {
+                const bool both_nan = std::isnan(organized[i]) && std::isnan(reference[i]);
+                if (!both_nan && std::abs(organized[i] - reference[i]) > 1e-5f)
+                {
+                    printf("%-32s MISMATCH at float %zu\n", name, i);
+                    status = 1;
+                }
+            }
+
+            // Depth read plus vertices written
+            print_result(name,
+                time_iterations(iterations, [&]() {
+                    backproject_depth(depth, intrinsics, 1000.f, camera_pose, downsample, organized.data(), level);
+                }),
+                (double)map_size.area() * (2 + 16));
+        }
+    }
+
+    return status;
+}
@@ -0,0 +1,95 @@
+#include "benchmark.h"
+
+#include "../kinfu-color.h"
+
+#include <cstring>
+#include <stdint.h>
+
+////
+//
+// BGRA -> RGBA swizzle of a 1080p color frame
+//
+////
+
+// The original captureColorImage conversion, kept as the baseline:
+// allocate, clear, swizzle one byte at a time, then copy out
+static void legacy_swizzle(const uint8_t* buffer, size_t size, uint8_t* data)
+{
+    uint8_t* flipped = new uint8_t[size];
+    std::memset(flipped, 0x0, size);
+
+    for (size_t i = 0; i < size - 4; i += 4)
+    {
+        flipped[i + 2] = buffer[i + 0];
+        flipped[i + 1] = buffer[i + 1];
+        flipped[i + 0] = buffer[i + 2];
+        flipped[i + 3] = buffer[i + 3];
+    }
+
+    std::memcpy(data, flipped, size);
+    delete[] flipped;
+}
+
+int run_color_benchmark(int iterations)
+{
+    const int width = 1920;
+    const int height = 1080;
+    const size_t size = (size_t)width * height * 4;
+
+    std::vector<uint8_t> src(size);
+    std::vector<uint8_t> dst(size);
+    std::vector<uint8_t> expected(size);
+
+    for (size_t i = 0; i < size; i++)
+        src[i] = (uint8_t)(i * 31 + 7);
+
+    printf("color swizzle %dx%d BGRA32 (%zu bytes)\n", width, height, size);
+
+    // The legacy loop skips the last pixel, so compare against the scalar kernel
+    swizzle_bgra_to_rgba(src.data(), width * 4, expected.data(), width, height, false, SIMD_SCALAR);
+
+    print_result("legacy (alloc + scalar + copy)",
+        time_iterations(iterations, [&]() { legacy_swizzle(src.data(), size, dst.data()); }),
+        (double)size);
+
+    const struct
+    {
+        const char* name;
+        simd_level_t level;
+    } kernels[] = {
+        { "scalar", SIMD_SCALAR },
+        { "ssse3", SIMD_SSSE3 },
+        { "avx2", SIMD_AVX2 },
+    };
+
+    int status = 0;
+    for (const auto& kernel : kernels)
+    {
+        if (kernel.level > get_simd_level())
+        {
+            printf("%-32s not supported on this CPU\n", kernel.name);
+            continue;
+        }
+
+        swizzle_bgra_to_rgba(src.data(), width * 4, dst.data(), width, height, false, kernel.level);
+        if (dst != expected)
+        {
+            printf("%-32s MISMATCH\n", kernel.name);
+            status = 1;
+        }
+
+        print_result(kernel.name,
+            time_iterations(iterations, [&]() {
+                swizzle_bgra_to_rgba(src.data(), width * 4, dst.data(), width, height, false, kernel.level);
+            }),
+            (double)size);
+    }
+
+    print_result("dispatched + vertical flip",
+        time_iterations(iterations, [&]() {
+            swizzle_bgra_to_rgba(src.data(), width * 4, dst.data(), width, height, true);
+        }),
+        (double)size);
+
+    return status;
+}
@@ -0,0 +1,514 @@
+#include "benchmark.h"
+
+#include "../kinfu-cloud.h"
+#include "../kinfu-color.h"
+#include "../kinfu-helpers.h"
+
+#include <k4arecord/playback.h>
+
+#include <atomic>
+#include <cfloat>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <string>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+////
+//
+// Full capture -> undistort -> fuse -> export pipeline, driven by a recording
+// or a synthetic depth stream, reported as JSON.
+//
+// A single threaded version of the plugin's frame path with a dense TSDF KinFu,
+// built from the same helpers, that swizzles color, undistorts and fuses every
+// frame and exports the whole cloud after each update. It leaves out what the
+// capture thread has gained since: extraction on the cloud thread with its LODs
+// and blocks, color registration for colored volumes, the other volume types
+// and the quality controller's frame stride.
+//
+////
+
+// Heap allocations made through operator new anywhere in the process (std containers, Ptr, ...).
+// OpenCV allocates Mat data with malloc, which is not counted here.
+static std::atomic<uint64_t> heap_allocations(0);
+
+void* operator new(size_t size)
+{
+    heap_allocations++;
+    if (void* p = malloc(size != 0 ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept
+{
+    free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+    free(p);
+}
+
+static size_t peak_rss_bytes()
+{
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+        return counters.PeakWorkingSetSize;
+    return 0;
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0)
+        return (size_t)usage.ru_maxrss * 1024;
+    return 0;
+#endif
+}
+
+// Same cap as the plugin's capturePointCloud
+static const int max_points = 1000000;
+
+// Color frame size used for the synthetic stream, as configured by setupConfigAndCalibrate()
+static const int synthetic_color_width = 1920;
+static const int synthetic_color_height = 1080;
+
+////
+//
+// Synthetic source
+//
+////
+
+static void hit_plane(float origin, float dir, float plane, float& t)
+{
+    if (fabsf(dir) > 1e-6f)
+    {
+        float s = (plane - origin) / dir;
+        if (s > 0.f && s < t)
+            t = s;
+    }
+}
+
+static void hit_box(const float o[3], const float d[3], const float lo[3], const float hi[3], float& t)
+{
+    float near_t = 0.f;
+    float far_t = FLT_MAX;
+
+    for (int k = 0; k < 3; k++)
+    {
+        if (fabsf(d[k]) < 1e-6f)
+        {
+            if (o[k] < lo[k] || o[k] > hi[k])
+                return;
+            continue;
+        }
+
+        float a = (lo[k] - o[k]) / d[k];
+        float b = (hi[k] - o[k]) / d[k];
+        near_t = std::max(near_t, std::min(a, b));
+        far_t = std::min(far_t, std::max(a, b));
+    }
+
+    if (near_t > 0.f && near_t <= far_t && near_t < t)
+        t = near_t;
+}
+
+static void hit_sphere(const float o[3], const float d[3], const float c[3], float r, float& t)
+{
+    const float oc[3] = { o[0] - c[0], o[1] - c[1], o[2] - c[2] };
+    const float a = d[0] * d[0] + d[1] * d[1] + d[2] * d[2];
+    const float b = oc[0] * d[0] + oc[1] * d[1] + oc[2] * d[2];
+    const float cc = oc[0] * oc[0] + oc[1] * oc[1] + oc[2] * oc[2] - r * r;
+    const float disc = b * b - a * cc;
+
+    if (disc > 0.f)
+    {
+        float s = (-b - sqrtf(disc)) / a;
+        if (s > 0.f && s < t)
+            t = s;
+    }
+}
+
+// Depth in millimetres of a room with a pillar and a ball, seen from a camera that sways and turns a
+// little each frame. OpenCV camera axes (y down), so the floor is at +y.
+static void render_synthetic_depth(uint16_t* depth, const pinhole_t& pinhole, int frame)
+{
+    const float phase = frame * 0.02f;
+    const float yaw = 0.08f * sinf(phase);
+    const float cos_yaw = cosf(yaw);
+    const float sin_yaw = sinf(yaw);
+    const float o[3] = { 0.25f * sinf(phase * 0.7f), 0.05f * sinf(phase * 1.3f), 0.2f * sinf(phase * 0.5f) };
+
+    const float pillar_lo[3] = { -1.2f, -0.2f, 2.5f };
+    const float pillar_hi[3] = { -0.6f, 1.2f, 3.1f };
+    const float ball[3] = { 0.5f, 0.6f, 2.2f };
+
+    for (int y = 0, idx = 0; y < pinhole.height; y++)
+    {
+        for (int x = 0; x < pinhole.width; x++, idx++)
+        {
+            // Ray with a camera space z of 1, so the hit distance is also the depth
+            const float cx = (x - pinhole.px) / pinhole.fx;
+            const float cy = (y - pinhole.py) / pinhole.fy;
+            const float d[3] = { cos_yaw * cx + sin_yaw, cy, -sin_yaw * cx + cos_yaw };
+
+            float t = FLT_MAX;
+            hit_plane(o[0], d[0], -2.0f, t);
+            hit_plane(o[0], d[0], 2.0f, t);
+            hit_plane(o[1], d[1], -1.5f, t);
+            hit_plane(o[1], d[1], 1.2f, t);
+            hit_plane(o[2], d[2], 4.0f, t);
+            hit_box(o, d, pillar_lo, pillar_hi, t);
+            hit_sphere(o, d, ball, 0.5f, t);
+
+            depth[idx] = t < 10.f ? (uint16_t)(t * 1000.f + 0.5f) : 0;
+        }
+    }
+}
+
+// Half pixel shifted identity LUT, so every pixel takes the full bilinear path
+static void create_synthetic_lut(const pinhole_t& pinhole, undistortion_lut_t* lut)
+{
+    const float weight[4] = { 0.25f, 0.25f, 0.25f, 0.25f };
+
+    allocate_undistortion_lut(lut, pinhole.width, pinhole.height, pinhole.width, INTERPOLATION_BILINEAR_DEPTH);
+    for (int y = 0, idx = 0; y < pinhole.height; y++)
+    {
+        for (int x = 0; x < pinhole.width; x++, idx++)
+        {
+            if (x + 1 < pinhole.width && y + 1 < pinhole.height)
+                set_undistortion_lut_entry(lut, idx, x, y, weight);
+        }
+    }
+}
+
+////
+//
+// Results
+//
+////
+
+typedef struct _stage_samples_t
+{
+    const char* name;
+    std::vector<double> ms;
+} stage_samples_t;
+
+enum
+{
+    STAGE_CAPTURE,
+    STAGE_COLOR,
+    STAGE_REMAP,
+    STAGE_UPDATE,
+    STAGE_GET_CLOUD,
+    STAGE_EXPORT,
+    STAGE_FRAME,
+    STAGE_COUNT
+};
+
+static void print_stage_json(const stage_samples_t& stage, bool last)
+{
+    double mean = 0.0;
+    for (double v : stage.ms)
+        mean += v;
+    if (!stage.ms.empty())
+        mean /= stage.ms.size();
+
+    printf("    \"%s\": { \"samples\": %zu, \"mean_ms\": %.4f, \"p50_ms\": %.4f, \"p95_ms\": %.4f, \"p99_ms\": %.4f, \"max_ms\": %.4f }%s\n",
+        stage.name,
+        stage.ms.size(),
+        mean,
+        percentile(stage.ms, 50),
+        percentile(stage.ms, 95),
+        percentile(stage.ms, 99),
+        percentile(stage.ms, 100),
+        last ? "" : ",");
+}
+
+static double elapsed_ms(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+int run_pipeline_benchmark(int frames, const char* recording)
+{
+    const bool synthetic = recording == NULL;
+    const int warmup_frames = 3;
+
+    k4a_playback_t playback = NULL;
+    k4a_calibration_t calibration;
+    bool color_from_recording = false;
+
+    pinhole_t pinhole;
+    undistortion_lut_t lut;
+
+    auto lut_start = std::chrono::steady_clock::now();
+    if (synthetic)
+    {
+        // Roughly the NFOV unbinned pinhole the plugin derives from a real calibration
+        pinhole.width = 640;
+        pinhole.height = 576;
+        pinhole.fx = 504.f;
+        pinhole.fy = 504.f;
+        pinhole.px = 320.f;
+        pinhole.py = 288.f;
+        create_synthetic_lut(pinhole, &lut);
+    }
+    else
+    {
+        k4a_record_configuration_t record_config;
+        if (K4A_RESULT_SUCCEEDED != k4a_playback_open(recording, &playback) ||
+            K4A_RESULT_SUCCEEDED != k4a_playback_get_record_configuration(playback, &record_config) ||
+            !record_config.depth_track_enabled ||
+            K4A_RESULT_SUCCEEDED != k4a_playback_get_calibration(playback, &calibration))
+        {
+            fprintf(stderr, "Failed to open recording '%s' with a depth track\n", recording);
+            if (playback != NULL)
+                k4a_playback_close(playback);
+            return 1;
+        }
+
+        color_from_recording = record_config.color_track_enabled &&
+            (record_config.color_format == K4A_IMAGE_FORMAT_COLOR_BGRA32 ||
+             K4A_RESULT_SUCCEEDED == k4a_playback_set_color_conversion(playback, K4A_IMAGE_FORMAT_COLOR_BGRA32));
+
+        pinhole = create_pinhole_from_xy_range(&calibration, K4A_CALIBRATION_TYPE_DEPTH);
+        create_undistortion_lut(&calibration, K4A_CALIBRATION_TYPE_DEPTH, &pinhole, &lut, INTERPOLATION_BILINEAR_DEPTH);
+    }
+    const double lut_build_ms = elapsed_ms(lut_start);
+
+    Ptr<kinfu::Params> params = kinfu::Params::defaultParams();
+    initialize_kinfu_params(*params, pinhole.width, pinhole.height, pinhole.fx, pinhole.fy, pinhole.px, pinhole.py);
+    setUseOptimized(true);
+    Ptr<kinfu::KinFu> kf = kinfu::KinFu::create(params);
+
+    frame_pool_t pool;
+    create_frame_pool(pool, pinhole);
+
+    // Synthetic frames are rendered into a k4a image so remap sees the same input as from a device
+    k4a_image_t synthetic_depth = NULL;
+    std::vector<uint8_t> synthetic_color;
+    if (synthetic)
+    {
+        k4a_image_create(K4A_IMAGE_FORMAT_DEPTH16, pinhole.width, pinhole.height, pinhole.width * (int)sizeof(uint16_t), &synthetic_depth);
+
+        synthetic_color.resize((size_t)synthetic_color_width * synthetic_color_height * 4);
+        for (size_t i = 0; i < synthetic_color.size(); i++)
+            synthetic_color[i] = (uint8_t)(i * 7);
+    }
+
+    // Caller-side buffers, as Unity pins them
+    std::vector<uint8_t> color_out((size_t)synthetic_color_width * synthetic_color_height * 4);
+    std::vector<float> points_out((size_t)max_points * 3);
+
+    stage_samples_t stages[STAGE_COUNT] = {
+        { "capture", {} }, { "color", {} }, { "remap", {} }, { "update", {} },
+        { "get_cloud", {} }, { "export_points", {} }, { "frame", {} }
+    };
+    for (int s = 0; s < STAGE_COUNT; s++)
+        stages[s].ms.reserve(frames);
+
+    int processed = 0;
+    int tracked = 0;
+    int failed_updates = 0;
+    int capped_clouds = 0;
+    uint64_t total_points = 0;
+    int max_cloud_points = 0;
+    int pool_allocations = 0;
+    uint64_t heap_allocations_start = 0;
+    double pipeline_ms = 0.0;
+
+    for (int frame = 0; frame < frames + warmup_frames; frame++)
+    {
+        const bool measured = frame >= warmup_frames;
+        if (frame == warmup_frames)
+            heap_allocations_start = heap_allocations;
+
+        double ms[STAGE_COUNT] = {};
+
+        // Capture
+        k4a_capture_t capture = NULL;
+        k4a_image_t depth_image = NULL;
+        auto start = std::chrono::steady_clock::now();
+        if (synthetic)
+        {
+            render_synthetic_depth((uint16_t*)(void*)k4a_image_get_buffer(synthetic_depth), pinhole, frame);
+            depth_image = synthetic_depth;
+            k4a_image_reference(depth_image);
+        }
+        else
+        {
+            while (depth_image == NULL)
+            {
+                if (K4A_STREAM_RESULT_SUCCEEDED != k4a_playback_get_next_capture(playback, &capture))
+                    break;
+
+                depth_image = k4a_capture_get_depth_image(capture);
+                if (depth_image == NULL)
+                {
+                    k4a_capture_release(capture);
+                    capture = NULL;
+                }
+            }
+
+            if (depth_image == NULL)
+                break;
+        }
+        ms[STAGE_CAPTURE] = elapsed_ms(start);
+
+        auto frame_start = std::chrono::steady_clock::now();
+
+        // Color
+        start = std::chrono::steady_clock::now();
+        if (synthetic)
+        {
+            swizzle_bgra_to_rgba(synthetic_color.data(), synthetic_color_width * 4, color_out.data(),
+                synthetic_color_width, synthetic_color_height, true);
+        }
+        else if (color_from_recording)
+        {
+            k4a_image_t color_image = k4a_capture_get_color_image(capture);
+            if (color_image != NULL)
+            {
+                const int width = k4a_image_get_width_pixels(color_image);
+                const int height = k4a_image_get_height_pixels(color_image);
+                if ((size_t)width * height * 4 <= color_out.size())
+                {
+                    swizzle_bgra_to_rgba(k4a_image_get_buffer(color_image), k4a_image_get_stride_bytes(color_image),
+                        color_out.data(), width, height, true);
+                }
+                k4a_image_release(color_image);
+            }
+        }
+        ms[STAGE_COLOR] = elapsed_ms(start);
+
+        // Undistort
+        start = std::chrono::steady_clock::now();
+        pool_allocations += measured ? create_frame_pool(pool, pinhole) : 0;
+        {
+            Mat undistorted_view = pool.undistorted_depth.getMat(ACCESS_WRITE);
+            remap(depth_image, &lut, undistorted_view.ptr<uint16_t>());
+        }
+        k4a_image_release(depth_image);
+        ms[STAGE_REMAP] = elapsed_ms(start);
+
+        // Fuse
+        start = std::chrono::steady_clock::now();
+        const bool update_ok = kf->update(pool.undistorted_depth);
+        ms[STAGE_UPDATE] = elapsed_ms(start);
+
+        // Export
+        int cloud_points = 0;
+        if (update_ok)
+        {
+            start = std::chrono::steady_clock::now();
+            Mat points;
+            kf->getPoints(points);
+            ms[STAGE_GET_CLOUD] = elapsed_ms(start);
+
+            start = std::chrono::steady_clock::now();
+            cloud_points = points.rows;
+            if (cloud_points <= max_points)
+            {
+                export_cloud_points(points.ptr<float>(), cloud_points, points_out.data(), CLOUD_LAYOUT_XYZ);
+            }
+            ms[STAGE_EXPORT] = elapsed_ms(start);
+        }
+
+        ms[STAGE_FRAME] = elapsed_ms(frame_start);
+
+        if (capture != NULL)
+            k4a_capture_release(capture);
+
+        if (!measured)
+            continue;
+
+        processed++;
+
+        // Rendering a synthetic frame is not pipeline work, so only recorded captures count towards fps
+        pipeline_ms += ms[STAGE_FRAME] + (synthetic ? 0.0 : ms[STAGE_CAPTURE]);
+
+        if (update_ok)
+        {
+            tracked++;
+            total_points += cloud_points;
+            max_cloud_points = std::max(max_cloud_points, cloud_points);
+            if (cloud_points > max_points)
+                capped_clouds++;
+        }
+        else
+        {
+            failed_updates++;
+        }
+
+        for (int s = 0; s < STAGE_COUNT; s++)
+        {
+            // Stages that did not run this frame would only drag the percentiles down
+            if ((s == STAGE_GET_CLOUD || s == STAGE_EXPORT) && !update_ok)
+                continue;
+            if (s == STAGE_COLOR && !synthetic && !color_from_recording)
+                continue;
+
+            stages[s].ms.push_back(ms[s]);
+        }
+    }
+
+    const uint64_t measured_heap_allocations = heap_allocations - heap_allocations_start;
+
+    if (synthetic_depth != NULL)
+        k4a_image_release(synthetic_depth);
+    if (playback != NULL)
+        k4a_playback_close(playback);
+
+    if (processed == 0)
+    {
+        fprintf(stderr, "No frames were processed\n");
+        return 1;
+    }
+
+    printf("{\n");
+    printf("  \"source\": \"%s\",\n", synthetic ? "synthetic" : "recording");
+    if (!synthetic)
+    {
+        // Paths are printed as given, escaping only what JSON requires of Windows paths
+        std::string escaped;
+        for (const char* c = recording; *c != '\0'; c++)
+        {
+            if (*c == '\\' || *c == '"')
+                escaped += '\\';
+            escaped += *c;
+        }
+        printf("  \"recording\": \"%s\",\n", escaped.c_str());
+    }
+    printf("  \"width\": %d,\n", pinhole.width);
+    printf("  \"height\": %d,\n", pinhole.height);
+    printf("  \"threads\": %d,\n", getNumThreads());
+    printf("  \"simd_level\": %d,\n", (int)get_simd_level());
+    printf("  \"lut_build_ms\": %.3f,\n", lut_build_ms);
+    printf("  \"frames\": %d,\n", processed);
+    printf("  \"warmup_frames\": %d,\n", warmup_frames);
+    printf("  \"tracked_frames\": %d,\n", tracked);
+    printf("  \"failed_updates\": %d,\n", failed_updates);
+    printf("  \"capped_clouds\": %d,\n", capped_clouds);
+    printf("  \"mean_points\": %.1f,\n", tracked > 0 ? (double)total_points / tracked : 0.0);
+    printf("  \"max_points\": %d,\n", max_cloud_points);
+    printf("  \"fps\": %.2f,\n", processed / (pipeline_ms * 1e-3));
+    printf("  \"peak_rss_bytes\": %zu,\n", peak_rss_bytes());
+    printf("  \"heap_allocations_per_frame\": %.2f,\n", (double)measured_heap_allocations / processed);
+    printf("  \"pool_allocations_per_frame\": %.2f,\n", (double)pool_allocations / processed);
+    printf("  \"stages\": {\n");
+    for (int s = 0; s < STAGE_COUNT; s++)
+        print_stage_json(stages[s], s == STAGE_COUNT - 1);
+    printf("  }\n");
+    printf("}\n");
+
+    return 0;
+}
@@ -0,0 +1,184 @@
+#include "benchmark.h"
+
+#include "../kinfu-helpers.h"
+
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+////
+//
+// Depth undistortion remap of an NFOV unbinned frame through a synthetic LUT
+//
+////
+
+// The original single-threaded remap over an array of coordinate_t, kept as the baseline and reference
+static void legacy_remap(const uint16_t* src_data, int src_width, const coordinate_t* lut_data, uint16_t* dst_data, int dst_width, int dst_height)
+{
+    memset(dst_data, 0, (size_t)dst_width * (size_t)dst_height * sizeof(uint16_t));
+
+    for (int i = 0; i < dst_width * dst_height; i++)
+    {
+        if (lut_data[i].x != INVALID && lut_data[i].y != INVALID)
+        {
+            const uint16_t neighbors[4]{ src_data[lut_data[i].y * src_width + lut_data[i].x],
+                                         src_data[lut_data[i].y * src_width + lut_data[i].x + 1],
+                                         src_data[(lut_data[i].y + 1) * src_width + lut_data[i].x],
+                                         src_data[(lut_data[i].y + 1) * src_width + lut_data[i].x + 1] };
+
+            if (neighbors[0] == 0 || neighbors[1] == 0 || neighbors[2] == 0 || neighbors[3] == 0)
+            {
+                continue;
+            }
+
+            const float skip_interpolation_ratio = 0.04693441759f;
+            float depth_min = std::min(std::min(neighbors[0], neighbors[1]), std::min(neighbors[2], neighbors[3]));
+            float depth_max = std::max(std::max(neighbors[0], neighbors[1]), std::max(neighbors[2], neighbors[3]));
+            float depth_delta = depth_max - depth_min;
+            float skip_interpolation_threshold = skip_interpolation_ratio * depth_min;
+            if (depth_delta > skip_interpolation_threshold)
+            {
+                continue;
+            }
+
+            dst_data[i] = (uint16_t)(neighbors[0] * lut_data[i].weight[0] + neighbors[1] * lut_data[i].weight[1] +
+                neighbors[2] * lut_data[i].weight[2] + neighbors[3] * lut_data[i].weight[3] +
+                0.5f);
+        }
+    }
+}
+
+// Fill a LUT with a mild barrel distortion, invalid outside an ellipse like the NFOV mask
+static void fill_synthetic_lut(coordinate_t* lut_data, int width, int height)
+{
+    for (int y = 0, idx = 0; y < height; y++)
+    {
+        for (int x = 0; x < width; x++, idx++)
+        {
+            float nx = (x - 0.5f * width) / (0.5f * width);
+            float ny = (y - 0.5f * height) / (0.5f * height);
+            float r2 = nx * nx + ny * ny;
+            float scale = 1.0f - 0.08f * r2;
+
+            float u = (nx * scale * 0.5f + 0.5f) * (width - 1);
+            float v = (ny * scale * 0.5f + 0.5f) * (height - 1);
+
+            coordinate_t& c = lut_data[idx];
+            c.x = (int)floorf(u);
+            c.y = (int)floorf(v);
+
+            if (r2 > 1.0f || c.x < 0 || c.x >= width - 1 || c.y < 0 || c.y >= height - 1)
+            {
+                c.x = INVALID;
+                c.y = INVALID;
+                continue;
+            }
+
+            float w_x = u - c.x;
+            float w_y = v - c.y;
+            c.weight[0] = (1.f - w_x) * (1.f - w_y);
+            c.weight[1] = w_x * (1.f - w_y);
+            c.weight[2] = (1.f - w_x) * w_y;
+            c.weight[3] = w_x * w_y;
+        }
+    }
+}
+
+// A slanted floor with boxes on it and a sprinkling of dropouts
+static void fill_synthetic_depth(uint16_t* depth, int width, int height)
+{
+    for (int y = 0, idx = 0; y < height; y++)
+    {
+        for (int x = 0; x < width; x++, idx++)
+        {
+            uint32_t hash = (uint32_t)idx * 2654435761u;
+            int d = 800 + y * 4 + x / 3;
+
+            if (((x / 80) + (y / 72)) % 3 == 0)
+                d -= 300;
+            if ((hash >> 24) < 8)
+                d = 0;
+
+            depth[idx] = (uint16_t)d;
+        }
+    }
+}
+
+// Pack the reference LUT into the compact layout the plugin uses
+static void build_compact_lut(const coordinate_t* lut_data, int width, int height, undistortion_lut_t* lut)
+{
+    allocate_undistortion_lut(lut, width, height, width, INTERPOLATION_BILINEAR_DEPTH);
+
+    for (int i = 0; i < width * height; i++)
+    {
+        if (lut_data[i].x != INVALID && lut_data[i].y != INVALID)
+        {
+            set_undistortion_lut_entry(lut, i, lut_data[i].x, lut_data[i].y, lut_data[i].weight);
+        }
+    }
+}
+
+int run_remap_benchmark(int iterations)
+{
+    const int width = 640;
+    const int height = 576;
+    const size_t pixels = (size_t)width * height;
+
+    k4a_image_t src = NULL;
+    k4a_image_create(K4A_IMAGE_FORMAT_DEPTH16, width, height, width * (int)sizeof(uint16_t), &src);
+
+    uint16_t* src_data = (uint16_t*)(void*)k4a_image_get_buffer(src);
+    std::vector<coordinate_t> lut_data(pixels);
+    fill_synthetic_depth(src_data, width, height);
+    fill_synthetic_lut(lut_data.data(), width, height);
+
+    undistortion_lut_t lut;
+    build_compact_lut(lut_data.data(), width, height, &lut);
+
+    std::vector<uint16_t> expected(pixels);
+    std::vector<uint16_t> dst(pixels);
+
+    printf("depth remap %dx%d bilinear-depth\n", width, height);
+    printf("%-32s %zu bytes -> %zu bytes\n", "lut size", pixels * sizeof(coordinate_t), undistortion_lut_size(&lut));
+
+    legacy_remap(src_data, width, lut_data.data(), expected.data(), width, height);
+    print_result("legacy (single thread, scalar)",
+        time_iterations(iterations, [&]() { legacy_remap(src_data, width, lut_data.data(), dst.data(), width, height); }),
+        0);
+
+    int status = 0;
+
+    // Fixed point weights may round differently from the float path, but never by more than one unit
+    remap(src, &lut, dst.data());
+    size_t differing = 0;
+    int max_error = 0;
+    for (size_t i = 0; i < pixels; i++)
+    {
+        const int error = abs((int)dst[i] - (int)expected[i]);
+        if (error != 0)
+            differing++;
+        if (error > max_error)
+            max_error = error;
+    }
+    printf("%-32s %zu pixels differ, max error %d\n", "remap vs legacy", differing, max_error);
+    if (max_error > 1)
+    {
+        printf("%-32s MISMATCH\n", "remap");
+        status = 1;
+    }
+
+    const int threads = getNumThreads();
+    setNumThreads(1);
+    print_result("remap (1 thread)",
+        time_iterations(iterations, [&]() { remap(src, &lut, dst.data()); }),
+        0);
+
+    setNumThreads(threads);
+    print_result("remap (parallel)",
+        time_iterations(iterations, [&]() { remap(src, &lut, dst.data()); }),
+        0);
+
+    k4a_image_release(src);
+
+    return status;
+}
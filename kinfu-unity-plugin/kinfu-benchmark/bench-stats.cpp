@@ -0,0 +1,76 @@
+#include "benchmark.h"
+
+#include "../kinfu-stats.h"
+
+#include <cmath>
+
+////
+//
+// Cost of the pipeline instrumentation, and how close its histogram percentiles land
+//
+////
+
+int run_stats_benchmark(int iterations)
+{
+    const int scopes = 100000;
+    const int stages_per_frame = KINFU_STAGE_COUNT;
+    const double frame_ms = 1000.0 / 30.0;
+
+    printf("pipeline stats, %d timed scopes per call\n", scopes);
+
+    set_stats_enabled(true);
+    auto enabled = time_iterations(iterations, [&]() {
+        for (int i = 0; i < scopes; i++)
+        {
+            StageTimer timer(KINFU_STAGE_REMAP);
+        }
+    });
+    print_result("StageTimer (enabled)", enabled, 0);
+
+    set_stats_enabled(false);
+    auto disabled = time_iterations(iterations, [&]() {
+        for (int i = 0; i < scopes; i++)
+        {
+            StageTimer timer(KINFU_STAGE_REMAP);
+        }
+    });
+    print_result("StageTimer (disabled)", disabled, 0);
+    set_stats_enabled(true);
+
+    const double ns_per_scope = percentile(enabled, 50) * 1e6 / scopes;
+    const double overhead = ns_per_scope * stages_per_frame * 1e-6 / frame_ms * 100.0;
+    printf("%-32s %.1f ns per stage, %.4f%% of a 30 fps frame\n", "overhead", ns_per_scope, overhead);
+
+    // Feed a known spread of times, 1 ms to 100 ms, and compare the percentiles
+    reset_stats();
+    const int samples = 1000;
+    for (int i = 1; i <= samples; i++)
+    {
+        const uint64_t ns = (uint64_t)(i * 100000);
+        record_stage_time(KINFU_STAGE_UPDATE, stats_now_ns() - ns);
+    }
+
+    kinfu_pipeline_stats_t stats;
+    get_stats(&stats);
+    const kinfu_stage_stats_t& update = stats.stages[KINFU_STAGE_UPDATE];
+
+    const double expected[3] = { 50.0, 95.0, 99.0 };
+    const float actual[3] = { update.p50_ms, update.p95_ms, update.p99_ms };
+    double worst = 0.0;
+    for (int i = 0; i < 3; i++)
+        worst = std::max(worst, fabs(actual[i] - expected[i]) / expected[i]);
+
+    printf("%-32s p50 %.2f p95 %.2f p99 %.2f ms (expected 50 95 99), worst error %.1f%%\n",
+        "histogram percentiles", update.p50_ms, update.p95_ms, update.p99_ms, worst * 100.0);
+
+    reset_stats();
+
+    // Percentiles are bucket midpoints, so they are within half a bucket (1/16) plus clock noise
+    if (overhead >= 1.0 || worst > 0.07)
+    {
+        printf("%-32s FAILED\n", "pipeline stats");
+        return 1;
+    }
+
+    return 0;
+}
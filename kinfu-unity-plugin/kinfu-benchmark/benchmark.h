@@ -0,0 +1,65 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <stdio.h>
+#include <vector>
+
+////
+//
+// Small timing helpers shared by the benchmark suites
+//
+////
+
+// Time `iterations` calls of fn after a few warm-up calls, returning milliseconds per call
+template <typename Fn>
+std::vector<double> time_iterations(int iterations, Fn fn)
+{
+    for (int i = 0; i < 3; i++)
+        fn();
+
+    std::vector<double> samples;
+    samples.reserve(iterations);
+
+    for (int i = 0; i < iterations; i++)
+    {
+        auto start = std::chrono::steady_clock::now();
+        fn();
+        auto end = std::chrono::steady_clock::now();
+        samples.push_back(std::chrono::duration<double, std::milli>(end - start).count());
+    }
+
+    return samples;
+}
+
+// Nearest-rank percentile (0-100) of a set of samples
+inline double percentile(std::vector<double> samples, double p)
+{
+    if (samples.empty())
+        return 0.0;
+
+    std::sort(samples.begin(), samples.end());
+    size_t rank = (size_t)(p / 100.0 * (samples.size() - 1) + 0.5);
+    return samples[std::min(rank, samples.size() - 1)];
+}
+
+// Print one result row, with throughput if the bytes processed per call are known
+inline void print_result(const char* name, const std::vector<double>& samples, double bytes_per_call)
+{
+    double p50 = percentile(samples, 50);
+    double best = percentile(samples, 0);
+
+    printf("%-32s p50 %9.3f ms   min %9.3f ms", name, p50, best);
+    if (bytes_per_call > 0)
+        printf("   %7.2f GB/s", bytes_per_call / (p50 * 1e-3) / 1e9);
+    printf("\n");
+}
+
+// Benchmark suites, each returns 0 on success
+int run_cloud_benchmark(int iterations);
+int run_color_benchmark(int iterations);
+int run_remap_benchmark(int iterations);
+int run_stats_benchmark(int iterations);
+
+// Whole per-frame pipeline over a recording, or a synthetic stream if recording is NULL. Prints JSON
+int run_pipeline_benchmark(int frames, const char* recording);
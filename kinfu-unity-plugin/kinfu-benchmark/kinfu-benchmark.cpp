@@ -0,0 +1,65 @@
+// kinfu-benchmark.cpp : Headless benchmarks for the KinFu Unity plugin.
+//
+// Usage: kinfu-benchmark [suite] [iterations] [recording.mkv]
+//   suite: all (default), cloud, color, remap, stats or pipeline
+//   pipeline runs `iterations` frames of the recording (or a synthetic stream
+//   without one) through the whole per-frame path and prints JSON. It is not
+//   part of all, so its output stays parseable.
+
+#include "benchmark.h"
+
+#include <stdlib.h>
+#include <string>
+
+int main(int argc, char** argv)
+{
+    std::string suite = argc > 1 ? argv[1] : "all";
+    int iterations = argc > 2 ? atoi(argv[2]) : 100;
+
+    if (iterations <= 0)
+    {
+        fprintf(stderr, "Iterations must be positive\n");
+        return 2;
+    }
+
+    int status = 0;
+    bool ran = false;
+
+    if (suite == "all" || suite == "cloud")
+    {
+        status |= run_cloud_benchmark(iterations);
+        ran = true;
+    }
+
+    if (suite == "all" || suite == "color")
+    {
+        status |= run_color_benchmark(iterations);
+        ran = true;
+    }
+
+    if (suite == "all" || suite == "remap")
+    {
+        status |= run_remap_benchmark(iterations);
+        ran = true;
+    }
+
+    if (suite == "all" || suite == "stats")
+    {
+        status |= run_stats_benchmark(iterations);
+        ran = true;
+    }
+
+    if (suite == "pipeline")
+    {
+        status |= run_pipeline_benchmark(iterations, argc > 3 ? argv[3] : NULL);
+        ran = true;
+    }
+
+    if (!ran)
+    {
+        fprintf(stderr, "Unknown suite '%s'\n", suite.c_str());
+        return 2;
+    }
+
+    return status;
+}
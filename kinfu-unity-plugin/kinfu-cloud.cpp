@@ -0,0 +1,1450 @@
+#include "pch.h"
+#include "framework.h"
+#include "kinfu-cloud.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <opencv2/core/utility.hpp>
+#include <string.h>
+
+// Points per parallel stripe, large enough that scheduling stays well under the copy time
+#define CLOUD_EXPORT_STRIPE 65536
+
+// Run fn over ranges of [0, count), across threads once the cloud is large enough to be worth it
+template <typename Fn>
+static void for_each_stripe(int count, Fn fn)
+{
+    if (count <= CLOUD_EXPORT_STRIPE)
+    {
+        fn(cv::Range(0, count));
+        return;
+    }
+
+    cv::parallel_for_(cv::Range(0, count), fn, (double)count / CLOUD_EXPORT_STRIPE);
+}
+
+////
+//
+// Point export kernels
+// Each kernel converts a contiguous run of points; the split across threads lives in the dispatcher.
+//
+////
+
+static void export_xyz_scalar(const float* src, float* dst, int count)
+{
+    for (int i = 0; i < count; i++, src += 4, dst += 3)
+    {
+        dst[0] = src[0];
+        dst[1] = src[1];
+        dst[2] = src[2];
+    }
+}
+
+static void export_xyzw_scalar(const float* src, float* dst, int count)
+{
+    for (int i = 0; i < count; i++, src += 4, dst += 4)
+    {
+        dst[0] = src[0];
+        dst[1] = src[1];
+        dst[2] = src[2];
+        dst[3] = 1.f;
+    }
+}
+
+#if KINFU_SIMD_X86
+
+// Only SSE shuffles are needed, the SSSE3 target is the lowest level the dispatcher knows
+KINFU_TARGET_SSSE3
+static void export_xyz_sse(const float* src, float* dst, int count)
+{
+    int i = 0;
+    for (; i + 4 <= count; i += 4, src += 16, dst += 12)
+    {
+        const __m128 a = _mm_loadu_ps(src + 0);
+        const __m128 b = _mm_loadu_ps(src + 4);
+        const __m128 c = _mm_loadu_ps(src + 8);
+        const __m128 d = _mm_loadu_ps(src + 12);
+
+        // Pack four xyz_ points into three registers: x0 y0 z0 x1 | y1 z1 x2 y2 | z2 x3 y3 z3
+        const __m128 a2b0 = _mm_shuffle_ps(a, b, _MM_SHUFFLE(0, 0, 2, 2));
+        const __m128 c2d0 = _mm_shuffle_ps(c, d, _MM_SHUFFLE(0, 0, 2, 2));
+
+        _mm_storeu_ps(dst + 0, _mm_shuffle_ps(a, a2b0, _MM_SHUFFLE(2, 0, 1, 0)));
+        _mm_storeu_ps(dst + 4, _mm_shuffle_ps(b, c, _MM_SHUFFLE(1, 0, 2, 1)));
+        _mm_storeu_ps(dst + 8, _mm_shuffle_ps(c2d0, d, _MM_SHUFFLE(2, 1, 2, 0)));
+    }
+
+    export_xyz_scalar(src, dst, count - i);
+}
+
+KINFU_TARGET_SSSE3
+static void export_xyzw_sse(const float* src, float* dst, int count)
+{
+    const __m128 xyz_mask = _mm_castsi128_ps(_mm_setr_epi32(-1, -1, -1, 0));
+    const __m128 w_one = _mm_setr_ps(0.f, 0.f, 0.f, 1.f);
+
+    int i = 0;
+    for (; i + 2 <= count; i += 2, src += 8, dst += 8)
+    {
+        const __m128 a = _mm_loadu_ps(src + 0);
+        const __m128 b = _mm_loadu_ps(src + 4);
+        _mm_storeu_ps(dst + 0, _mm_or_ps(_mm_and_ps(a, xyz_mask), w_one));
+        _mm_storeu_ps(dst + 4, _mm_or_ps(_mm_and_ps(b, xyz_mask), w_one));
+    }
+
+    export_xyzw_scalar(src, dst, count - i);
+}
+
+#endif
+
+void export_cloud_points(const float* points, int count, float* dst, cloud_layout_t layout, simd_level_t level)
+{
+    void (*export_points)(const float*, float*, int) =
+        layout == CLOUD_LAYOUT_XYZW ? export_xyzw_scalar : export_xyz_scalar;
+
+#if KINFU_SIMD_X86
+    if (level >= SIMD_SSSE3)
+        export_points = layout == CLOUD_LAYOUT_XYZW ? export_xyzw_sse : export_xyz_sse;
+#endif
+
+    const int components = (int)layout;
+    for_each_stripe(count, [&](const cv::Range& range) {
+        export_points(points + (size_t)range.start * 4,
+            dst + (size_t)range.start * components,
+            range.end - range.start);
+    });
+}
+
+void export_cloud_points(const float* points, int count, float* dst, cloud_layout_t layout)
+{
+    export_cloud_points(points, count, dst, layout, get_simd_level());
+}
+
+int export_cloud_range(const cloud_snapshot_t& cloud, int offset, int count, float* dst, cloud_layout_t layout)
+{
+    if (offset < 0 || count < 0)
+        return -1;
+
+    const int available = std::max(cloud.points.rows - offset, 0);
+    count = std::min(count, available);
+    if (count == 0)
+        return 0;
+
+    CV_Assert(cloud.points.type() == CV_32FC4 && cloud.points.isContinuous());
+    export_cloud_points(cloud.points.ptr<float>(offset), count, dst, layout);
+
+    return count;
+}
+
+////
+//
+// Interleaved vertex export
+//
+////
+
+// An optional attribute is absent (-1) or lies entirely inside the vertex
+static bool attribute_fits(int offset, int size, int stride)
+{
+    return offset == -1 || (offset >= 0 && offset + size <= stride);
+}
+
+static int vertex_color_size(int color_format)
+{
+    return color_format == KINFU_VERTEX_COLOR_RGBA_FLOAT ? 4 * (int)sizeof(float) : 4;
+}
+
+bool validate_vertex_format(const kinfu_vertex_format_t& format, const char** error)
+{
+    const char* reason = NULL;
+
+    if (format.stride <= 0)
+        reason = "Vertex stride must be positive";
+    else if (format.position_offset < 0 || !attribute_fits(format.position_offset, 3 * sizeof(float), format.stride))
+        reason = "Vertex position must lie inside the stride";
+    else if (!attribute_fits(format.normal_offset, 3 * sizeof(float), format.stride))
+        reason = "Vertex normal must lie inside the stride";
+    else if (format.color_offset != -1 && format.color_format != KINFU_VERTEX_COLOR_RGBA32 && format.color_format != KINFU_VERTEX_COLOR_RGBA_FLOAT)
+        reason = "Unknown vertex color format";
+    else if (!attribute_fits(format.color_offset, vertex_color_size(format.color_format), format.stride))
+        reason = "Vertex color must lie inside the stride";
+    else if (!attribute_fits(format.size_offset, sizeof(float), format.stride))
+        reason = "Vertex size must lie inside the stride";
+
+    if (error != NULL)
+        *error = reason;
+
+    return reason == NULL;
+}
+
+int export_cloud_vertices(const cloud_snapshot_t& cloud, int offset, int count, uint8_t* dst, const kinfu_vertex_format_t& format)
+{
+    if (offset < 0 || count < 0 || !validate_vertex_format(format, NULL))
+        return -1;
+
+    const bool with_normals = format.normal_offset >= 0;
+    if (with_normals && cloud.normals.rows != cloud.points.rows)
+        return -1;
+
+    const int available = std::max(cloud.points.rows - offset, 0);
+    count = std::min(count, available);
+    if (count == 0)
+        return 0;
+
+    CV_Assert(cloud.points.type() == CV_32FC4 && cloud.points.isContinuous());
+    const float* points = cloud.points.ptr<float>(offset);
+    const float* normals = with_normals ? cloud.normals.ptr<float>(offset) : NULL;
+    const bool with_colors = format.color_offset >= 0 && cloud.colors.rows == cloud.points.rows;
+    const uint8_t* colors = with_colors ? cloud.colors.ptr<uint8_t>(offset) : NULL;
+
+    // The constant attributes are encoded once and copied into every vertex
+    uint8_t color[4 * sizeof(float)];
+    const size_t color_size = (size_t)vertex_color_size(format.color_format);
+    for (int c = 0; c < 4; c++)
+    {
+        const uint8_t channel = (uint8_t)(format.color >> (8 * c));
+        if (format.color_format == KINFU_VERTEX_COLOR_RGBA_FLOAT)
+        {
+            const float value = channel / 255.f;
+            memcpy(color + c * sizeof(float), &value, sizeof(float));
+        }
+        else
+        {
+            color[c] = channel;
+        }
+    }
+
+    const float y_sign = format.flip_y ? -1.f : 1.f;
+
+    for_each_stripe(count, [&](const cv::Range& range) {
+        // Byte stores may alias anything, so keep the format in locals or it is reloaded for every point
+        const int stride = format.stride;
+        const int position_offset = format.position_offset;
+        const int normal_offset = format.normal_offset;
+        const int color_offset = format.color_offset;
+        const int size_offset = format.size_offset;
+        const float size = format.size;
+        uint8_t vertex_color[4 * sizeof(float)];
+        memcpy(vertex_color, color, sizeof(vertex_color));
+
+        const float* point = points + (size_t)range.start * 4;
+        const float* normal = normals != NULL ? normals + (size_t)range.start * 4 : NULL;
+        const uint8_t* point_color = colors != NULL ? colors + (size_t)range.start * 4 : NULL;
+        uint8_t* vertex = dst + (size_t)range.start * stride;
+
+        for (int i = range.start; i < range.end; i++, point += 4, vertex += stride)
+        {
+            const float position[3] = { point[0], point[1] * y_sign, point[2] };
+            memcpy(vertex + position_offset, position, sizeof(position));
+
+            if (normal != NULL)
+            {
+                const float n[3] = { normal[0], normal[1] * y_sign, normal[2] };
+                memcpy(vertex + normal_offset, n, sizeof(n));
+                normal += 4;
+            }
+
+            if (point_color != NULL)
+            {
+                if (color_size == 4)
+                {
+                    memcpy(vertex_color, point_color, 4);
+                }
+                else
+                {
+                    for (int c = 0; c < 4; c++)
+                    {
+                        const float value = point_color[c] / 255.f;
+                        memcpy(vertex_color + c * sizeof(float), &value, sizeof(float));
+                    }
+                }
+                point_color += 4;
+            }
+
+            if (color_offset >= 0)
+            {
+                if (color_size == 4)
+                    memcpy(vertex + color_offset, vertex_color, 4);
+                else
+                    memcpy(vertex + color_offset, vertex_color, 4 * sizeof(float));
+            }
+
+            if (size_offset >= 0)
+                memcpy(vertex + size_offset, &size, sizeof(float));
+        }
+    });
+
+    return count;
+}
+
+////
+//
+// Voxel-grid filtering
+// Points are keyed by their grid cell and scattered into hash buckets, then each
+// bucket keeps one point per cell in its own open-addressing table. Buckets share
+// nothing, so they are filtered in parallel without locks.
+//
+////
+
+// Hash buckets the cells are spread across, the top 8 bits of the hash
+#define VOXEL_FILTER_BUCKETS 256
+
+// Cell coordinates are packed into 21 bits per axis, biased so negative cells fit
+#define VOXEL_COORD_BITS 21
+#define VOXEL_COORD_BIAS (1 << (VOXEL_COORD_BITS - 1))
+
+// Never a packed cell, marks empty slots and points off the grid
+#define VOXEL_NO_KEY UINT64_MAX
+
+typedef struct _voxel_point_t
+{
+    uint64_t key;    /**< Packed cell */
+    float distance2; /**< Squared distance to the cell centre */
+    int index;       /**< Point in the source cloud */
+} voxel_point_t;
+
+typedef struct _voxel_slot_t
+{
+    uint64_t key;    /**< Packed cell, VOXEL_NO_KEY when empty */
+    int index;       /**< Point nearest the cell centre so far */
+    float distance2; /**< Its squared distance to the centre */
+} voxel_slot_t;
+
+static inline uint64_t voxel_hash(uint64_t key)
+{
+    return key * 0x9E3779B97F4A7C15ull;
+}
+
+static inline int voxel_bucket(uint64_t key)
+{
+    return (int)(voxel_hash(key) >> 56);
+}
+
+// Packed cell of a point and its squared distance to the cell centre, false if it is off the grid
+static inline bool voxel_cell(const float* p, float inv_cell, float cell_size, uint64_t& key, float& distance2)
+{
+    key = 0;
+    distance2 = 0.f;
+
+    for (int c = 0; c < 3; c++)
+    {
+        // Written so NaN fails the range check too
+        const float v = p[c] * inv_cell;
+        if (!(v >= -VOXEL_COORD_BIAS && v < VOXEL_COORD_BIAS))
+            return false;
+
+        // Truncate then step down for negatives, a floor without the libm call
+        int cell = (int)v;
+        cell -= (float)cell > v;
+
+        const float d = p[c] - ((float)cell + 0.5f) * cell_size;
+        distance2 += d * d;
+        key = (key << VOXEL_COORD_BITS) | (uint64_t)(cell + VOXEL_COORD_BIAS);
+    }
+
+    return true;
+}
+
+static void count_cells_scalar(const float* src, int begin, int end, float cell_size, int* counts)
+{
+    const float inv_cell = 1.f / cell_size;
+    for (int i = begin; i < end; i++)
+    {
+        uint64_t key;
+        float distance2;
+        if (voxel_cell(src + (size_t)i * 4, inv_cell, cell_size, key, distance2))
+            counts[voxel_bucket(key)]++;
+    }
+}
+
+static void scatter_cells_scalar(const float* src, int begin, int end, float cell_size, int* at, voxel_point_t* bucketed)
+{
+    const float inv_cell = 1.f / cell_size;
+    for (int i = begin; i < end; i++)
+    {
+        voxel_point_t point;
+        if (!voxel_cell(src + (size_t)i * 4, inv_cell, cell_size, point.key, point.distance2))
+            continue;
+
+        point.index = i;
+        bucketed[at[voxel_bucket(point.key)]++] = point;
+    }
+}
+
+#if KINFU_SIMD_X86
+
+// voxel_cell with the three axes in one register
+KINFU_TARGET_SSSE3
+static inline bool voxel_cell_sse(const float* p, __m128 inv_cell, __m128 cell_size, uint64_t& key, float& distance2)
+{
+    const __m128 point = _mm_loadu_ps(p);
+    const __m128 v = _mm_mul_ps(point, inv_cell);
+    const __m128 in_range = _mm_and_ps(_mm_cmpge_ps(v, _mm_set1_ps(-VOXEL_COORD_BIAS)), _mm_cmplt_ps(v, _mm_set1_ps(VOXEL_COORD_BIAS)));
+    if ((_mm_movemask_ps(in_range) & 7) != 7)
+        return false;
+
+    // Truncate, then add the all-ones compare mask (-1) where that rounded up
+    __m128i cell = _mm_cvttps_epi32(v);
+    cell = _mm_add_epi32(cell, _mm_castps_si128(_mm_cmpgt_ps(_mm_cvtepi32_ps(cell), v)));
+
+    const __m128 d = _mm_sub_ps(point, _mm_mul_ps(_mm_add_ps(_mm_cvtepi32_ps(cell), _mm_set1_ps(0.5f)), cell_size));
+    float squares[4];
+    _mm_storeu_ps(squares, _mm_mul_ps(d, d));
+    distance2 = squares[0] + squares[1] + squares[2];
+
+    int32_t biased[4];
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(biased), _mm_add_epi32(cell, _mm_set1_epi32(VOXEL_COORD_BIAS)));
+    key = ((uint64_t)(uint32_t)biased[0] << (2 * VOXEL_COORD_BITS)) | ((uint64_t)(uint32_t)biased[1] << VOXEL_COORD_BITS) | (uint32_t)biased[2];
+
+    return true;
+}
+
+KINFU_TARGET_SSSE3
+static void count_cells_sse(const float* src, int begin, int end, float cell_size, int* counts)
+{
+    const __m128 inv_cell = _mm_set1_ps(1.f / cell_size);
+    const __m128 cell = _mm_set1_ps(cell_size);
+    for (int i = begin; i < end; i++)
+    {
+        uint64_t key;
+        float distance2;
+        if (voxel_cell_sse(src + (size_t)i * 4, inv_cell, cell, key, distance2))
+            counts[voxel_bucket(key)]++;
+    }
+}
+
+KINFU_TARGET_SSSE3
+static void scatter_cells_sse(const float* src, int begin, int end, float cell_size, int* at, voxel_point_t* bucketed)
+{
+    const __m128 inv_cell = _mm_set1_ps(1.f / cell_size);
+    const __m128 cell = _mm_set1_ps(cell_size);
+    for (int i = begin; i < end; i++)
+    {
+        voxel_point_t point;
+        if (!voxel_cell_sse(src + (size_t)i * 4, inv_cell, cell, point.key, point.distance2))
+            continue;
+
+        point.index = i;
+        bucketed[at[voxel_bucket(point.key)]++] = point;
+    }
+}
+
+#endif
+
+void voxel_filter_cloud(const cv::Mat& points, const cv::Mat& normals, const cv::Mat& colors, float cell_size,
+    cv::Mat& filtered_points, cv::Mat& filtered_normals, cv::Mat& filtered_colors, simd_level_t level)
+{
+    void (*count_cells)(const float*, int, int, float, int*) = count_cells_scalar;
+    void (*scatter_cells)(const float*, int, int, float, int*, voxel_point_t*) = scatter_cells_scalar;
+
+#if KINFU_SIMD_X86
+    if (level >= SIMD_SSSE3)
+    {
+        count_cells = count_cells_sse;
+        scatter_cells = scatter_cells_sse;
+    }
+#endif
+
+    CV_Assert(points.type() == CV_32FC4 && points.isContinuous() && cell_size > 0.f);
+
+    const int count = points.rows;
+    const bool with_normals = count > 0 && normals.rows == count;
+    const bool with_colors = count > 0 && colors.rows == count;
+    CV_Assert(!with_normals || (normals.type() == CV_32FC4 && normals.isContinuous()));
+    CV_Assert(!with_colors || (colors.type() == CV_8UC4 && colors.isContinuous()));
+
+    const float* src = points.ptr<float>();
+    const int stripes = std::max((count + CLOUD_EXPORT_STRIPE - 1) / CLOUD_EXPORT_STRIPE, 1);
+
+    // Count the points each stripe sends to each bucket. Cells are cheap to compute,
+    // so they are computed again for the scatter rather than stored
+    std::vector<int> bucket_counts((size_t)stripes * VOXEL_FILTER_BUCKETS, 0);
+
+    cv::parallel_for_(cv::Range(0, stripes), [&](const cv::Range& range) {
+        for (int stripe = range.start; stripe < range.end; stripe++)
+        {
+            count_cells(src, stripe * CLOUD_EXPORT_STRIPE, std::min((stripe + 1) * CLOUD_EXPORT_STRIPE, count), cell_size,
+                &bucket_counts[(size_t)stripe * VOXEL_FILTER_BUCKETS]);
+        }
+    });
+
+    // Lay the buckets out one after another, keeping each bucket's points in index order
+    std::vector<int> bucket_start(VOXEL_FILTER_BUCKETS + 1);
+    std::vector<int> write_at((size_t)stripes * VOXEL_FILTER_BUCKETS);
+    int total = 0;
+    for (int bucket = 0; bucket < VOXEL_FILTER_BUCKETS; bucket++)
+    {
+        bucket_start[bucket] = total;
+        for (int stripe = 0; stripe < stripes; stripe++)
+        {
+            write_at[(size_t)stripe * VOXEL_FILTER_BUCKETS + bucket] = total;
+            total += bucket_counts[(size_t)stripe * VOXEL_FILTER_BUCKETS + bucket];
+        }
+    }
+    bucket_start[VOXEL_FILTER_BUCKETS] = total;
+
+    // Every slot is written by the scatter, so skip the zero fill a vector would do
+    std::unique_ptr<voxel_point_t[]> bucketed(new voxel_point_t[total]);
+    cv::parallel_for_(cv::Range(0, stripes), [&](const cv::Range& range) {
+        for (int stripe = range.start; stripe < range.end; stripe++)
+        {
+            scatter_cells(src, stripe * CLOUD_EXPORT_STRIPE, std::min((stripe + 1) * CLOUD_EXPORT_STRIPE, count), cell_size,
+                &write_at[(size_t)stripe * VOXEL_FILTER_BUCKETS], bucketed.get());
+        }
+    });
+
+    // Keep the point nearest each cell centre, the earliest on a tie, its index written over the front of the bucket's run
+    std::vector<int> kept(VOXEL_FILTER_BUCKETS, 0);
+    cv::parallel_for_(cv::Range(0, VOXEL_FILTER_BUCKETS), [&](const cv::Range& range) {
+        const voxel_slot_t empty = { VOXEL_NO_KEY, -1, 0.f };
+        std::vector<voxel_slot_t> table;
+
+        for (int bucket = range.start; bucket < range.end; bucket++)
+        {
+            const int first = bucket_start[bucket];
+            const int n = bucket_start[bucket + 1] - first;
+            if (n == 0)
+                continue;
+
+            // At most half full, probing linearly on the hash bits below the bucket's
+            size_t size = 16;
+            while (size < (size_t)n * 2)
+                size <<= 1;
+            const size_t mask = size - 1;
+            table.assign(size, empty);
+
+            // Neighbouring points usually share a cell, so remember the last one found
+            voxel_slot_t* last = &table[0];
+            for (int k = first; k < first + n; k++)
+            {
+                const voxel_point_t& point = bucketed[k];
+                voxel_slot_t* entry = last;
+                if (entry->key != point.key)
+                {
+                    size_t slot = (size_t)(voxel_hash(point.key) >> 24) & mask;
+                    while (table[slot].key != point.key && table[slot].key != VOXEL_NO_KEY)
+                        slot = (slot + 1) & mask;
+                    entry = &table[slot];
+                }
+
+                if (entry->key == VOXEL_NO_KEY || point.distance2 < entry->distance2)
+                {
+                    entry->key = point.key;
+                    entry->index = point.index;
+                    entry->distance2 = point.distance2;
+                }
+                last = entry;
+            }
+
+            int out = first;
+            for (const voxel_slot_t& entry : table)
+            {
+                if (entry.key != VOXEL_NO_KEY)
+                    bucketed[out++].index = entry.index;
+            }
+            kept[bucket] = out - first;
+        }
+    });
+
+    std::vector<int> kept_start(VOXEL_FILTER_BUCKETS);
+    int kept_total = 0;
+    for (int bucket = 0; bucket < VOXEL_FILTER_BUCKETS; bucket++)
+    {
+        kept_start[bucket] = kept_total;
+        kept_total += kept[bucket];
+    }
+
+    filtered_points.create(kept_total, 1, CV_32FC4);
+    if (with_normals)
+        filtered_normals.create(kept_total, 1, CV_32FC4);
+    else
+        filtered_normals.release();
+    if (with_colors)
+        filtered_colors.create(kept_total, 1, CV_8UC4);
+    else
+        filtered_colors.release();
+
+    if (kept_total == 0)
+        return;
+
+    float* dst_points = filtered_points.ptr<float>();
+    const float* src_normals = with_normals ? normals.ptr<float>() : NULL;
+    float* dst_normals = with_normals ? filtered_normals.ptr<float>() : NULL;
+    const uint8_t* src_colors = with_colors ? colors.ptr<uint8_t>() : NULL;
+    uint8_t* dst_colors = with_colors ? filtered_colors.ptr<uint8_t>() : NULL;
+
+    cv::parallel_for_(cv::Range(0, VOXEL_FILTER_BUCKETS), [&](const cv::Range& range) {
+        for (int bucket = range.start; bucket < range.end; bucket++)
+        {
+            for (int j = 0; j < kept[bucket]; j++)
+            {
+                const size_t i = (size_t)bucketed[bucket_start[bucket] + j].index;
+                const size_t out = (size_t)(kept_start[bucket] + j);
+                memcpy(dst_points + out * 4, src + i * 4, 4 * sizeof(float));
+                if (with_normals)
+                    memcpy(dst_normals + out * 4, src_normals + i * 4, 4 * sizeof(float));
+                if (with_colors)
+                    memcpy(dst_colors + out * 4, src_colors + i * 4, 4);
+            }
+        }
+    });
+}
+
+void voxel_filter_cloud(const cv::Mat& points, const cv::Mat& normals, const cv::Mat& colors, float cell_size,
+    cv::Mat& filtered_points, cv::Mat& filtered_normals, cv::Mat& filtered_colors)
+{
+    voxel_filter_cloud(points, normals, colors, cell_size, filtered_points, filtered_normals, filtered_colors, get_simd_level());
+}
+
+void build_cloud_lods(cloud_snapshot_t& cloud, const float* cell_sizes, int count)
+{
+    cloud.lods.clear();
+
+    const cloud_snapshot_t* source = &cloud;
+    for (int level = 0; level < count; level++)
+    {
+        std::shared_ptr<cloud_snapshot_t> lod = std::make_shared<cloud_snapshot_t>();
+        voxel_filter_cloud(source->points, source->normals, source->colors, cell_sizes[level], lod->points, lod->normals, lod->colors);
+        lod->generation = cloud.generation;
+        lod->cell_size = cell_sizes[level];
+
+        cloud.lods.push_back(lod);
+        source = lod.get();
+    }
+}
+
+////
+//
+// Block partitioning and deltas
+// Points are keyed by their block like the voxel filter keys cells and numbered with
+// one open-addressing table, then their indices are scattered into key order in
+// parallel stripes. The points stay where they are, only a delta copies any.
+// Block hashes are sums of per-point hashes, so they do not depend on point order.
+//
+////
+
+// The block table doubles once it is more than 1 / BLOCK_TABLE_LOAD full
+#define BLOCK_TABLE_LOAD 2
+
+void unpack_block_key(uint64_t key, int coords[3])
+{
+    const uint64_t mask = (1ull << VOXEL_COORD_BITS) - 1;
+    coords[0] = (int)((key >> (2 * VOXEL_COORD_BITS)) & mask) - VOXEL_COORD_BIAS;
+    coords[1] = (int)((key >> VOXEL_COORD_BITS) & mask) - VOXEL_COORD_BIAS;
+    coords[2] = (int)(key & mask) - VOXEL_COORD_BIAS;
+}
+
+// Mix of a point's position bits, summed per block
+static inline uint64_t point_hash(const float* p)
+{
+    uint32_t bits[3];
+    memcpy(bits, p, sizeof(bits));
+
+    uint64_t h = ((uint64_t)bits[1] << 32 | bits[0]) ^ (uint64_t)bits[2] * 0xC2B2AE3D27D4EB4Full;
+    h ^= h >> 30;
+    h *= 0xBF58476D1CE4E5B9ull;
+    h ^= h >> 27;
+    h *= 0x94D049BB133111EBull;
+    return h ^ (h >> 31);
+}
+
+static void block_keys_scalar(const float* src, int begin, int end, float block_size, uint64_t* keys)
+{
+    const float inv_block = 1.f / block_size;
+    for (int i = begin; i < end; i++)
+    {
+        float distance2;
+        if (!voxel_cell(src + (size_t)i * 4, inv_block, block_size, keys[i], distance2))
+            keys[i] = VOXEL_NO_KEY;
+    }
+}
+
+#if KINFU_SIMD_X86
+
+KINFU_TARGET_SSSE3
+static void block_keys_sse(const float* src, int begin, int end, float block_size, uint64_t* keys)
+{
+    const __m128 inv_block = _mm_set1_ps(1.f / block_size);
+    const __m128 block = _mm_set1_ps(block_size);
+    for (int i = begin; i < end; i++)
+    {
+        float distance2;
+        if (!voxel_cell_sse(src + (size_t)i * 4, inv_block, block, keys[i], distance2))
+            keys[i] = VOXEL_NO_KEY;
+    }
+}
+
+#endif
+
+void partition_cloud_blocks(cloud_snapshot_t& cloud, float block_size, simd_level_t level)
+{
+    void (*block_keys)(const float*, int, int, float, uint64_t*) = block_keys_scalar;
+
+#if KINFU_SIMD_X86
+    if (level >= SIMD_SSSE3)
+        block_keys = block_keys_sse;
+#endif
+
+    CV_Assert(block_size > 0.f);
+
+    const int count = cloud.points.rows;
+    CV_Assert(count == 0 || (cloud.points.type() == CV_32FC4 && cloud.points.isContinuous()));
+
+    cloud.block_size = block_size;
+    cloud.blocks.clear();
+    cloud.block_points.clear();
+    if (count == 0)
+        return;
+
+    const float* src = cloud.points.ptr<float>();
+    const int stripes = (count + CLOUD_EXPORT_STRIPE - 1) / CLOUD_EXPORT_STRIPE;
+
+    std::unique_ptr<uint64_t[]> keys(new uint64_t[count]);
+    cv::parallel_for_(cv::Range(0, stripes), [&](const cv::Range& range) {
+        for (int stripe = range.start; stripe < range.end; stripe++)
+            block_keys(src, stripe * CLOUD_EXPORT_STRIPE, std::min((stripe + 1) * CLOUD_EXPORT_STRIPE, count), block_size, keys.get());
+    });
+
+    // Number the blocks in the order they are first seen. Neighbouring points usually share
+    // a block, so the last one found is checked before the table
+    std::unique_ptr<int[]> ids(new int[count]);
+    std::vector<uint64_t> block_keys_found;
+    const voxel_slot_t empty = { VOXEL_NO_KEY, -1, 0.f };
+    std::vector<voxel_slot_t> table(1024, empty);
+    size_t mask = table.size() - 1;
+
+    uint64_t last_key = VOXEL_NO_KEY;
+    int last_id = -1;
+    for (int i = 0; i < count; i++)
+    {
+        const uint64_t key = keys[i];
+        if (key == last_key || key == VOXEL_NO_KEY)
+        {
+            ids[i] = key == VOXEL_NO_KEY ? -1 : last_id;
+            continue;
+        }
+
+        size_t slot = (size_t)(voxel_hash(key) >> 24) & mask;
+        while (table[slot].key != key && table[slot].key != VOXEL_NO_KEY)
+            slot = (slot + 1) & mask;
+
+        if (table[slot].key == VOXEL_NO_KEY)
+        {
+            table[slot].key = key;
+            table[slot].index = (int)block_keys_found.size();
+            block_keys_found.push_back(key);
+
+            if (block_keys_found.size() * BLOCK_TABLE_LOAD > table.size())
+            {
+                table.assign(table.size() * 2, empty);
+                mask = table.size() - 1;
+                for (size_t id = 0; id < block_keys_found.size(); id++)
+                {
+                    size_t at = (size_t)(voxel_hash(block_keys_found[id]) >> 24) & mask;
+                    while (table[at].key != VOXEL_NO_KEY)
+                        at = (at + 1) & mask;
+                    table[at].key = block_keys_found[id];
+                    table[at].index = (int)id;
+                }
+
+                slot = (size_t)(voxel_hash(key) >> 24) & mask;
+                while (table[slot].key != key)
+                    slot = (slot + 1) & mask;
+            }
+        }
+
+        last_key = key;
+        last_id = table[slot].index;
+        ids[i] = last_id;
+    }
+
+    // Blocks are laid out in key order, so clouds can be compared block by block
+    const int block_count = (int)block_keys_found.size();
+    std::vector<int> order(block_count);
+    for (int id = 0; id < block_count; id++)
+        order[id] = id;
+    std::sort(order.begin(), order.end(), [&](int a, int b) { return block_keys_found[a] < block_keys_found[b]; });
+
+    std::vector<int> rank(block_count);
+    for (int r = 0; r < block_count; r++)
+        rank[order[r]] = r;
+
+    // Points and hash sums each stripe sends to each block, ranked. The hashes do not depend on
+    // point order, so they are summed here while the points stream past instead of in another pass
+    std::vector<int> write_at((size_t)stripes * block_count, 0);
+    std::vector<uint64_t> hashes((size_t)stripes * block_count, 0);
+    cv::parallel_for_(cv::Range(0, stripes), [&](const cv::Range& range) {
+        for (int stripe = range.start; stripe < range.end; stripe++)
+        {
+            int* counts = &write_at[(size_t)stripe * block_count];
+            uint64_t* sums = &hashes[(size_t)stripe * block_count];
+            const int end = std::min((stripe + 1) * CLOUD_EXPORT_STRIPE, count);
+            for (int i = stripe * CLOUD_EXPORT_STRIPE; i < end; i++)
+            {
+                if (ids[i] < 0)
+                    continue;
+
+                const int r = rank[ids[i]];
+                counts[r]++;
+                sums[r] += point_hash(src + (size_t)i * 4);
+            }
+        }
+    });
+
+    // Then where each stripe writes its point indices
+    cloud.blocks.resize(block_count);
+    int total = 0;
+    for (int r = 0; r < block_count; r++)
+    {
+        cloud_block_t& block = cloud.blocks[r];
+        block.key = block_keys_found[order[r]];
+        block.offset = total;
+        block.generation = cloud.generation;
+
+        uint64_t hash = 0;
+        for (int stripe = 0; stripe < stripes; stripe++)
+        {
+            int& at = write_at[(size_t)stripe * block_count + r];
+            const int n = at;
+            at = total;
+            total += n;
+            hash += hashes[(size_t)stripe * block_count + r];
+        }
+        block.count = total - block.offset;
+        block.hash = hash + (uint64_t)block.count;
+    }
+
+    cloud.block_points.resize(total);
+    cv::parallel_for_(cv::Range(0, stripes), [&](const cv::Range& range) {
+        for (int stripe = range.start; stripe < range.end; stripe++)
+        {
+            int* at = &write_at[(size_t)stripe * block_count];
+            const int end = std::min((stripe + 1) * CLOUD_EXPORT_STRIPE, count);
+            for (int i = stripe * CLOUD_EXPORT_STRIPE; i < end; i++)
+            {
+                if (ids[i] >= 0)
+                    cloud.block_points[at[rank[ids[i]]]++] = i;
+            }
+        }
+    });
+}
+
+void partition_cloud_blocks(cloud_snapshot_t& cloud, float block_size)
+{
+    partition_cloud_blocks(cloud, block_size, get_simd_level());
+}
+
+void update_block_history(cloud_block_history_t& history, cloud_snapshot_t& cloud)
+{
+    CV_Assert(cloud.block_size > 0.f);
+
+    // A new block size starts over, so every earlier generation needs a full delta
+    if (history.block_size != cloud.block_size)
+    {
+        history.block_size = cloud.block_size;
+        history.generation = cloud.generation;
+        history.start = cloud.generation;
+        history.blocks.clear();
+        history.removed.clear();
+    }
+
+    // Overtaken by a newer extraction, so there is no telling what changed since any generation
+    if (cloud.generation < history.generation)
+    {
+        for (cloud_block_t& block : cloud.blocks)
+            block.generation = cloud.generation;
+        cloud.removed_blocks.clear();
+        cloud.block_history_start = cloud.generation;
+        return;
+    }
+
+    // Both block lists are in key order, so one merge finds the changed, added and removed blocks
+    std::vector<cloud_removed_block_t> removed;
+    size_t old_index = 0;
+    for (cloud_block_t& block : cloud.blocks)
+    {
+        while (old_index < history.blocks.size() && history.blocks[old_index].key < block.key)
+        {
+            removed.push_back({ history.blocks[old_index].key, cloud.generation });
+            old_index++;
+        }
+
+        if (old_index < history.blocks.size() && history.blocks[old_index].key == block.key)
+        {
+            const cloud_block_t& previous = history.blocks[old_index++];
+            block.generation = previous.hash == block.hash ? previous.generation : cloud.generation;
+        }
+        else
+        {
+            block.generation = cloud.generation;
+        }
+    }
+    for (; old_index < history.blocks.size(); old_index++)
+        removed.push_back({ history.blocks[old_index].key, cloud.generation });
+
+    // Keep the earlier removals of blocks that did not come back
+    size_t live = 0;
+    for (const cloud_removed_block_t& earlier : history.removed)
+    {
+        while (live < cloud.blocks.size() && cloud.blocks[live].key < earlier.key)
+            live++;
+        if (live == cloud.blocks.size() || cloud.blocks[live].key != earlier.key)
+            removed.push_back(earlier);
+    }
+    std::sort(removed.begin(), removed.end(),
+        [](const cloud_removed_block_t& a, const cloud_removed_block_t& b) { return a.key < b.key; });
+
+    history.generation = cloud.generation;
+    history.blocks = cloud.blocks;
+    history.removed = removed;
+
+    cloud.removed_blocks = removed;
+    cloud.block_history_start = history.start;
+}
+
+void extract_cloud_delta(const cloud_snapshot_t& cloud, uint64_t since, cloud_snapshot_t& delta,
+    std::vector<kinfu_cloud_block_t>& blocks, kinfu_cloud_delta_t& header)
+{
+    const bool full = since < cloud.block_history_start;
+    const bool with_normals = cloud.points.rows > 0 && cloud.normals.rows == cloud.points.rows;
+    const bool with_colors = cloud.points.rows > 0 && cloud.colors.rows == cloud.points.rows;
+
+    blocks.clear();
+    std::vector<const cloud_block_t*> changed;
+    int total = 0;
+    for (const cloud_block_t& block : cloud.blocks)
+    {
+        if (!full && block.generation <= since)
+            continue;
+
+        kinfu_cloud_block_t entry;
+        int coords[3];
+        unpack_block_key(block.key, coords);
+        entry.x = coords[0];
+        entry.y = coords[1];
+        entry.z = coords[2];
+        entry.first_point = total;
+        entry.point_count = block.count;
+        entry.removed = 0;
+        entry.hash = block.hash;
+        blocks.push_back(entry);
+
+        changed.push_back(&block);
+        total += block.count;
+    }
+
+    int removed_count = 0;
+    if (!full)
+    {
+        for (const cloud_removed_block_t& block : cloud.removed_blocks)
+        {
+            if (block.generation <= since)
+                continue;
+
+            kinfu_cloud_block_t entry;
+            int coords[3];
+            unpack_block_key(block.key, coords);
+            entry.x = coords[0];
+            entry.y = coords[1];
+            entry.z = coords[2];
+            entry.first_point = total;
+            entry.point_count = 0;
+            entry.removed = 1;
+            entry.hash = 0;
+            blocks.push_back(entry);
+            removed_count++;
+        }
+    }
+
+    delta.generation = cloud.generation;
+    delta.cell_size = cloud.cell_size;
+    delta.lods.clear();
+    delta.block_size = 0.f;
+    delta.blocks.clear();
+    delta.block_points.clear();
+    delta.removed_blocks.clear();
+    delta.block_history_start = 0;
+    delta.points.create(total, 1, CV_32FC4);
+    if (with_normals)
+        delta.normals.create(total, 1, CV_32FC4);
+    else
+        delta.normals.release();
+    if (with_colors)
+        delta.colors.create(total, 1, CV_8UC4);
+    else
+        delta.colors.release();
+
+    if (total > 0)
+    {
+        const float* src = cloud.points.ptr<float>();
+        const float* src_normals = with_normals ? cloud.normals.ptr<float>() : NULL;
+        const uint8_t* src_colors = with_colors ? cloud.colors.ptr<uint8_t>() : NULL;
+        float* dst = delta.points.ptr<float>();
+        float* dst_normals = with_normals ? delta.normals.ptr<float>() : NULL;
+        uint8_t* dst_colors = with_colors ? delta.colors.ptr<uint8_t>() : NULL;
+
+        cv::parallel_for_(cv::Range(0, (int)changed.size()), [&](const cv::Range& range) {
+            for (int b = range.start; b < range.end; b++)
+            {
+                const cloud_block_t& block = *changed[b];
+                size_t out = (size_t)blocks[b].first_point;
+                for (int k = block.offset; k < block.offset + block.count; k++, out++)
+                {
+                    const size_t i = (size_t)cloud.block_points[k];
+                    memcpy(dst + out * 4, src + i * 4, 4 * sizeof(float));
+                    if (with_normals)
+                        memcpy(dst_normals + out * 4, src_normals + i * 4, 4 * sizeof(float));
+                    if (with_colors)
+                        memcpy(dst_colors + out * 4, src_colors + i * 4, 4);
+                }
+            }
+        });
+    }
+
+    header.generation = cloud.generation;
+    header.since = since;
+    header.full = full ? 1 : 0;
+    header.block_count = (int)blocks.size();
+    header.removed_count = removed_count;
+    header.point_count = total;
+    header.block_size = cloud.block_size;
+}
+
+int count_volume_units(const cv::Mat& points, float unit_size, float margin)
+{
+    CV_Assert(unit_size > 0.f && margin >= 0.f);
+
+    const int count = points.rows;
+    CV_Assert(count == 0 || (points.type() == CV_32FC4 && points.isContinuous()));
+
+    const float* src = points.ptr<float>();
+    const float inv_unit = 1.f / unit_size;
+
+    const voxel_slot_t empty = { VOXEL_NO_KEY, -1, 0.f };
+    std::vector<voxel_slot_t> table(1024, empty);
+    size_t mask = table.size() - 1;
+    int units = 0;
+
+    auto insert = [&](uint64_t key) {
+        size_t slot = (size_t)(voxel_hash(key) >> 24) & mask;
+        while (table[slot].key != key && table[slot].key != VOXEL_NO_KEY)
+            slot = (slot + 1) & mask;
+        if (table[slot].key == key)
+            return;
+
+        table[slot].key = key;
+        if (++units * BLOCK_TABLE_LOAD <= (int)table.size())
+            return;
+
+        std::vector<voxel_slot_t> old(table.size() * 2, empty);
+        old.swap(table);
+        mask = table.size() - 1;
+        for (const voxel_slot_t& entry : old)
+        {
+            if (entry.key == VOXEL_NO_KEY)
+                continue;
+
+            size_t at = (size_t)(voxel_hash(entry.key) >> 24) & mask;
+            while (table[at].key != VOXEL_NO_KEY)
+                at = (at + 1) & mask;
+            table[at] = entry;
+        }
+    };
+
+    // Consecutive points mostly span the same cells around them, so those are only inserted once
+    uint64_t last_low = VOXEL_NO_KEY, last_high = VOXEL_NO_KEY;
+    for (int i = 0; i < count; i++)
+    {
+        const float* p = src + (size_t)i * 4;
+        const float low_corner[3] = { p[0] - margin, p[1] - margin, p[2] - margin };
+        const float high_corner[3] = { p[0] + margin, p[1] + margin, p[2] + margin };
+
+        uint64_t low, high;
+        float distance2;
+        if (!voxel_cell(low_corner, inv_unit, unit_size, low, distance2) || !voxel_cell(high_corner, inv_unit, unit_size, high, distance2))
+            continue;
+        if (low == last_low && high == last_high)
+            continue;
+        last_low = low;
+        last_high = high;
+
+        int from[3], to[3];
+        unpack_block_key(low, from);
+        unpack_block_key(high, to);
+        for (int x = from[0]; x <= to[0]; x++)
+        {
+            for (int y = from[1]; y <= to[1]; y++)
+            {
+                for (int z = from[2]; z <= to[2]; z++)
+                {
+                    insert(((uint64_t)(x + VOXEL_COORD_BIAS) << (2 * VOXEL_COORD_BITS)) |
+                        ((uint64_t)(y + VOXEL_COORD_BIAS) << VOXEL_COORD_BITS) | (uint64_t)(z + VOXEL_COORD_BIAS));
+                }
+            }
+        }
+    }
+
+    return units;
+}
+
+////
+//
+// Region culling
+// Points are first classified into one inside byte each, four at a time with SSE
+// against every plane, then the stripes compact their inside points in order.
+//
+////
+
+// Move plane (a, b, c, d) from a local frame into the volume, given the local to volume pose
+static void transform_plane(const cv::Matx44f& pose, const float local[4], float plane[4])
+{
+    // n' = R n, d' = d - n' . t
+    for (int r = 0; r < 3; r++)
+        plane[r] = pose(r, 0) * local[0] + pose(r, 1) * local[1] + pose(r, 2) * local[2];
+
+    plane[3] = local[3] - (plane[0] * pose(0, 3) + plane[1] * pose(1, 3) + plane[2] * pose(2, 3));
+}
+
+// Scale a plane to a unit normal, so plane distances are in metres
+static void normalize_plane(float plane[4])
+{
+    const float length = std::sqrt(plane[0] * plane[0] + plane[1] * plane[1] + plane[2] * plane[2]);
+    for (int c = 0; c < 4; c++)
+        plane[c] /= length;
+}
+
+void make_frustum_region(const cv::Matx44f& camera_pose, const cv::Matx33f& intrinsics, cv::Size frame_size,
+    float near_distance, float far_distance, kinfu_cull_region_t& region)
+{
+    const float fx = intrinsics(0, 0), fy = intrinsics(1, 1);
+    const float cx = intrinsics(0, 2), cy = intrinsics(1, 2);
+    const float width = (float)frame_size.width, height = (float)frame_size.height;
+
+    // Camera-space planes through the image edges facing inwards (OpenCV's y points down), then near and far
+    float local[6][4] = {
+        { fx, 0.f, cx, 0.f },
+        { -fx, 0.f, width - cx, 0.f },
+        { 0.f, fy, cy, 0.f },
+        { 0.f, -fy, height - cy, 0.f },
+        { 0.f, 0.f, 1.f, -near_distance },
+        { 0.f, 0.f, -1.f, far_distance },
+    };
+
+    region.plane_count = 6;
+    for (int p = 0; p < 6; p++)
+    {
+        normalize_plane(local[p]);
+        transform_plane(camera_pose, local[p], region.planes[p]);
+    }
+}
+
+void make_box_region(const cv::Matx44f& box_pose, const float half_extents[3], kinfu_cull_region_t& region)
+{
+    region.plane_count = 6;
+    for (int axis = 0; axis < 3; axis++)
+    {
+        for (int side = 0; side < 2; side++)
+        {
+            // -extent <= x on one side, x <= extent on the other
+            float local[4] = { 0.f, 0.f, 0.f, half_extents[axis] };
+            local[axis] = side == 0 ? 1.f : -1.f;
+            transform_plane(box_pose, local, region.planes[axis * 2 + side]);
+        }
+    }
+}
+
+static void classify_points_scalar(const float* points, int count, const kinfu_cull_region_t& region, uint8_t* inside)
+{
+    for (int i = 0; i < count; i++, points += 4)
+    {
+        uint8_t in = 1;
+        for (int p = 0; p < region.plane_count && in; p++)
+        {
+            const float* plane = region.planes[p];
+            // Written so NaN points are outside
+            in = plane[0] * points[0] + plane[1] * points[1] + plane[2] * points[2] + plane[3] >= 0.f;
+        }
+        inside[i] = in;
+    }
+}
+
+#if KINFU_SIMD_X86
+
+KINFU_TARGET_SSSE3
+static void classify_points_sse(const float* points, int count, const kinfu_cull_region_t& region, uint8_t* inside)
+{
+    // Low byte of each lane's compare mask, as 0 or 1 per point
+    const __m128i lane_bytes = _mm_setr_epi8(0, 4, 8, 12, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+    const __m128i one = _mm_set1_epi8(1);
+    const __m128 zero = _mm_setzero_ps();
+
+    int i = 0;
+    for (; i + 4 <= count; i += 4, points += 16)
+    {
+        __m128 x = _mm_loadu_ps(points + 0);
+        __m128 y = _mm_loadu_ps(points + 4);
+        __m128 z = _mm_loadu_ps(points + 8);
+        __m128 w = _mm_loadu_ps(points + 12);
+        _MM_TRANSPOSE4_PS(x, y, z, w);
+
+        __m128 in = _mm_cmpeq_ps(zero, zero);
+        for (int p = 0; p < region.plane_count; p++)
+        {
+            const float* plane = region.planes[p];
+            const __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(plane[0]), x), _mm_mul_ps(_mm_set1_ps(plane[1]), y)),
+                _mm_add_ps(_mm_mul_ps(_mm_set1_ps(plane[2]), z), _mm_set1_ps(plane[3])));
+            in = _mm_and_ps(in, _mm_cmpge_ps(distance, zero));
+        }
+
+        const int bytes = _mm_cvtsi128_si32(_mm_and_si128(_mm_shuffle_epi8(_mm_castps_si128(in), lane_bytes), one));
+        memcpy(inside + i, &bytes, sizeof(bytes));
+    }
+
+    classify_points_scalar(points, count - i, region, inside + i);
+}
+
+#endif
+
+void cull_cloud(const cloud_snapshot_t& cloud, const kinfu_cull_region_t& region, cloud_snapshot_t& culled, simd_level_t level)
+{
+    CV_Assert(region.plane_count >= 1 && region.plane_count <= KINFU_MAX_CULL_PLANES);
+
+    void (*classify_points)(const float*, int, const kinfu_cull_region_t&, uint8_t*) = classify_points_scalar;
+
+#if KINFU_SIMD_X86
+    if (level >= SIMD_SSSE3)
+        classify_points = classify_points_sse;
+#endif
+
+    const int count = cloud.points.rows;
+    const bool with_normals = count > 0 && cloud.normals.rows == count;
+    const bool with_colors = count > 0 && cloud.colors.rows == count;
+    CV_Assert(count == 0 || (cloud.points.type() == CV_32FC4 && cloud.points.isContinuous()));
+
+    const float* src = cloud.points.ptr<float>();
+    const float* src_normals = with_normals ? cloud.normals.ptr<float>() : NULL;
+    const uint8_t* src_colors = with_colors ? cloud.colors.ptr<uint8_t>() : NULL;
+    const int stripes = std::max((count + CLOUD_EXPORT_STRIPE - 1) / CLOUD_EXPORT_STRIPE, 1);
+
+    // One byte per point, every one written by the classify pass
+    std::unique_ptr<uint8_t[]> inside(new uint8_t[std::max(count, 1)]);
+    std::vector<int> kept(stripes, 0);
+
+    cv::parallel_for_(cv::Range(0, stripes), [&](const cv::Range& range) {
+        for (int stripe = range.start; stripe < range.end; stripe++)
+        {
+            const int begin = stripe * CLOUD_EXPORT_STRIPE;
+            const int end = std::min(begin + CLOUD_EXPORT_STRIPE, count);
+            classify_points(src + (size_t)begin * 4, end - begin, region, inside.get() + begin);
+
+            int n = 0;
+            for (int i = begin; i < end; i++)
+                n += inside[i];
+            kept[stripe] = n;
+        }
+    });
+
+    std::vector<int> kept_start(stripes);
+    int kept_total = 0;
+    for (int stripe = 0; stripe < stripes; stripe++)
+    {
+        kept_start[stripe] = kept_total;
+        kept_total += kept[stripe];
+    }
+
+    culled.generation = cloud.generation;
+    culled.cell_size = cloud.cell_size;
+    culled.lods.clear();
+    culled.block_size = 0.f;
+    culled.blocks.clear();
+    culled.block_points.clear();
+    culled.removed_blocks.clear();
+    culled.block_history_start = 0;
+    culled.points.create(kept_total, 1, CV_32FC4);
+    if (with_normals)
+        culled.normals.create(kept_total, 1, CV_32FC4);
+    else
+        culled.normals.release();
+    if (with_colors)
+        culled.colors.create(kept_total, 1, CV_8UC4);
+    else
+        culled.colors.release();
+
+    if (kept_total == 0)
+        return;
+
+    float* dst = culled.points.ptr<float>();
+    float* dst_normals = with_normals ? culled.normals.ptr<float>() : NULL;
+    uint8_t* dst_colors = with_colors ? culled.colors.ptr<uint8_t>() : NULL;
+
+    cv::parallel_for_(cv::Range(0, stripes), [&](const cv::Range& range) {
+        for (int stripe = range.start; stripe < range.end; stripe++)
+        {
+            const int end = std::min((stripe + 1) * CLOUD_EXPORT_STRIPE, count);
+            size_t out = (size_t)kept_start[stripe];
+
+            for (int i = stripe * CLOUD_EXPORT_STRIPE; i < end; i++)
+            {
+                if (!inside[i])
+                    continue;
+
+                memcpy(dst + out * 4, src + (size_t)i * 4, 4 * sizeof(float));
+                if (with_normals)
+                    memcpy(dst_normals + out * 4, src_normals + (size_t)i * 4, 4 * sizeof(float));
+                if (with_colors)
+                    memcpy(dst_colors + out * 4, src_colors + (size_t)i * 4, 4);
+                out++;
+            }
+        }
+    });
+}
+
+void cull_cloud(const cloud_snapshot_t& cloud, const kinfu_cull_region_t& region, cloud_snapshot_t& culled)
+{
+    cull_cloud(cloud, region, culled, get_simd_level());
+}
+
+////
+//
+// Organized depth back-projection
+// Each row is independent, so rows are spread across threads. The SSE kernel
+// does four pixels at a time and transposes them back into x, y, z, 0 points.
+//
+////
+
+cv::Size organized_map_size(cv::Size frame_size, int downsample)
+{
+    return cv::Size((frame_size.width + downsample - 1) / downsample, (frame_size.height + downsample - 1) / downsample);
+}
+
+// Camera intrinsics and pose of one back-projection, shared by the row kernels
+typedef struct _backprojection_t
+{
+    float inv_fx, inv_fy, cx, cy; /**< Pinhole model */
+    float inv_depth_factor;       /**< Metres per depth unit */
+    float rotation[9];            /**< Camera to volume, row-major */
+    float translation[3];
+    int downsample;               /**< Pixels between samples on both axes */
+} backprojection_t;
+
+static void backproject_row_scalar(const uint16_t* depth, int v, int width, const backprojection_t& bp, float* points)
+{
+    const float nan = std::numeric_limits<float>::quiet_NaN();
+    const float y_ray = ((float)v - bp.cy) * bp.inv_fy;
+
+    for (int x = 0; x < width; x++, points += 4)
+    {
+        const uint16_t d = depth[x * bp.downsample];
+        if (d == 0)
+        {
+            points[0] = points[1] = points[2] = nan;
+            points[3] = 0.f;
+            continue;
+        }
+
+        const float z = d * bp.inv_depth_factor;
+        const float cam[3] = { ((float)(x * bp.downsample) - bp.cx) * bp.inv_fx * z, y_ray * z, z };
+        for (int r = 0; r < 3; r++)
+            points[r] = bp.rotation[r * 3 + 0] * cam[0] + bp.rotation[r * 3 + 1] * cam[1] + bp.rotation[r * 3 + 2] * cam[2] + bp.translation[r];
+        points[3] = 0.f;
+    }
+}
+
+#if KINFU_SIMD_X86
+
+KINFU_TARGET_SSSE3
+static void backproject_row_sse(const uint16_t* depth, int v, int width, const backprojection_t& bp, float* points)
+{
+    const __m128 inv_depth_factor = _mm_set1_ps(bp.inv_depth_factor);
+    const __m128 x_scale = _mm_set1_ps(bp.downsample * bp.inv_fx);
+    const __m128 x_offset = _mm_set1_ps(-bp.cx * bp.inv_fx);
+    const __m128 y_ray = _mm_set1_ps(((float)v - bp.cy) * bp.inv_fy);
+    const __m128 nan = _mm_set1_ps(std::numeric_limits<float>::quiet_NaN());
+    const __m128 lane = _mm_setr_ps(0.f, 1.f, 2.f, 3.f);
+
+    __m128 r[9], t[3];
+    for (int i = 0; i < 9; i++)
+        r[i] = _mm_set1_ps(bp.rotation[i]);
+    for (int i = 0; i < 3; i++)
+        t[i] = _mm_set1_ps(bp.translation[i]);
+
+    int x = 0;
+    for (; x + 4 <= width; x += 4, points += 16)
+    {
+        const uint16_t* d = depth + (size_t)x * bp.downsample;
+        const __m128i raw = _mm_setr_epi32(d[0], d[bp.downsample], d[2 * bp.downsample], d[3 * bp.downsample]);
+        const __m128 missing = _mm_castsi128_ps(_mm_cmpeq_epi32(raw, _mm_setzero_si128()));
+
+        const __m128 z = _mm_mul_ps(_mm_cvtepi32_ps(raw), inv_depth_factor);
+        const __m128 x_ray = _mm_add_ps(_mm_mul_ps(_mm_add_ps(_mm_set1_ps((float)x), lane), x_scale), x_offset);
+        const __m128 cx = _mm_mul_ps(x_ray, z);
+        const __m128 cy = _mm_mul_ps(y_ray, z);
+
+        __m128 wx = _mm_add_ps(_mm_add_ps(_mm_mul_ps(r[0], cx), _mm_mul_ps(r[1], cy)), _mm_add_ps(_mm_mul_ps(r[2], z), t[0]));
+        __m128 wy = _mm_add_ps(_mm_add_ps(_mm_mul_ps(r[3], cx), _mm_mul_ps(r[4], cy)), _mm_add_ps(_mm_mul_ps(r[5], z), t[1]));
+        __m128 wz = _mm_add_ps(_mm_add_ps(_mm_mul_ps(r[6], cx), _mm_mul_ps(r[7], cy)), _mm_add_ps(_mm_mul_ps(r[8], z), t[2]));
+        __m128 ww = _mm_setzero_ps();
+
+        wx = _mm_or_ps(_mm_andnot_ps(missing, wx), _mm_and_ps(missing, nan));
+        wy = _mm_or_ps(_mm_andnot_ps(missing, wy), _mm_and_ps(missing, nan));
+        wz = _mm_or_ps(_mm_andnot_ps(missing, wz), _mm_and_ps(missing, nan));
+
+        _MM_TRANSPOSE4_PS(wx, wy, wz, ww);
+        _mm_storeu_ps(points + 0, wx);
+        _mm_storeu_ps(points + 4, wy);
+        _mm_storeu_ps(points + 8, wz);
+        _mm_storeu_ps(points + 12, ww);
+    }
+
+    if (x < width)
+    {
+        // The scalar kernel indexes from its own start, so hand it the remaining pixels as a row of their own
+        backprojection_t tail = bp;
+        tail.cx -= (float)(x * bp.downsample);
+        backproject_row_scalar(depth + (size_t)x * bp.downsample, v, width - x, tail, points);
+    }
+}
+
+#endif
+
+void backproject_depth(const cv::Mat& depth, const cv::Matx33f& intrinsics, float depth_factor,
+    const cv::Matx44f& camera_pose, int downsample, float* points, simd_level_t level)
+{
+    CV_Assert(depth.type() == CV_16UC1 && downsample >= 1);
+
+    void (*backproject_row)(const uint16_t*, int, int, const backprojection_t&, float*) = backproject_row_scalar;
+
+#if KINFU_SIMD_X86
+    if (level >= SIMD_SSSE3)
+        backproject_row = backproject_row_sse;
+#endif
+
+    backprojection_t bp;
+    bp.inv_fx = 1.f / intrinsics(0, 0);
+    bp.inv_fy = 1.f / intrinsics(1, 1);
+    bp.cx = intrinsics(0, 2);
+    bp.cy = intrinsics(1, 2);
+    bp.inv_depth_factor = 1.f / depth_factor;
+    for (int r = 0; r < 3; r++)
+    {
+        for (int c = 0; c < 3; c++)
+            bp.rotation[r * 3 + c] = camera_pose(r, c);
+        bp.translation[r] = camera_pose(r, 3);
+    }
+    bp.downsample = downsample;
+
+    const cv::Size size = organized_map_size(depth.size(), downsample);
+    cv::parallel_for_(cv::Range(0, size.height), [&](const cv::Range& range) {
+        for (int y = range.start; y < range.end; y++)
+        {
+            backproject_row(depth.ptr<uint16_t>(y * downsample), y * downsample, size.width, bp,
+                points + (size_t)y * size.width * 4);
+        }
+    });
+}
+
+void backproject_depth(const cv::Mat& depth, const cv::Matx33f& intrinsics, float depth_factor,
+    const cv::Matx44f& camera_pose, int downsample, float* points)
+{
+    backproject_depth(depth, intrinsics, depth_factor, camera_pose, downsample, points, get_simd_level());
+}
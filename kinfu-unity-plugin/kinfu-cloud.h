@@ -0,0 +1,158 @@
+#pragma once
+
+#include "kinfu-simd.h"
+#include "kinfu-unity.h"
+
+#include <memory>
+#include <opencv2/core.hpp>
+#include <stdint.h>
+#include <vector>
+
+////
+//
+// Point cloud export helpers
+//
+////
+
+// Floats written per point in the caller's buffer
+typedef enum
+{
+    CLOUD_LAYOUT_XYZ = 3,  /**< Packed x, y, z */
+    CLOUD_LAYOUT_XYZW = 4  /**< x, y, z, 1 for homogeneous positions, 16-byte aligned points */
+} cloud_layout_t;
+
+// One block of a partitioned cloud, its points contiguous in the cloud
+typedef struct _cloud_block_t
+{
+    uint64_t key;        /**< Packed block coordinates, as unpack_block_key reads them */
+    int offset;          /**< First of the block's entries in block_points */
+    int count;           /**< Points in the block */
+    uint64_t hash;       /**< Order-independent hash of the block's positions */
+    uint64_t generation; /**< Generation the block last changed at, set by update_block_history */
+} cloud_block_t;
+
+// A block that left the cloud, kept so later deltas can report it
+typedef struct _cloud_removed_block_t
+{
+    uint64_t key;        /**< Packed block coordinates */
+    uint64_t generation; /**< Generation of the first cloud without it */
+} cloud_removed_block_t;
+
+// A point cloud extracted from the volume, shared between the thread that fused it and its readers.
+// Never modified once published, so readers can hold on to it while newer clouds are extracted
+typedef struct _cloud_snapshot_t
+{
+    cv::Mat points;      /**< Nx1 CV_32FC4 from getPoints */
+    cv::Mat normals;     /**< Nx1 CV_32FC4 from getCloud, empty unless normals were asked for */
+    cv::Mat colors;      /**< Nx1 CV_8UC4 RGBA32, empty unless the volume fuses color */
+    uint64_t generation; /**< Fusion generation the cloud was extracted at */
+    float cell_size;     /**< Grid cell a LOD was filtered to, 0 for the full cloud */
+    std::vector<std::shared_ptr<_cloud_snapshot_t>> lods; /**< Voxel-filtered copies from build_cloud_lods, finest first */
+    float block_size;    /**< Edge of the blocks the points are sorted into, 0 if not partitioned */
+    std::vector<cloud_block_t> blocks;                 /**< Blocks in key order, from partition_cloud_blocks */
+    std::vector<int> block_points;                     /**< Indices of the points, block after block */
+    std::vector<cloud_removed_block_t> removed_blocks; /**< Blocks removed since block_history_start, in key order */
+    uint64_t block_history_start; /**< Deltas from generations before this have to list every block */
+} cloud_snapshot_t;
+
+// Block hashes of the newest partitioned cloud, which the next one is compared against
+typedef struct _cloud_block_history_t
+{
+    float block_size;    /**< Block edge of the clouds in the history, 0 before the first */
+    uint64_t generation; /**< Generation of the newest cloud */
+    uint64_t start;      /**< Generation the history starts at */
+    std::vector<cloud_block_t> blocks;           /**< Blocks of the newest cloud, in key order */
+    std::vector<cloud_removed_block_t> removed;  /**< Blocks removed since start, in key order */
+} cloud_block_history_t;
+
+// Most LOD levels built alongside one cloud
+#define CLOUD_MAX_LODS 4
+
+// Convert count points from KinFu's getPoints/getCloud layout (x, y, z, padding per point)
+// straight into dst in the given layout, in parallel for large clouds.
+// Picks the widest kernel the CPU supports.
+void export_cloud_points(const float* points, int count, float* dst, cloud_layout_t layout);
+
+// Same as above with an explicit instruction set, used by the benchmarks
+void export_cloud_points(const float* points, int count, float* dst, cloud_layout_t layout, simd_level_t level);
+
+// Convert points [offset, offset + count) of a snapshot into dst, clamped to the end of the cloud.
+// Returns the number of points written, or -1 for a negative offset or count
+int export_cloud_range(const cloud_snapshot_t& cloud, int offset, int count, float* dst, cloud_layout_t layout);
+
+// Whether an interleaved vertex format is usable: attributes inside the stride and a known color format.
+// Writes the reason into error (if not NULL) when it is not
+bool validate_vertex_format(const kinfu_vertex_format_t& format, const char** error);
+
+// Write points [offset, offset + count) of a snapshot as interleaved vertices, clamped to the end of the cloud.
+// Colors come from the cloud when it has them, format.color otherwise.
+// Returns the number of vertices written, or -1 for a negative offset or count or missing normals
+int export_cloud_vertices(const cloud_snapshot_t& cloud, int offset, int count, uint8_t* dst, const kinfu_vertex_format_t& format);
+
+// Keep one point per cell of a cell_size grid, the one nearest the cell centre, along with its normal
+// and color if normals and colors have a row per point. Cells are bucketed by a hash of their coordinates and the buckets
+// filtered in parallel, so the cost is linear in the number of points
+void voxel_filter_cloud(const cv::Mat& points, const cv::Mat& normals, const cv::Mat& colors, float cell_size,
+    cv::Mat& filtered_points, cv::Mat& filtered_normals, cv::Mat& filtered_colors);
+
+// Same as above with an explicit instruction set, used by the benchmarks
+void voxel_filter_cloud(const cv::Mat& points, const cv::Mat& normals, const cv::Mat& colors, float cell_size,
+    cv::Mat& filtered_points, cv::Mat& filtered_normals, cv::Mat& filtered_colors, simd_level_t level);
+
+// Fill cloud.lods with a voxel-filtered copy per cell size, each filtered from the level before it
+// so only the first pass touches every point. Cell sizes must be positive and increasing
+void build_cloud_lods(cloud_snapshot_t& cloud, const float* cell_sizes, int count);
+
+// Planes of the depth camera frustum between near_distance and far_distance, for a camera with these
+// intrinsics and image size placed at camera_pose (camera to volume)
+void make_frustum_region(const cv::Matx44f& camera_pose, const cv::Matx33f& intrinsics, cv::Size frame_size,
+    float near_distance, float far_distance, kinfu_cull_region_t& region);
+
+// Planes of a box of the given half extents placed at box_pose (box to volume)
+void make_box_region(const cv::Matx44f& box_pose, const float half_extents[3], kinfu_cull_region_t& region);
+
+// Copy the points of cloud inside region, with their normals and colors, into culled.
+// The points are classified in parallel, then compacted in order
+void cull_cloud(const cloud_snapshot_t& cloud, const kinfu_cull_region_t& region, cloud_snapshot_t& culled);
+
+// Same as above with an explicit instruction set, used by the benchmarks
+void cull_cloud(const cloud_snapshot_t& cloud, const kinfu_cull_region_t& region, cloud_snapshot_t& culled, simd_level_t level);
+
+// Size of the organized map backproject_depth makes from a frame_size image, every downsample-th pixel
+cv::Size organized_map_size(cv::Size frame_size, int downsample);
+
+// Back-project every downsample-th pixel of a CV_16UC1 depth image (depth_factor units per metre) through
+// the pinhole intrinsics to camera_pose (camera to volume), as an organized map of x, y, z, 0 per pixel.
+// Pixels without depth are NaN, as in KinFu's own vertex maps
+void backproject_depth(const cv::Mat& depth, const cv::Matx33f& intrinsics, float depth_factor,
+    const cv::Matx44f& camera_pose, int downsample, float* points);
+
+// Same as above with an explicit instruction set, used by the benchmarks
+void backproject_depth(const cv::Mat& depth, const cv::Matx33f& intrinsics, float depth_factor,
+    const cv::Matx44f& camera_pose, int downsample, float* points, simd_level_t level);
+
+// Block coordinates packed into a cloud_block_t key
+void unpack_block_key(uint64_t key, int coords[3]);
+
+// Group the points of cloud by the block_size grid block they fall in, filling cloud.blocks with each
+// block's run of cloud.block_points and its hash. Points off the grid are left out. Keys are found in
+// parallel stripes and blocks numbered in one pass, then the indices are scattered in parallel, in point
+// order within a block
+void partition_cloud_blocks(cloud_snapshot_t& cloud, float block_size);
+
+// Same as above with an explicit instruction set, used by the benchmarks
+void partition_cloud_blocks(cloud_snapshot_t& cloud, float block_size, simd_level_t level);
+
+// Compare a partitioned cloud's blocks against history, setting the generation each block last changed at
+// and the blocks removed since, then make the cloud the newest in history. Clouds must come in generation
+// order; an older one than history has seen gets marked as changed everywhere and leaves history alone
+void update_block_history(cloud_block_history_t& history, cloud_snapshot_t& cloud);
+
+// Copy the blocks of a partitioned cloud that changed after generation since into delta, and list them,
+// then the blocks removed after since, in blocks. When since is before the cloud's history every block
+// is listed and header.full set
+void extract_cloud_delta(const cloud_snapshot_t& cloud, uint64_t since, cloud_snapshot_t& delta,
+    std::vector<kinfu_cloud_block_t>& blocks, kinfu_cloud_delta_t& header);
+
+// Number of unit_size grid cells within margin of any point, as a hashed volume allocates around a surface
+int count_volume_units(const cv::Mat& points, float unit_size, float margin);
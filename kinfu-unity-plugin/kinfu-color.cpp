@@ -0,0 +1,115 @@
+#include "pch.h"
+#include "framework.h"
+#include "kinfu-color.h"
+
+#include <algorithm>
+
+////
+//
+// BGRA -> RGBA swizzle kernels
+// Each kernel converts one row; the row loop and flip live in the dispatcher.
+//
+////
+
+static void swizzle_row_scalar(const uint8_t* src, uint8_t* dst, int width)
+{
+    for (int x = 0; x < width; x++, src += 4, dst += 4)
+    {
+        // Swap Blue and Red (because the image is in BGRA not RGBA)
+        dst[0] = src[2];
+        dst[1] = src[1];
+        dst[2] = src[0];
+        dst[3] = src[3];
+    }
+}
+
+#if KINFU_SIMD_X86
+
+KINFU_TARGET_SSSE3
+static void swizzle_row_ssse3(const uint8_t* src, uint8_t* dst, int width)
+{
+    const __m128i mask = _mm_setr_epi8(2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15);
+
+    int x = 0;
+    for (; x + 4 <= width; x += 4)
+    {
+        __m128i px = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + x * 4));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + x * 4), _mm_shuffle_epi8(px, mask));
+    }
+
+    swizzle_row_scalar(src + x * 4, dst + x * 4, width - x);
+}
+
+KINFU_TARGET_AVX2
+static void swizzle_row_avx2(const uint8_t* src, uint8_t* dst, int width)
+{
+    // vpshufb works per 128-bit lane, so the mask repeats for both lanes
+    const __m256i mask = _mm256_setr_epi8(2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15,
+                                          2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15);
+
+    int x = 0;
+    for (; x + 16 <= width; x += 16)
+    {
+        __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + x * 4));
+        __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + x * 4 + 32));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + x * 4), _mm256_shuffle_epi8(a, mask));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + x * 4 + 32), _mm256_shuffle_epi8(b, mask));
+    }
+
+    swizzle_row_ssse3(src + x * 4, dst + x * 4, width - x);
+}
+
+#endif
+
+void swizzle_bgra_to_rgba(const uint8_t* src,
+    int src_stride,
+    uint8_t* dst,
+    int width,
+    int height,
+    bool flip_vertical,
+    simd_level_t level)
+{
+    void (*swizzle_row)(const uint8_t*, uint8_t*, int) = swizzle_row_scalar;
+
+#if KINFU_SIMD_X86
+    if (level == SIMD_AVX2)
+        swizzle_row = swizzle_row_avx2;
+    else if (level == SIMD_SSSE3)
+        swizzle_row = swizzle_row_ssse3;
+#endif
+
+    const size_t dst_stride = (size_t)width * 4;
+
+    for (int y = 0; y < height; y++)
+    {
+        const int dst_y = flip_vertical ? height - 1 - y : y;
+        swizzle_row(src + (size_t)y * src_stride, dst + (size_t)dst_y * dst_stride, width);
+    }
+}
+
+void swizzle_bgra_to_rgba(const uint8_t* src,
+    int src_stride,
+    uint8_t* dst,
+    int width,
+    int height,
+    bool flip_vertical)
+{
+    swizzle_bgra_to_rgba(src, src_stride, dst, width, height, flip_vertical, get_simd_level());
+}
+
+void set_opaque_alpha(uint8_t* rgba, int pixel_count)
+{
+    for (int i = 0; i < pixel_count; i++)
+        rgba[(size_t)i * 4 + 3] = 255;
+}
+
+void pack_point_colors(const float* colors, int count, uint8_t* rgba)
+{
+    for (int i = 0; i < count; i++, colors += 4, rgba += 4)
+    {
+        // Channels come back in the order they were fused, B, G, R. NaN clamps to 0
+        for (int c = 0; c < 3; c++)
+            rgba[2 - c] = (uint8_t)std::min(255.f, std::max(0.f, colors[c] + 0.5f));
+        rgba[3] = 255;
+    }
+}
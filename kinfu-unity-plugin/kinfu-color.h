@@ -0,0 +1,37 @@
+#pragma once
+
+#include "kinfu-simd.h"
+
+#include <stdint.h>
+
+////
+//
+// Color image conversion helpers
+//
+////
+
+// Convert a BGRA32 image into a tightly packed RGBA32 buffer (width * 4 bytes per row)
+// in a single pass, optionally flipping it vertically so row 0 ends up at the bottom
+// as Unity textures expect. Picks the widest kernel the CPU supports.
+void swizzle_bgra_to_rgba(const uint8_t* src,
+    int src_stride,
+    uint8_t* dst,
+    int width,
+    int height,
+    bool flip_vertical);
+
+// Same as above with an explicit instruction set, used by the benchmarks.
+// Falls back to the scalar kernel if the level is not supported by this build.
+void swizzle_bgra_to_rgba(const uint8_t* src,
+    int src_stride,
+    uint8_t* dst,
+    int width,
+    int height,
+    bool flip_vertical,
+    simd_level_t level);
+
+// Set the alpha of every RGBA32 pixel to 255, for sources that leave it at 0 (such as KinFu::render)
+void set_opaque_alpha(uint8_t* rgba, int pixel_count);
+
+// Pack ColoredKinFu's point colors (float4 B, G, R, 0 from 0 to 255) into opaque RGBA32
+void pack_point_colors(const float* colors, int count, uint8_t* rgba);
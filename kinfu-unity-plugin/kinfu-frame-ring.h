@@ -0,0 +1,84 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+
+////
+//
+// Single-producer / single-consumer ring of preallocated frame slots.
+//
+// The producer (capture thread) fills the slot returned by beginWrite() and
+// publishes it with endWrite(). The consumer (Unity thread) takes the newest
+// published slot with beginReadLatest() and hands it back with endRead().
+// Neither side blocks or allocates, so slot buffers must be sized up front.
+//
+////
+
+template <typename T, size_t N>
+class FrameRing
+{
+public:
+    // Slot for the producer to fill, or nullptr if the consumer has fallen behind
+    T *beginWrite()
+    {
+        const size_t h = head.load(std::memory_order_relaxed);
+        if (h - tail.load(std::memory_order_acquire) == N)
+            return nullptr;
+
+        return &slots[h % N];
+    }
+
+    // Publish the slot returned by beginWrite()
+    void endWrite()
+    {
+        head.store(head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    // Newest published slot, dropping any older ones, or nullptr if none are pending
+    T *beginReadLatest()
+    {
+        size_t t = tail.load(std::memory_order_relaxed);
+        const size_t h = head.load(std::memory_order_acquire);
+        if (t == h)
+            return nullptr;
+
+        if (h - t > 1)
+        {
+            t = h - 1;
+            tail.store(t, std::memory_order_release);
+        }
+
+        return &slots[t % N];
+    }
+
+    // Hand the slot returned by beginReadLatest() back to the producer
+    void endRead()
+    {
+        tail.store(tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    // Direct slot access, only safe while neither side is running
+    T &slot(size_t index)
+    {
+        return slots[index];
+    }
+
+    size_t capacity() const
+    {
+        return N;
+    }
+
+    // Drop all pending slots, only safe while neither side is running
+    void clear()
+    {
+        head.store(0, std::memory_order_relaxed);
+        tail.store(0, std::memory_order_relaxed);
+    }
+
+private:
+    T slots[N];
+
+    // Kept on separate cache lines so the two threads do not false-share
+    alignas(64) std::atomic<size_t> head{0};
+    alignas(64) std::atomic<size_t> tail{0};
+};
@@ -0,0 +1,135 @@
+#include "pch.h"
+#include "framework.h"
+#include "kinfu-fusion.h"
+
+#include <type_traits>
+
+// Only ColoredKinFu fuses color, the others fuse the depth alone
+template <typename T>
+static bool update_fusion(T& fusion, cv::InputArray depth, cv::InputArray)
+{
+    return fusion.update(depth);
+}
+
+static bool update_fusion(cv::colored_kinfu::ColoredKinFu& fusion, cv::InputArray depth, cv::InputArray rgb)
+{
+    return fusion.update(depth, rgb);
+}
+
+template <typename T>
+static void get_fusion_cloud(const T& fusion, cv::OutputArray points, cv::OutputArray normals, cv::OutputArray colors)
+{
+    fusion.getCloud(points, normals);
+    colors.release();
+}
+
+static void get_fusion_cloud(const cv::colored_kinfu::ColoredKinFu& fusion, cv::OutputArray points, cv::OutputArray normals,
+    cv::OutputArray colors)
+{
+    fusion.getCloud(points, normals, colors);
+}
+
+// Forwards to a KinFu, LargeKinfu or ColoredKinFu, keeping a copy of its params in KinFu's form
+template <typename T>
+class FusionAdapter : public FusionBackend
+{
+public:
+    FusionAdapter(const cv::Ptr<T>& fusion, const cv::kinfu::Params& params) : fusion(fusion), params(params) {}
+
+    const cv::kinfu::Params& getParams() const override { return params; }
+    bool hasColor() const override { return std::is_same<T, cv::colored_kinfu::ColoredKinFu>::value; }
+
+    void render(cv::OutputArray image) const override { fusion->render(image); }
+    void render(cv::OutputArray image, const cv::Matx44f& cameraPose) const override { fusion->render(image, cameraPose); }
+    void getCloud(cv::OutputArray points, cv::OutputArray normals) const override { fusion->getCloud(points, normals); }
+    void getCloud(cv::OutputArray points, cv::OutputArray normals, cv::OutputArray colors) const override
+    {
+        get_fusion_cloud(*fusion, points, normals, colors);
+    }
+    void getPoints(cv::OutputArray points) const override { fusion->getPoints(points); }
+    void getNormals(cv::InputArray points, cv::OutputArray normals) const override { fusion->getNormals(points, normals); }
+    void reset() override { fusion->reset(); }
+    cv::Affine3f getPose() const override { return fusion->getPose(); }
+    bool update(cv::InputArray depth) override
+    {
+        // ColoredKinFu has no depth-only update
+        CV_Assert(!hasColor());
+        return update_fusion(*fusion, depth, cv::noArray());
+    }
+    bool update(cv::InputArray depth, cv::InputArray rgb) override { return update_fusion(*fusion, depth, rgb); }
+
+private:
+    cv::Ptr<T> fusion;
+    cv::kinfu::Params params;
+};
+
+cv::Ptr<FusionBackend> create_kinfu_backend(const cv::Ptr<cv::kinfu::Params>& params)
+{
+    return cv::makePtr<FusionAdapter<cv::kinfu::KinFu>>(cv::kinfu::KinFu::create(params), *params);
+}
+
+// LargeKinfu's params as KinFu's, its submaps described by the volume fields
+static cv::kinfu::Params kinfu_params_of(const cv::large_kinfu::Params& large)
+{
+    cv::kinfu::Params params;
+    params.frameSize = large.frameSize;
+    params.volumeType = large.volumeParams.type;
+    params.intr = large.intr;
+    params.rgb_intr = large.rgb_intr;
+    params.depthFactor = large.depthFactor;
+    params.bilateral_sigma_depth = large.bilateral_sigma_depth;
+    params.bilateral_sigma_spatial = large.bilateral_sigma_spatial;
+    params.bilateral_kernel_size = large.bilateral_kernel_size;
+    params.pyramidLevels = large.pyramidLevels;
+    params.volumeDims = large.volumeParams.resolution;
+    params.voxelSize = large.volumeParams.voxelSize;
+    params.tsdf_min_camera_movement = large.tsdf_min_camera_movement;
+    params.volumePose = large.volumeParams.pose;
+    params.tsdf_trunc_dist = large.volumeParams.tsdfTruncDist;
+    params.tsdf_max_weight = large.volumeParams.maxWeight;
+    params.raycast_step_factor = large.volumeParams.raycastStepFactor;
+    params.lightPose = large.lightPose;
+    params.icpDistThresh = large.icpDistThresh;
+    params.icpAngleThresh = large.icpAngleThresh;
+    params.icpIterations = large.icpIterations;
+    params.truncateThreshold = large.truncateThreshold;
+    return params;
+}
+
+cv::Ptr<FusionBackend> create_large_kinfu_backend(const cv::Ptr<cv::large_kinfu::Params>& params)
+{
+    return cv::makePtr<FusionAdapter<cv::large_kinfu::LargeKinfu>>(cv::large_kinfu::LargeKinfu::create(params), kinfu_params_of(*params));
+}
+
+// ColoredKinFu's params as KinFu's, which has the same fields bar the color frame size
+static cv::kinfu::Params kinfu_params_of(const cv::colored_kinfu::Params& colored)
+{
+    cv::kinfu::Params params;
+    params.frameSize = colored.frameSize;
+    params.volumeType = colored.volumeType;
+    params.intr = colored.intr;
+    params.rgb_intr = colored.rgb_intr;
+    params.depthFactor = colored.depthFactor;
+    params.bilateral_sigma_depth = colored.bilateral_sigma_depth;
+    params.bilateral_sigma_spatial = colored.bilateral_sigma_spatial;
+    params.bilateral_kernel_size = colored.bilateral_kernel_size;
+    params.pyramidLevels = colored.pyramidLevels;
+    params.volumeDims = colored.volumeDims;
+    params.voxelSize = colored.voxelSize;
+    params.tsdf_min_camera_movement = colored.tsdf_min_camera_movement;
+    params.volumePose = colored.volumePose;
+    params.tsdf_trunc_dist = colored.tsdf_trunc_dist;
+    params.tsdf_max_weight = colored.tsdf_max_weight;
+    params.raycast_step_factor = colored.raycast_step_factor;
+    params.lightPose = colored.lightPose;
+    params.icpDistThresh = colored.icpDistThresh;
+    params.icpAngleThresh = colored.icpAngleThresh;
+    params.icpIterations = colored.icpIterations;
+    params.truncateThreshold = colored.truncateThreshold;
+    return params;
+}
+
+cv::Ptr<FusionBackend> create_colored_kinfu_backend(const cv::Ptr<cv::colored_kinfu::Params>& params)
+{
+    return cv::makePtr<FusionAdapter<cv::colored_kinfu::ColoredKinFu>>(cv::colored_kinfu::ColoredKinFu::create(params), kinfu_params_of(*params));
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <opencv2/rgbd.hpp>
+
+////
+//
+// Fusion backends
+// KinFu, LargeKinfu and ColoredKinFu have nearly the same methods but no common base,
+// so the plugin drives whichever one was started through this interface.
+//
+////
+
+class FusionBackend
+{
+public:
+    virtual ~FusionBackend() = default;
+
+    // Params in KinFu's form. LargeKinfu's volume params are folded in, as a hash volume
+    virtual const cv::kinfu::Params& getParams() const = 0;
+
+    // Whether update fuses a color image and getCloud gives colors back
+    virtual bool hasColor() const = 0;
+
+    virtual void render(cv::OutputArray image) const = 0;
+    virtual void render(cv::OutputArray image, const cv::Matx44f& cameraPose) const = 0;
+    virtual void getCloud(cv::OutputArray points, cv::OutputArray normals) const = 0;
+    // Also gives colors as float4 B, G, R, 0 from 0 to 255 when hasColor, releases them otherwise
+    virtual void getCloud(cv::OutputArray points, cv::OutputArray normals, cv::OutputArray colors) const = 0;
+    virtual void getPoints(cv::OutputArray points) const = 0;
+    virtual void getNormals(cv::InputArray points, cv::OutputArray normals) const = 0;
+    virtual void reset() = 0;
+    virtual cv::Affine3f getPose() const = 0;
+    virtual bool update(cv::InputArray depth) = 0;
+    // rgb is a CV_8UC3 image registered to depth, ignored unless hasColor
+    virtual bool update(cv::InputArray depth, cv::InputArray rgb) = 0;
+};
+
+// A single KinFu volume, dense or hashed
+cv::Ptr<FusionBackend> create_kinfu_backend(const cv::Ptr<cv::kinfu::Params>& params);
+
+// LargeKinfu, which tracks against hashed submaps and adds new ones as the camera moves on.
+// Only the current submap can be read back, so clouds and renders come from that one
+cv::Ptr<FusionBackend> create_large_kinfu_backend(const cv::Ptr<cv::large_kinfu::Params>& params);
+
+// ColoredKinFu, a dense volume that also fuses color. It projects rgb with the depth camera's pose,
+// so color must already be registered to depth, with rgb_intr for the registered image
+cv::Ptr<FusionBackend> create_colored_kinfu_backend(const cv::Ptr<cv::colored_kinfu::Params>& params);
@@ -1,6 +1,7 @@
 #include "pch.h"
 #include "framework.h"
 #include "kinfu-helpers.h"
+#include "kinfu-simd.h"
 
 ////
 // 
@@ -141,17 +142,113 @@ pinhole_t create_pinhole_from_xy_range(const k4a_calibration_t* calibration, con
     return pinhole;
 }
 
+// Round each array up to a cache line so the kernels' loads stay aligned
+static size_t lut_array_size(size_t bytes)
+{
+    return (bytes + 63) & ~(size_t)63;
+}
+
+size_t undistortion_lut_data_size(int width, int height, interpolation_t type)
+{
+    const size_t count = (size_t)width * (size_t)height;
+    size_t bytes = lut_array_size(count * sizeof(uint32_t)) + lut_array_size((count + 31) / 32 * sizeof(uint32_t));
+    if (type != INTERPOLATION_NEARESTNEIGHBOR)
+    {
+        bytes += 4 * lut_array_size(count * sizeof(uint16_t));
+    }
+    return bytes;
+}
+
+void bind_undistortion_lut(undistortion_lut_t* lut, uint8_t* base, int width, int height, int src_width, interpolation_t type)
+{
+    const size_t count = (size_t)width * (size_t)height;
+    const bool bilinear = type != INTERPOLATION_NEARESTNEIGHBOR;
+
+    const size_t offset_size = lut_array_size(count * sizeof(uint32_t));
+    const size_t valid_size = lut_array_size((count + 31) / 32 * sizeof(uint32_t));
+    const size_t weight_size = lut_array_size(count * sizeof(uint16_t));
+
+    lut->width = width;
+    lut->height = height;
+    lut->src_width = src_width;
+    lut->type = type;
+
+    lut->offset = (uint32_t*)base;
+    lut->valid = (uint32_t*)(base + offset_size);
+    for (int k = 0; k < 4; k++)
+    {
+        lut->weight[k] = bilinear ? (uint16_t*)(base + offset_size + valid_size + k * weight_size) : NULL;
+    }
+}
+
+void allocate_undistortion_lut(undistortion_lut_t* lut, int width, int height, int src_width, interpolation_t type)
+{
+    lut->mapping.reset();
+
+    // Zeroed, so every entry starts out invalid with a safe offset of 0
+    lut->storage.assign(undistortion_lut_data_size(width, height, type) + 63, 0);
+    uint8_t* base = (uint8_t*)(((uintptr_t)lut->storage.data() + 63) & ~(uintptr_t)63);
+
+    bind_undistortion_lut(lut, base, width, height, src_width, type);
+}
+
+void release_undistortion_lut(undistortion_lut_t* lut)
+{
+    lut->storage = std::vector<uint8_t>();
+    lut->mapping.reset();
+
+    lut->offset = NULL;
+    lut->valid = NULL;
+    for (int k = 0; k < 4; k++)
+    {
+        lut->weight[k] = NULL;
+    }
+}
+
+size_t undistortion_lut_size(const undistortion_lut_t* lut)
+{
+    const size_t count = (size_t)lut->width * (size_t)lut->height;
+    size_t bytes = count * sizeof(uint32_t) + (count + 31) / 32 * sizeof(uint32_t);
+    if (lut->weight[0] != NULL)
+    {
+        bytes += 4 * count * sizeof(uint16_t);
+    }
+    return bytes;
+}
+
+// Store the offset and weights of one entry, leaving the valid bit to the caller
+static void store_undistortion_lut_entry(undistortion_lut_t* lut, int idx, int x, int y, const float weight[4])
+{
+    lut->offset[idx] = (uint32_t)(y * lut->src_width + x);
+
+    if (lut->weight[0] != NULL)
+    {
+        // Round three weights and give the remainder to the last, so they always sum to exactly 1.0
+        const int one = 1 << LUT_WEIGHT_BITS;
+        int sum = 0;
+        for (int k = 0; k < 3; k++)
+        {
+            int w = (int)(weight[k] * one + 0.5f);
+            w = min(max(w, 0), one - sum);
+            lut->weight[k][idx] = (uint16_t)w;
+            sum += w;
+        }
+        lut->weight[3][idx] = (uint16_t)(one - sum);
+    }
+}
+
+void set_undistortion_lut_entry(undistortion_lut_t* lut, int idx, int x, int y, const float weight[4])
+{
+    store_undistortion_lut_entry(lut, idx, x, y, weight);
+    lut->valid[idx >> 5] |= 1u << (idx & 31);
+}
+
 void create_undistortion_lut(const k4a_calibration_t* calibration,
     const k4a_calibration_type_t camera,
     const pinhole_t* pinhole,
-    k4a_image_t lut,
+    undistortion_lut_t* lut,
     interpolation_t type)
 {
-    coordinate_t* lut_data = (coordinate_t*)(void*)k4a_image_get_buffer(lut);
-
-    k4a_float3_t ray;
-    ray.xyz.z = 1.f;
-
     int src_width = calibration->depth_camera_calibration.resolution_width;
     int src_height = calibration->depth_camera_calibration.resolution_height;
     if (camera == K4A_CALIBRATION_TYPE_COLOR)
@@ -160,142 +257,356 @@ void create_undistortion_lut(const k4a_calibration_t* calibration,
         src_height = calibration->color_camera_calibration.resolution_height;
     }
 
-    for (int y = 0, idx = 0; y < pinhole->height; y++)
+    allocate_undistortion_lut(lut, pinhole->width, pinhole->height, src_width, type);
+
+    if (type != INTERPOLATION_NEARESTNEIGHBOR && type != INTERPOLATION_BILINEAR && type != INTERPOLATION_BILINEAR_DEPTH)
     {
-        ray.xyz.y = ((float)y - pinhole->py) / pinhole->fy;
+        printf("Unexpected interpolation type!\n");
+        exit(-1);
+    }
 
-        for (int x = 0; x < pinhole->width; x++, idx++)
-        {
-            ray.xyz.x = ((float)x - pinhole->px) / pinhole->fx;
+    // Rows can share a word of the valid bitmask, so they flag pixels here and the bits are packed afterwards
+    std::vector<uint8_t> valid_pixels((size_t)pinhole->width * (size_t)pinhole->height, 0);
 
-            k4a_float2_t distorted;
-            int valid;
-            k4a_calibration_3d_to_2d(calibration, &ray, camera, camera, &distorted, &valid);
+    // Each destination pixel is an independent projection, so bands of rows are built in parallel
+    parallel_for_(Range(0, pinhole->height), [&](const Range& rows) {
+        k4a_float3_t ray;
+        ray.xyz.z = 1.f;
 
-            coordinate_t src;
-            if (type == INTERPOLATION_NEARESTNEIGHBOR)
-            {
-                // Remapping via nearest neighbor interpolation
-                src.x = (int)floorf(distorted.xy.x + 0.5f);
-                src.y = (int)floorf(distorted.xy.y + 0.5f);
-            }
-            else if (type == INTERPOLATION_BILINEAR || type == INTERPOLATION_BILINEAR_DEPTH)
-            {
-                // Remapping via bilinear interpolation
-                src.x = (int)floorf(distorted.xy.x);
-                src.y = (int)floorf(distorted.xy.y);
-            }
-            else
-            {
-                printf("Unexpected interpolation type!\n");
-                exit(-1);
-            }
+        for (int y = rows.start; y < rows.end; y++)
+        {
+            ray.xyz.y = ((float)y - pinhole->py) / pinhole->fy;
 
-            if (valid && src.x >= 0 && src.x < src_width && src.y >= 0 && src.y < src_height)
+            for (int x = 0, idx = y * pinhole->width; x < pinhole->width; x++, idx++)
             {
-                lut_data[idx] = src;
+                ray.xyz.x = ((float)x - pinhole->px) / pinhole->fx;
+
+                k4a_float2_t distorted;
+                int valid;
+                k4a_calibration_3d_to_2d(calibration, &ray, camera, camera, &distorted, &valid);
+
+                coordinate_t src;
+                if (type == INTERPOLATION_NEARESTNEIGHBOR)
+                {
+                    // Remapping via nearest neighbor interpolation
+                    src.x = (int)floorf(distorted.xy.x + 0.5f);
+                    src.y = (int)floorf(distorted.xy.y + 0.5f);
+                }
+                else
+                {
+                    // Remapping via bilinear interpolation
+                    src.x = (int)floorf(distorted.xy.x);
+                    src.y = (int)floorf(distorted.xy.y);
+                }
 
-                if (type == INTERPOLATION_BILINEAR || type == INTERPOLATION_BILINEAR_DEPTH)
+                // Entries start out invalid, so only valid ones need writing
+                if (valid && src.x >= 0 && src.x < src_width && src.y >= 0 && src.y < src_height)
                 {
-                    // Compute the floating point weights, using the distance from projected point src to the
-                    // image coordinate of the upper left neighbor
-                    float w_x = distorted.xy.x - src.x;
-                    float w_y = distorted.xy.y - src.y;
-                    float w0 = (1.f - w_x) * (1.f - w_y);
-                    float w1 = w_x * (1.f - w_y);
-                    float w2 = (1.f - w_x) * w_y;
-                    float w3 = w_x * w_y;
+                    if (type == INTERPOLATION_BILINEAR || type == INTERPOLATION_BILINEAR_DEPTH)
+                    {
+                        // Compute the floating point weights, using the distance from projected point src to the
+                        // image coordinate of the upper left neighbor
+                        float w_x = distorted.xy.x - src.x;
+                        float w_y = distorted.xy.y - src.y;
+                        src.weight[0] = (1.f - w_x) * (1.f - w_y);
+                        src.weight[1] = w_x * (1.f - w_y);
+                        src.weight[2] = (1.f - w_x) * w_y;
+                        src.weight[3] = w_x * w_y;
+                    }
 
                     // Fill into lut
-                    lut_data[idx].weight[0] = w0;
-                    lut_data[idx].weight[1] = w1;
-                    lut_data[idx].weight[2] = w2;
-                    lut_data[idx].weight[3] = w3;
+                    store_undistortion_lut_entry(lut, idx, src.x, src.y, src.weight);
+                    valid_pixels[idx] = 1;
                 }
             }
-            else
-            {
-                lut_data[idx].x = INVALID;
-                lut_data[idx].y = INVALID;
-            }
+        }
+    });
+
+    for (size_t idx = 0; idx < valid_pixels.size(); idx++)
+    {
+        lut->valid[idx >> 5] |= (uint32_t)valid_pixels[idx] << (idx & 31);
+    }
+}
+
+void remap(const k4a_image_t src, const undistortion_lut_t* lut, k4a_image_t dst)
+{
+    remap(src, lut, (uint16_t*)(void*)k4a_image_get_buffer(dst));
+}
+
+// Skip interpolation threshold, see remap_pixel for how it is estimated
+static const float skip_interpolation_ratio = 0.04693441759f;
+
+// Remap a single destination pixel.
+// The interpolation type is a template parameter so the per-pixel branches fold away.
+template <interpolation_t type>
+static inline uint16_t remap_pixel(const uint16_t* src_data, int src_width, const undistortion_lut_t* lut, int i)
+{
+    if ((lut->valid[i >> 5] & (1u << (i & 31))) == 0)
+    {
+        return 0;
+    }
+
+    const uint32_t offset = lut->offset[i];
+
+    if (type == INTERPOLATION_NEARESTNEIGHBOR)
+    {
+        return src_data[offset];
+    }
+
+    const uint32_t neighbors[4]{ src_data[offset],
+                                 src_data[offset + 1],
+                                 src_data[offset + src_width],
+                                 src_data[offset + src_width + 1] };
+
+    if (type == INTERPOLATION_BILINEAR_DEPTH)
+    {
+        // If the image contains invalid data, e.g. depth image contains value 0, ignore the bilinear
+        // interpolation for current target pixel if one of the neighbors contains invalid data to avoid
+        // introduce noise on the edge. If the image is color or ir images, user should use
+        // INTERPOLATION_BILINEAR
+        if (neighbors[0] == 0 || neighbors[1] == 0 || neighbors[2] == 0 || neighbors[3] == 0)
+        {
+            return 0;
+        }
+
+        // Ignore interpolation at large depth discontinuity without disrupting slanted surface
+        // Skip interpolation threshold is estimated based on the following logic:
+        // - angle between two pixels is: theta = 0.234375 degree (120 degree / 512) in binning resolution
+        // mode
+        // - distance between two pixels at same depth approximately is: A ~= sin(theta) * depth
+        // - distance between two pixels at highly slanted surface (e.g. alpha = 85 degree) is: B = A /
+        // cos(alpha)
+        // - skip_interpolation_ratio ~= sin(theta) / cos(alpha)
+        // We use B as the threshold that to skip interpolation if the depth difference in the triangle is
+        // larger than B. This is a conservative threshold to estimate largest distance on a highly slanted
+        // surface at given depth, in reality, given distortion, distance, resolution difference, B can be
+        // smaller
+        float depth_min = (float)min(min(neighbors[0], neighbors[1]), min(neighbors[2], neighbors[3]));
+        float depth_max = (float)max(max(neighbors[0], neighbors[1]), max(neighbors[2], neighbors[3]));
+        float depth_delta = depth_max - depth_min;
+        float skip_interpolation_threshold = skip_interpolation_ratio * depth_min;
+        if (depth_delta > skip_interpolation_threshold)
+        {
+            return 0;
         }
     }
+
+    // Fixed point weighted sum, rounded to nearest. Fits in 32 bits since the weights sum to 1 << LUT_WEIGHT_BITS
+    const uint32_t sum = neighbors[0] * lut->weight[0][i] + neighbors[1] * lut->weight[1][i] +
+        neighbors[2] * lut->weight[2][i] + neighbors[3] * lut->weight[3][i] +
+        (1u << (LUT_WEIGHT_BITS - 1));
+
+    return (uint16_t)(sum >> LUT_WEIGHT_BITS);
 }
 
-void remap(const k4a_image_t src, const k4a_image_t lut, k4a_image_t dst, interpolation_t type)
+#if KINFU_SIMD_X86
+
+// Bilinear remap of 8 pixels at a time from a multiple of 8, returning how many pixels were written.
+// Computes exactly what remap_pixel does, so it can be mixed freely with the scalar tail.
+template <bool depth_checks>
+KINFU_TARGET_AVX2
+static int remap_bilinear_avx2(const uint16_t* src_data,
+    int src_width,
+    const undistortion_lut_t* lut,
+    uint16_t* dst_data,
+    int begin,
+    int end)
 {
-    int src_width = k4a_image_get_width_pixels(src);
-    int dst_width = k4a_image_get_width_pixels(dst);
-    int dst_height = k4a_image_get_height_pixels(dst);
+    const __m256i lane_bits = _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+    const __m256i low_half = _mm256_set1_epi32(0xFFFF);
+    const __m256i width = _mm256_set1_epi32(src_width);
+    const __m256i round = _mm256_set1_epi32(1 << (LUT_WEIGHT_BITS - 1));
+    const __m256 ratio = _mm256_set1_ps(skip_interpolation_ratio);
+    const uint8_t* valid_bytes = reinterpret_cast<const uint8_t*>(lut->valid);
+    const int* src_words = reinterpret_cast<const int*>(src_data);
+
+    int i = begin;
+    for (; i + 8 <= end; i += 8)
+    {
+        const int valid_bits = valid_bytes[i >> 3];
+        if (valid_bits == 0)
+        {
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst_data + i), _mm_setzero_si128());
+            continue;
+        }
 
-    uint16_t* src_data = (uint16_t*)(void*)k4a_image_get_buffer(src);
-    uint16_t* dst_data = (uint16_t*)(void*)k4a_image_get_buffer(dst);
-    coordinate_t* lut_data = (coordinate_t*)(void*)k4a_image_get_buffer(lut);
+        __m256i keep = _mm256_cmpeq_epi32(_mm256_and_si256(_mm256_set1_epi32(valid_bits), lane_bits), lane_bits);
 
-    memset(dst_data, 0, (size_t)dst_width * (size_t)dst_height * sizeof(uint16_t));
+        // Invalid entries have offset 0, so every gather stays inside the source image.
+        // A 32-bit gather at a 16-bit pixel index picks up the pixel and its right-hand neighbor
+        __m256i top = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(lut->offset + i));
+        __m256i top_pair = _mm256_i32gather_epi32(src_words, top, 2);
+        __m256i bottom_pair = _mm256_i32gather_epi32(src_words, _mm256_add_epi32(top, width), 2);
 
-    for (int i = 0; i < dst_width * dst_height; i++)
+        __m256i n0 = _mm256_and_si256(top_pair, low_half);
+        __m256i n1 = _mm256_srli_epi32(top_pair, 16);
+        __m256i n2 = _mm256_and_si256(bottom_pair, low_half);
+        __m256i n3 = _mm256_srli_epi32(bottom_pair, 16);
+
+        if (depth_checks)
+        {
+            // Any zero neighbor makes the minimum zero
+            __m256i depth_min = _mm256_min_epu32(_mm256_min_epu32(n0, n1), _mm256_min_epu32(n2, n3));
+            __m256i depth_max = _mm256_max_epu32(_mm256_max_epu32(n0, n1), _mm256_max_epu32(n2, n3));
+            __m256 depth_delta = _mm256_cvtepi32_ps(_mm256_sub_epi32(depth_max, depth_min));
+            __m256 threshold = _mm256_mul_ps(ratio, _mm256_cvtepi32_ps(depth_min));
+
+            keep = _mm256_andnot_si256(_mm256_cmpeq_epi32(depth_min, _mm256_setzero_si256()), keep);
+            keep = _mm256_and_si256(keep, _mm256_castps_si256(_mm256_cmp_ps(depth_delta, threshold, _CMP_LE_OQ)));
+        }
+
+        __m256i w0 = _mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(lut->weight[0] + i)));
+        __m256i w1 = _mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(lut->weight[1] + i)));
+        __m256i w2 = _mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(lut->weight[2] + i)));
+        __m256i w3 = _mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(lut->weight[3] + i)));
+
+        __m256i sum = _mm256_add_epi32(_mm256_mullo_epi32(n0, w0), _mm256_mullo_epi32(n1, w1));
+        sum = _mm256_add_epi32(sum, _mm256_mullo_epi32(n2, w2));
+        sum = _mm256_add_epi32(sum, _mm256_mullo_epi32(n3, w3));
+        sum = _mm256_srli_epi32(_mm256_add_epi32(sum, round), LUT_WEIGHT_BITS);
+
+        __m256i result = _mm256_and_si256(sum, keep);
+        __m128i packed = _mm_packus_epi32(_mm256_castsi256_si128(result), _mm256_extracti128_si256(result, 1));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst_data + i), packed);
+    }
+
+    return i;
+}
+
+#endif
+
+// Remap destination pixels [begin, end)
+template <interpolation_t type>
+static void remap_range(const uint16_t* src_data,
+    int src_width,
+    const undistortion_lut_t* lut,
+    uint16_t* dst_data,
+    int begin,
+    int end)
+{
+    int i = begin;
+
+#if KINFU_SIMD_X86
+    if (type != INTERPOLATION_NEARESTNEIGHBOR && get_simd_level() == SIMD_AVX2)
     {
-        if (lut_data[i].x != INVALID && lut_data[i].y != INVALID)
+        // Scalar up to a whole byte of the valid mask, then 8 pixels at a time
+        for (; i < end && (i & 7) != 0; i++)
         {
-            if (type == INTERPOLATION_NEARESTNEIGHBOR)
+            dst_data[i] = remap_pixel<type>(src_data, src_width, lut, i);
+        }
+
+        i = remap_bilinear_avx2<type == INTERPOLATION_BILINEAR_DEPTH>(src_data, src_width, lut, dst_data, i, end);
+    }
+#endif
+
+    for (; i < end; i++)
+    {
+        dst_data[i] = remap_pixel<type>(src_data, src_width, lut, i);
+    }
+}
+
+void remap(const k4a_image_t src, const undistortion_lut_t* lut, uint16_t* dst_data)
+{
+    const int src_width = k4a_image_get_width_pixels(src);
+    const int dst_width = lut->width;
+    const int dst_height = lut->height;
+
+    const uint16_t* src_data = (const uint16_t*)(void*)k4a_image_get_buffer(src);
+
+    // Pick the kernel once, outside the pixel loop
+    void (*remap_kernel)(const uint16_t*, int, const undistortion_lut_t*, uint16_t*, int, int) = nullptr;
+    switch (lut->type)
+    {
+    case INTERPOLATION_NEARESTNEIGHBOR:
+        remap_kernel = remap_range<INTERPOLATION_NEARESTNEIGHBOR>;
+        break;
+    case INTERPOLATION_BILINEAR:
+        remap_kernel = remap_range<INTERPOLATION_BILINEAR>;
+        break;
+    case INTERPOLATION_BILINEAR_DEPTH:
+        remap_kernel = remap_range<INTERPOLATION_BILINEAR_DEPTH>;
+        break;
+    default:
+        printf("Unexpected interpolation type!\n");
+        exit(-1);
+    }
+
+    // Every destination pixel is written, so bands of rows can run independently
+    parallel_for_(Range(0, dst_height), [&](const Range& rows) {
+        remap_kernel(src_data, src_width, lut, dst_data, rows.start * dst_width, rows.end * dst_width);
+    });
+}
+
+void remap_color(const uint8_t* src_bgra, const undistortion_lut_t* lut, uint8_t* dst_bgr)
+{
+    const int src_width = lut->src_width;
+    const int dst_width = lut->width;
+    const bool bilinear = lut->type != INTERPOLATION_NEARESTNEIGHBOR;
+
+    parallel_for_(Range(0, lut->height), [&](const Range& rows) {
+        for (int i = rows.start * dst_width; i < rows.end * dst_width; i++)
+        {
+            uint8_t* dst = dst_bgr + (size_t)i * 3;
+            if ((lut->valid[i >> 5] & (1u << (i & 31))) == 0)
             {
-                dst_data[i] = src_data[lut_data[i].y * src_width + lut_data[i].x];
+                dst[0] = dst[1] = dst[2] = 0;
+                continue;
             }
-            else if (type == INTERPOLATION_BILINEAR || type == INTERPOLATION_BILINEAR_DEPTH)
+
+            // A bilinear LUT points at the top-left neighbor, the heaviest one is the nearest
+            uint32_t offset = lut->offset[i];
+            if (bilinear)
             {
-                const uint16_t neighbors[4]{ src_data[lut_data[i].y * src_width + lut_data[i].x],
-                                             src_data[lut_data[i].y * src_width + lut_data[i].x + 1],
-                                             src_data[(lut_data[i].y + 1) * src_width + lut_data[i].x],
-                                             src_data[(lut_data[i].y + 1) * src_width + lut_data[i].x + 1] };
-
-                // If the image contains invalid data, e.g. depth image contains value 0, ignore the bilinear
-                // interpolation for current target pixel if one of the neighbors contains invalid data to avoid
-                // introduce noise on the edge. If the image is color or ir images, user should use
-                // INTERPOLATION_BILINEAR
-                if (type == INTERPOLATION_BILINEAR_DEPTH)
+                const uint32_t neighbors[4] = { 0, 1, (uint32_t)src_width, (uint32_t)src_width + 1 };
+                int nearest = 0;
+                for (int k = 1; k < 4; k++)
                 {
-                    // If the image contains invalid data, e.g. depth image contains value 0, ignore the bilinear
-                    // interpolation for current target pixel if one of the neighbors contains invalid data to avoid
-                    // introduce noise on the edge. If the image is color or ir images, user should use
-                    // INTERPOLATION_BILINEAR
-                    if (neighbors[0] == 0 || neighbors[1] == 0 || neighbors[2] == 0 || neighbors[3] == 0)
-                    {
-                        continue;
-                    }
-
-                    // Ignore interpolation at large depth discontinuity without disrupting slanted surface
-                    // Skip interpolation threshold is estimated based on the following logic:
-                    // - angle between two pixels is: theta = 0.234375 degree (120 degree / 512) in binning resolution
-                    // mode
-                    // - distance between two pixels at same depth approximately is: A ~= sin(theta) * depth
-                    // - distance between two pixels at highly slanted surface (e.g. alpha = 85 degree) is: B = A /
-                    // cos(alpha)
-                    // - skip_interpolation_ratio ~= sin(theta) / cos(alpha)
-                    // We use B as the threshold that to skip interpolation if the depth difference in the triangle is
-                    // larger than B. This is a conservative threshold to estimate largest distance on a highly slanted
-                    // surface at given depth, in reality, given distortion, distance, resolution difference, B can be
-                    // smaller
-                    const float skip_interpolation_ratio = 0.04693441759f;
-                    float depth_min = min(min(neighbors[0], neighbors[1]), min(neighbors[2], neighbors[3]));
-                    float depth_max = max(max(neighbors[0], neighbors[1]), max(neighbors[2], neighbors[3]));
-                    float depth_delta = depth_max - depth_min;
-                    float skip_interpolation_threshold = skip_interpolation_ratio * depth_min;
-                    if (depth_delta > skip_interpolation_threshold)
-                    {
-                        continue;
-                    }
+                    if (lut->weight[k][i] > lut->weight[nearest][i])
+                        nearest = k;
                 }
-
-                dst_data[i] = (uint16_t)(neighbors[0] * lut_data[i].weight[0] + neighbors[1] * lut_data[i].weight[1] +
-                    neighbors[2] * lut_data[i].weight[2] + neighbors[3] * lut_data[i].weight[3] +
-                    0.5f);
-            }
-            else
-            {
-                printf("Unexpected interpolation type!\n");
-                exit(-1);
+                offset += neighbors[nearest];
             }
+
+            const uint8_t* src = src_bgra + (size_t)offset * 4;
+            dst[0] = src[0];
+            dst[1] = src[1];
+            dst[2] = src[2];
         }
+    });
+}
+
+int create_frame_pool(frame_pool_t& pool, const pinhole_t& pinhole)
+{
+    int allocations = 0;
+
+    if (pool.undistorted_depth.rows != pinhole.height ||
+        pool.undistorted_depth.cols != pinhole.width ||
+        pool.undistorted_depth.type() != CV_16UC1)
+    {
+        pool.undistorted_depth.create(pinhole.height, pinhole.width, CV_16UC1);
+        allocations++;
     }
-}
\ No newline at end of file
+
+    return allocations;
+}
+
+int create_color_frame_pool(frame_pool_t& pool, const pinhole_t& pinhole, int depth_width, int depth_height)
+{
+    int allocations = 0;
+
+    if (pool.registered_color.rows != depth_height || pool.registered_color.cols != depth_width ||
+        pool.registered_color.type() != CV_8UC4)
+    {
+        pool.registered_color.create(depth_height, depth_width, CV_8UC4);
+        allocations++;
+    }
+
+    if (pool.undistorted_color.rows != pinhole.height || pool.undistorted_color.cols != pinhole.width ||
+        pool.undistorted_color.type() != CV_8UC3)
+    {
+        pool.undistorted_color.create(pinhole.height, pinhole.width, CV_8UC3);
+        allocations++;
+    }
+
+    return allocations;
+}
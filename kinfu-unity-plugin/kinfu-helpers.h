@@ -3,6 +3,9 @@
 #include <k4a/k4a.h>
 #include <opencv2/rgbd.hpp>
 
+#include <memory>
+#include <vector>
+
 using namespace cv;
 
 ////
@@ -31,6 +34,9 @@ typedef struct _coordinate_t
     float weight[4];
 } coordinate_t;
 
+// Fixed point precision of the compact LUT weights (Q15, so the four weights sum to 32768)
+#define LUT_WEIGHT_BITS 15
+
 typedef enum
 {
     INTERPOLATION_NEARESTNEIGHBOR, /**< Nearest neighbor interpolation */
@@ -39,6 +45,25 @@ typedef enum
                                                 data with value 0 */
 } interpolation_t;
 
+// Compact undistortion LUT, stored as separate arrays so remap streams as few bytes as possible.
+// About 12 bytes per pixel for bilinear (4 for nearest neighbor) against 24 for coordinate_t.
+// The arrays point into `storage`, or into memory kept alive by `mapping` (e.g. a mapped cache file),
+// so a LUT built into `storage` must not be copied.
+typedef struct _undistortion_lut_t
+{
+    int width;     /**< Destination (pinhole) size */
+    int height;
+    int src_width; /**< Row length of the source image the offsets index into */
+    interpolation_t type;
+
+    uint32_t* offset;    /**< y * src_width + x of the (top-left) source pixel, 0 when invalid */
+    uint32_t* valid;     /**< Bitmask, bit i is set when destination pixel i has a valid source */
+    uint16_t* weight[4]; /**< Bilinear weights in LUT_WEIGHT_BITS fixed point, NULL for nearest neighbor */
+
+    std::vector<uint8_t> storage;  /**< Backing memory for the arrays above when owned by the LUT */
+    std::shared_ptr<void> mapping; /**< Keeps read-only backing memory owned elsewhere alive */
+} undistortion_lut_t;
+
 void initialize_kinfu_params(kinfu::Params& params,
     const int width,
     const int height,
@@ -62,11 +87,58 @@ void compute_xy_range(const k4a_calibration_t* calibration,
 
 pinhole_t create_pinhole_from_xy_range(const k4a_calibration_t* calibration, const k4a_calibration_type_t camera);
 
+// Allocate an empty (all invalid) LUT of width x height entries
+void allocate_undistortion_lut(undistortion_lut_t* lut, int width, int height, int src_width, interpolation_t type);
+
+// Bytes needed for the arrays of a width x height LUT, laid out from a 64 byte aligned base
+size_t undistortion_lut_data_size(int width, int height, interpolation_t type);
+
+// Point the LUT arrays at undistortion_lut_data_size bytes of memory at base, which must be 64 byte aligned
+void bind_undistortion_lut(undistortion_lut_t* lut, uint8_t* base, int width, int height, int src_width, interpolation_t type);
+
+// Free the LUT memory, whether owned or mapped
+void release_undistortion_lut(undistortion_lut_t* lut);
+
+// Bytes remap reads from the LUT for one frame
+size_t undistortion_lut_size(const undistortion_lut_t* lut);
+
+// Store one LUT entry from its source pixel and floating point bilinear weights
+void set_undistortion_lut_entry(undistortion_lut_t* lut, int idx, int x, int y, const float weight[4]);
+
+// Build the LUT for a pinhole model, computing rows in parallel
 void create_undistortion_lut(const k4a_calibration_t* calibration,
     const k4a_calibration_type_t camera,
     const pinhole_t* pinhole,
-    k4a_image_t lut,
+    undistortion_lut_t* lut,
     interpolation_t type);
 
-void remap(const k4a_image_t src, const k4a_image_t lut, k4a_image_t dst, interpolation_t type);
+void remap(const k4a_image_t src, const undistortion_lut_t* lut, k4a_image_t dst);
+
+// Remap into a caller-owned, tightly packed lut->width x lut->height buffer
+void remap(const k4a_image_t src, const undistortion_lut_t* lut, uint16_t* dst_data);
+
+// Remap a BGRA32 image laid out like the LUT's source (e.g. color registered to the depth camera) into a
+// tightly packed BGR buffer. Takes the nearest source pixel, so colors never blend across depth edges
+void remap_color(const uint8_t* src_bgra, const undistortion_lut_t* lut, uint8_t* dst_bgr);
+
+////
+//
+// Per-frame buffer pool
+//
+////
+
+// Buffers reused by every frame of the depth path, sized once from the pinhole model
+typedef struct _frame_pool_t
+{
+    UMat undistorted_depth; /**< Remap output, handed straight to kf->update */
+    Mat registered_color;   /**< BGRA32 color registered to the raw depth image, colored volumes only */
+    Mat undistorted_color;  /**< Registered color remapped like the depth (BGR), handed to kf->update with it */
+} frame_pool_t;
+
+// (Re)size the pool for a pinhole model, returning how many buffers had to be allocated.
+// Returns 0 when the pool already matches, so it is safe to call on every frame.
+int create_frame_pool(frame_pool_t& pool, const pinhole_t& pinhole);
 
+// (Re)size the color buffers of the pool for a colored volume, depth_width x depth_height being the raw
+// depth image color is registered to. Returns how many buffers had to be allocated, as create_frame_pool
+int create_color_frame_pool(frame_pool_t& pool, const pinhole_t& pinhole, int depth_width, int depth_height);
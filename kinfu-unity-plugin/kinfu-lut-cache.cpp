@@ -0,0 +1,214 @@
+#include "pch.h"
+#include "framework.h"
+#include "kinfu-lut-cache.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Bump whenever the file layout or the LUT array layout changes
+#define LUT_CACHE_VERSION 1
+
+// The LUT arrays start here so they keep the 64 byte alignment of the (page aligned) mapping
+#define LUT_CACHE_DATA_OFFSET 128
+
+typedef struct _lut_cache_header_t
+{
+    char magic[8];        /**< "KFLUTC" */
+    uint32_t version;     /**< LUT_CACHE_VERSION */
+    uint32_t weight_bits; /**< LUT_WEIGHT_BITS the weights were stored with */
+    uint64_t key;         /**< hash_undistortion_lut_key of the calibration it was built from */
+    uint64_t data_size;   /**< Bytes of LUT arrays following the header at LUT_CACHE_DATA_OFFSET */
+
+    pinhole_t pinhole;
+
+    int32_t width;
+    int32_t height;
+    int32_t src_width;
+    int32_t type;
+} lut_cache_header_t;
+
+static const char lut_cache_magic[8] = "KFLUTC";
+
+// FNV-1a, good enough to tell calibrations apart and stable across runs
+static uint64_t fnv1a(uint64_t hash, const void* data, size_t size)
+{
+    const uint8_t* bytes = (const uint8_t*)data;
+    for (size_t i = 0; i < size; i++)
+    {
+        hash ^= bytes[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+uint64_t hash_undistortion_lut_key(const k4a_calibration_t* calibration,
+    const k4a_calibration_type_t camera,
+    interpolation_t type)
+{
+    const int32_t params[4] = { LUT_CACHE_VERSION, LUT_WEIGHT_BITS, (int32_t)camera, (int32_t)type };
+
+    uint64_t hash = 14695981039346656037ull;
+    hash = fnv1a(hash, calibration, sizeof(*calibration));
+    hash = fnv1a(hash, params, sizeof(params));
+    return hash;
+}
+
+std::string get_undistortion_lut_cache_path(uint64_t key)
+{
+    std::string dir;
+
+#ifdef _WIN32
+    char temp[MAX_PATH + 1];
+    const DWORD length = GetTempPathA(sizeof(temp), temp);
+    if (length > 0 && length < sizeof(temp))
+        dir = temp;
+#else
+    const char* temp = getenv("TMPDIR");
+    dir = temp != NULL ? temp : "/tmp";
+    if (!dir.empty() && dir.back() != '/')
+        dir += '/';
+#endif
+
+    char name[64];
+    snprintf(name, sizeof(name), "kinfu-lut-%016llx.bin", (unsigned long long)key);
+    return dir + name;
+}
+
+// Map a whole file read-only, returning the view wrapped so it is unmapped with its last owner
+static std::shared_ptr<void> map_file(const char* path, size_t* size)
+{
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+        return nullptr;
+
+    LARGE_INTEGER file_size;
+    if (!GetFileSizeEx(file, &file_size) || file_size.QuadPart == 0)
+    {
+        CloseHandle(file);
+        return nullptr;
+    }
+
+    // The view keeps the file mapped after both handles are closed
+    HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    CloseHandle(file);
+    if (mapping == NULL)
+        return nullptr;
+
+    void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(mapping);
+    if (view == NULL)
+        return nullptr;
+
+    *size = (size_t)file_size.QuadPart;
+    return std::shared_ptr<void>(view, [](void* p) { UnmapViewOfFile(p); });
+#else
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return nullptr;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0)
+    {
+        close(fd);
+        return nullptr;
+    }
+
+    const size_t length = (size_t)st.st_size;
+    void* view = mmap(NULL, length, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (view == MAP_FAILED)
+        return nullptr;
+
+    *size = length;
+    return std::shared_ptr<void>(view, [length](void* p) { munmap(p, length); });
+#endif
+}
+
+bool load_undistortion_lut_cache(const char* path, uint64_t key, pinhole_t* pinhole, undistortion_lut_t* lut)
+{
+    size_t size = 0;
+    std::shared_ptr<void> view = map_file(path, &size);
+    if (view == nullptr || size < LUT_CACHE_DATA_OFFSET)
+        return false;
+
+    const lut_cache_header_t* header = (const lut_cache_header_t*)view.get();
+    if (memcmp(header->magic, lut_cache_magic, sizeof(lut_cache_magic)) != 0 ||
+        header->version != LUT_CACHE_VERSION ||
+        header->weight_bits != LUT_WEIGHT_BITS ||
+        header->key != key)
+    {
+        return false;
+    }
+
+    const interpolation_t type = (interpolation_t)header->type;
+    if (header->type < INTERPOLATION_NEARESTNEIGHBOR || header->type > INTERPOLATION_BILINEAR_DEPTH ||
+        header->width <= 0 || header->height <= 0 || header->src_width <= 0 ||
+        header->pinhole.width != header->width || header->pinhole.height != header->height ||
+        header->data_size != undistortion_lut_data_size(header->width, header->height, type) ||
+        size < LUT_CACHE_DATA_OFFSET + header->data_size)
+    {
+        return false;
+    }
+
+    *pinhole = header->pinhole;
+
+    // Remap only ever reads the arrays, so pointing them into the read-only view is safe
+    release_undistortion_lut(lut);
+    uint8_t* base = (uint8_t*)view.get() + LUT_CACHE_DATA_OFFSET;
+    bind_undistortion_lut(lut, base, header->width, header->height, header->src_width, type);
+    lut->mapping = view;
+
+    return true;
+}
+
+bool save_undistortion_lut_cache(const char* path, uint64_t key, const pinhole_t* pinhole, const undistortion_lut_t* lut)
+{
+    static_assert(sizeof(lut_cache_header_t) <= LUT_CACHE_DATA_OFFSET, "LUT cache header overlaps the data");
+
+    uint8_t header_block[LUT_CACHE_DATA_OFFSET] = {};
+    lut_cache_header_t* header = (lut_cache_header_t*)header_block;
+    memcpy(header->magic, lut_cache_magic, sizeof(lut_cache_magic));
+    header->version = LUT_CACHE_VERSION;
+    header->weight_bits = LUT_WEIGHT_BITS;
+    header->key = key;
+    header->data_size = undistortion_lut_data_size(lut->width, lut->height, lut->type);
+    header->pinhole = *pinhole;
+    header->width = lut->width;
+    header->height = lut->height;
+    header->src_width = lut->src_width;
+    header->type = (int32_t)lut->type;
+
+    // Write next to the target and swap it in, so a reader never maps a half written file
+    const std::string temp_path = std::string(path) + ".tmp";
+    FILE* file = fopen(temp_path.c_str(), "wb");
+    if (file == NULL)
+        return false;
+
+    // The arrays are laid out contiguously from offset, see bind_undistortion_lut
+    bool ok = fwrite(header_block, 1, sizeof(header_block), file) == sizeof(header_block) &&
+        fwrite(lut->offset, 1, (size_t)header->data_size, file) == (size_t)header->data_size;
+    ok = fclose(file) == 0 && ok;
+
+    if (ok)
+    {
+#ifdef _WIN32
+        ok = MoveFileExA(temp_path.c_str(), path, MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+        ok = rename(temp_path.c_str(), path) == 0;
+#endif
+    }
+
+    if (!ok)
+        remove(temp_path.c_str());
+
+    return ok;
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include "kinfu-helpers.h"
+
+#include <string>
+
+////
+//
+// On-disk cache of the pinhole model and undistortion LUT
+//
+// Building the LUT projects every destination pixel through the lens model,
+// which is a noticeable cost on every start. The result only depends on the
+// calibration and interpolation type, so it is written to a file keyed by a
+// hash of those and memory mapped straight into the LUT on later starts.
+//
+////
+
+// Key identifying a LUT built for this calibration (which includes the depth mode), camera and interpolation type
+uint64_t hash_undistortion_lut_key(const k4a_calibration_t* calibration,
+    const k4a_calibration_type_t camera,
+    interpolation_t type);
+
+// Cache file for a key, in the user's temp directory
+std::string get_undistortion_lut_cache_path(uint64_t key);
+
+// Map a cache file into the LUT, returning false if it is missing, stale or corrupt.
+// The LUT arrays then point into the read-only mapping, which the LUT keeps alive.
+bool load_undistortion_lut_cache(const char* path, uint64_t key, pinhole_t* pinhole, undistortion_lut_t* lut);
+
+// Write the pinhole model and LUT to a cache file, replacing any existing one
+bool save_undistortion_lut_cache(const char* path, uint64_t key, const pinhole_t* pinhole, const undistortion_lut_t* lut);
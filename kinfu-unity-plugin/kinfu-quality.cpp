@@ -0,0 +1,195 @@
+#include "pch.h"
+#include "framework.h"
+#include "kinfu-quality.h"
+
+#include <string.h>
+
+// Weight of the newest frame in the smoothed fusion time
+#define QUALITY_SMOOTHING 0.2f
+
+typedef struct _quality_level_t
+{
+    int icp_iterations[4];       /**< Finest pyramid level first */
+    int pyramid_levels;          /**< Entries of icp_iterations in use */
+    int bilateral_kernel_size;
+    float raycast_step_factor;
+    float min_camera_movement;
+    int frame_stride;
+} quality_level_t;
+
+// Level 0 is KinFu's defaultParams, level 2 its coarseParams tracking. Only the
+// last level skips frames, so tracking keeps every frame for as long as it can
+static const quality_level_t quality_levels[QUALITY_LEVEL_COUNT] = {
+    { { 10, 5, 4, 0 }, 3, 7, 0.25f, 0.f, 1 },
+    { { 7, 4, 3, 0 }, 3, 5, 0.5f, 0.f, 1 },
+    { { 5, 3, 2, 0 }, 3, 5, 0.75f, 0.005f, 1 },
+    { { 4, 2, 0, 0 }, 2, 3, 0.75f, 0.01f, 1 },
+    { { 4, 2, 0, 0 }, 2, 3, 0.75f, 0.01f, 2 },
+};
+
+void get_quality_level(int level, kinfu_quality_state_t& state)
+{
+    const quality_level_t& knobs = quality_levels[level];
+    memcpy(state.icp_iterations, knobs.icp_iterations, sizeof(state.icp_iterations));
+    state.pyramid_levels = knobs.pyramid_levels;
+    state.bilateral_kernel_size = knobs.bilateral_kernel_size;
+    state.raycast_step_factor = knobs.raycast_step_factor;
+    state.min_camera_movement = knobs.min_camera_movement;
+    state.frame_stride = knobs.frame_stride;
+}
+
+bool same_creation_knobs(int a, int b)
+{
+    const quality_level_t& knobsA = quality_levels[a];
+    const quality_level_t& knobsB = quality_levels[b];
+    return memcmp(knobsA.icp_iterations, knobsB.icp_iterations, sizeof(knobsA.icp_iterations)) == 0 &&
+           knobsA.pyramid_levels == knobsB.pyramid_levels &&
+           knobsA.bilateral_kernel_size == knobsB.bilateral_kernel_size &&
+           knobsA.raycast_step_factor == knobsB.raycast_step_factor &&
+           knobsA.min_camera_movement == knobsB.min_camera_movement;
+}
+
+bool valid_quality_policy(const kinfu_quality_policy_t& policy, const char** error)
+{
+    const char* reason = NULL;
+    if (!(policy.target_ms >= 0.f && policy.target_ms <= 1000.f))
+        reason = "target must be 0 to 1000 ms";
+    else if (!(policy.raise_fraction >= 0.3f && policy.raise_fraction <= 0.95f))
+        reason = "raise fraction must be 0.3 to 0.95";
+    else if (policy.lower_frames < 1 || policy.raise_frames < 1)
+        reason = "lower and raise frames must be at least 1";
+
+    if (error != NULL)
+        *error = reason;
+    return reason == NULL;
+}
+
+QualityController::QualityController()
+    : policy(), current(0), created(0), smoothed(0.f), frames(0), over(0), under(0), wait(0)
+{
+}
+
+float QualityController::frameMs() const
+{
+    return smoothed / quality_levels[current].frame_stride;
+}
+
+// Whether two levels run alike right now. Without rebuild KinFu keeps the knobs it was
+// created with, so only the frame stride tells levels apart
+bool QualityController::sameEffect(int a, int b) const
+{
+    if (quality_levels[a].frame_stride != quality_levels[b].frame_stride)
+        return false;
+
+    return !policy.rebuild || same_creation_knobs(a, b);
+}
+
+// The first coarser level that changes what runs, or -1
+int QualityController::lowerLevel() const
+{
+    for (int level = current + 1; level < QUALITY_LEVEL_COUNT; level++)
+    {
+        if (!sameEffect(level, current))
+            return level;
+    }
+
+    return -1;
+}
+
+// The first finer level that changes what runs, then on to the finest level running like it,
+// so the next KinFu created gets the best knobs that fit. Level 0 if no finer level changes
+// anything, -1 at level 0
+int QualityController::raiseLevel() const
+{
+    int level = current - 1;
+    while (level > 0 && sameEffect(level, current))
+        level--;
+
+    while (level > 0 && sameEffect(level - 1, level))
+        level--;
+
+    return level;
+}
+
+void QualityController::restart()
+{
+    smoothed = 0.f;
+    frames = 0;
+    over = 0;
+    under = 0;
+    wait = 0;
+}
+
+void QualityController::moveTo(int level, kinfu_quality_event_t& event)
+{
+    event.frame = frames;
+    event.frame_ms = frameMs();
+    event.target_ms = policy.target_ms;
+    event.from_level = current;
+    event.to_level = level;
+    event.applied = 0;
+
+    current = level;
+    over = 0;
+    under = 0;
+
+    // Let the smoothed time settle at the new level before judging it
+    wait = policy.lower_frames;
+}
+
+bool QualityController::observe(float frame_ms, kinfu_quality_event_t& event)
+{
+    smoothed = frames == 0 ? frame_ms : smoothed + QUALITY_SMOOTHING * (frame_ms - smoothed);
+    frames++;
+
+    if (policy.target_ms <= 0.f)
+    {
+        if (current == 0)
+            return false;
+
+        moveTo(0, event);
+        return true;
+    }
+
+    if (wait > 0)
+    {
+        wait--;
+        return false;
+    }
+
+    // Skipped frames cost nothing, so the budget is held per captured frame. Going up is judged
+    // at the stride of the level it would go to, so dropping the stride does not go straight over.
+    // Between the two thresholds both runs start again, that gap is the hysteresis
+    const int lower = lowerLevel();
+    const int raise = raiseLevel();
+    const float raiseMs = raise >= 0 ? smoothed / quality_levels[raise].frame_stride : 0.f;
+    if (frameMs() > policy.target_ms)
+    {
+        over++;
+        under = 0;
+    }
+    else if (raise >= 0 && raiseMs < policy.target_ms * policy.raise_fraction)
+    {
+        under++;
+        over = 0;
+    }
+    else
+    {
+        over = 0;
+        under = 0;
+    }
+
+    if (over >= policy.lower_frames && lower >= 0)
+    {
+        moveTo(lower, event);
+        return true;
+    }
+
+    if (under >= policy.raise_frames && raise >= 0)
+    {
+        moveTo(raise, event);
+        return true;
+    }
+
+    return false;
+}
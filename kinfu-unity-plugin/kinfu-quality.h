@@ -0,0 +1,73 @@
+#pragma once
+
+#include "kinfu-unity.h"
+
+#include <stdint.h>
+
+////
+//
+// Adaptive quality
+//
+// A ladder of tracking and fusion settings from KinFu's defaults down to coarse
+// tracking that fuses one frame in two, and a controller that walks it to hold a
+// frame time budget per captured frame. The smoothed time has to stay over the budget
+// (or under the raise threshold) for a run of frames before the level moves, and each
+// move is followed by a wait, so the level does not flap around the budget.
+//
+// KinFu only takes the tracking knobs when it is created. Without rebuild the controller
+// skips levels that would change nothing until the next reset, so it moves on the frame
+// stride alone.
+//
+////
+
+// Levels in the ladder, 0 being KinFu's defaults
+#define QUALITY_LEVEL_COUNT 5
+
+// Fill the knobs of a ladder level into state, leaving level, created_level and frame_ms alone
+void get_quality_level(int level, kinfu_quality_state_t& state);
+
+// Whether two levels create KinFu alike, so moving between them only changes the frame stride
+bool same_creation_knobs(int a, int b);
+
+// Whether a policy is in the ranges setQualityPolicy accepts
+bool valid_quality_policy(const kinfu_quality_policy_t& policy, const char** error);
+
+class QualityController
+{
+public:
+    QualityController();
+
+    void setPolicy(const kinfu_quality_policy_t& policy) { this->policy = policy; }
+    const kinfu_quality_policy_t& getPolicy() const { return policy; }
+
+    int level() const { return current; }
+
+    // Level the running KinFu was created with, whose tracking knobs stay until it is created again
+    int createdLevel() const { return created; }
+    void setCreatedLevel(int level) { created = level; }
+
+    // Smoothed time per captured frame, a fused frame's time spread over the frame stride
+    float frameMs() const;
+
+    // Take one fused frame's time. Returns true if the level changed, describing the change in event.
+    // With the controller off, a raised level drops straight back to 0
+    bool observe(float frame_ms, kinfu_quality_event_t& event);
+
+    // Forget the frame times seen so far, keeping the level, for a new KinFu
+    void restart();
+
+private:
+    bool sameEffect(int a, int b) const;
+    int lowerLevel() const;
+    int raiseLevel() const;
+    void moveTo(int level, kinfu_quality_event_t& event);
+
+    kinfu_quality_policy_t policy;
+    int current;
+    int created;
+    float smoothed;
+    uint64_t frames;
+    int over;
+    int under;
+    int wait;
+};
@@ -0,0 +1,543 @@
+#include "pch.h"
+#include "framework.h"
+#include "kinfu-quantize.h"
+
+#include <algorithm>
+#include <cmath>
+#include <mutex>
+#include <opencv2/core/utility.hpp>
+#include <string.h>
+
+// Points per parallel stripe
+#define QUANTIZE_STRIPE 65536
+
+#define QUANTIZE_MAX 65535.f
+
+size_t quantized_cloud_size(int count, int flags)
+{
+    size_t per_point = 3 * sizeof(uint16_t);
+    if (flags & KINFU_QUANTIZED_NORMALS)
+        per_point += sizeof(uint16_t);
+    if (flags & KINFU_QUANTIZED_COLORS)
+        per_point += sizeof(uint16_t);
+
+    return per_point * (size_t)std::max(count, 0);
+}
+
+void set_quantized_bounds(const float min[3], const float max[3], kinfu_quantized_cloud_t* header)
+{
+    for (int c = 0; c < 3; c++)
+    {
+        // Keep a usable step even for a flat box
+        const float extent = std::max(max[c] - min[c], 1e-6f);
+        header->origin[c] = min[c];
+        header->scale[c] = extent / QUANTIZE_MAX;
+    }
+}
+
+// Errors found by one stripe, merged into the header when it finishes
+typedef struct _quantize_error_t
+{
+    float max_position_error2; /**< Squared, in metres */
+    float min_normal_dot;      /**< Cosine of the largest normal error */
+} quantize_error_t;
+
+////
+//
+// Scalar kernels
+//
+////
+
+static float sign_not_zero(float v)
+{
+    return v < 0.f ? -1.f : 1.f;
+}
+
+static void encode_positions_scalar(const float* points, uint16_t* dst, int count,
+    const kinfu_quantized_cloud_t& header, quantize_error_t& error)
+{
+    for (int i = 0; i < count; i++, points += 4, dst += 3)
+    {
+        float error2 = 0.f;
+        for (int c = 0; c < 3; c++)
+        {
+            const float q = std::min(std::max((points[c] - header.origin[c]) / header.scale[c], 0.f), QUANTIZE_MAX);
+            dst[c] = (uint16_t)(q + 0.5f);
+
+            const float d = header.origin[c] + dst[c] * header.scale[c] - points[c];
+            error2 += d * d;
+        }
+
+        error.max_position_error2 = std::max(error.max_position_error2, error2);
+    }
+}
+
+static void decode_octahedral(uint16_t code, float* n)
+{
+    float u = (code & 0xff) * (2.f / 255.f) - 1.f;
+    float v = (code >> 8) * (2.f / 255.f) - 1.f;
+    const float z = 1.f - std::abs(u) - std::abs(v);
+
+    if (z < 0.f)
+    {
+        const float folded_u = (1.f - std::abs(v)) * sign_not_zero(u);
+        v = (1.f - std::abs(u)) * sign_not_zero(v);
+        u = folded_u;
+    }
+
+    const float length = std::sqrt(u * u + v * v + z * z);
+    n[0] = u / length;
+    n[1] = v / length;
+    n[2] = z / length;
+}
+
+static void encode_normals_scalar(const float* normals, uint16_t* dst, int count, quantize_error_t& error)
+{
+    for (int i = 0; i < count; i++, normals += 4)
+    {
+        const float x = normals[0], y = normals[1], z = normals[2];
+        const float l1 = std::max(std::abs(x) + std::abs(y) + std::abs(z), 1e-20f);
+
+        // Project onto the octahedron, folding the lower half over the upper one
+        float u = x / l1;
+        float v = y / l1;
+        if (z < 0.f)
+        {
+            const float folded_u = (1.f - std::abs(v)) * sign_not_zero(u);
+            v = (1.f - std::abs(u)) * sign_not_zero(v);
+            u = folded_u;
+        }
+
+        const uint16_t qu = (uint16_t)((u * 0.5f + 0.5f) * 255.f + 0.5f);
+        const uint16_t qv = (uint16_t)((v * 0.5f + 0.5f) * 255.f + 0.5f);
+        dst[i] = (uint16_t)(qu | (qv << 8));
+
+        float decoded[3];
+        decode_octahedral(dst[i], decoded);
+        const float length = std::sqrt(x * x + y * y + z * z);
+        if (length > 0.f)
+            error.min_normal_dot = std::min(error.min_normal_dot, (x * decoded[0] + y * decoded[1] + z * decoded[2]) / length);
+    }
+}
+
+static void encode_colors_scalar(const uint8_t* colors, uint16_t* dst, int count)
+{
+    for (int i = 0; i < count; i++, colors += 4)
+        dst[i] = (uint16_t)(((colors[0] >> 3) << 11) | ((colors[1] >> 2) << 5) | (colors[2] >> 3));
+}
+
+static void decode_positions_scalar(const uint16_t* src, float* points, int count, const kinfu_quantized_cloud_t& header)
+{
+    for (int i = 0; i < count; i++, src += 3, points += 3)
+    {
+        for (int c = 0; c < 3; c++)
+            points[c] = header.origin[c] + src[c] * header.scale[c];
+    }
+}
+
+static void decode_normals_scalar(const uint16_t* src, float* normals, int count)
+{
+    for (int i = 0; i < count; i++, normals += 3)
+        decode_octahedral(src[i], normals);
+}
+
+static void decode_colors_scalar(const uint16_t* src, uint8_t* colors, int count)
+{
+    for (int i = 0; i < count; i++, colors += 4)
+    {
+        // Replicate the top bits into the bottom so full intensity decodes to 255
+        const int r = (src[i] >> 11) & 0x1f, g = (src[i] >> 5) & 0x3f, b = src[i] & 0x1f;
+        colors[0] = (uint8_t)((r << 3) | (r >> 2));
+        colors[1] = (uint8_t)((g << 2) | (g >> 4));
+        colors[2] = (uint8_t)((b << 3) | (b >> 2));
+        colors[3] = 255;
+    }
+}
+
+#if KINFU_SIMD_X86
+
+////
+//
+// SSSE3 kernels
+// Positions go two points at a time, normals and colors four at a time,
+// with the scalar kernels finishing the remainder.
+//
+////
+
+// Take the low 16 bits of each 32-bit lane of x, y, z into 6 bytes at byte `at`
+static inline __m128i pack_xyz_mask(int at)
+{
+    int8_t mask[16];
+    memset(mask, -1, sizeof(mask));
+    for (int c = 0; c < 3; c++)
+    {
+        mask[at + c * 2 + 0] = (int8_t)(c * 4 + 0);
+        mask[at + c * 2 + 1] = (int8_t)(c * 4 + 1);
+    }
+    return _mm_loadu_si128(reinterpret_cast<const __m128i*>(mask));
+}
+
+// Spread the 3 x uint16 at byte `at` into zero-extended 32-bit lanes x, y, z, 0
+static inline __m128i unpack_xyz_mask(int at)
+{
+    int8_t mask[16];
+    memset(mask, -1, sizeof(mask));
+    for (int c = 0; c < 3; c++)
+    {
+        mask[c * 4 + 0] = (int8_t)(at + c * 2 + 0);
+        mask[c * 4 + 1] = (int8_t)(at + c * 2 + 1);
+    }
+    return _mm_loadu_si128(reinterpret_cast<const __m128i*>(mask));
+}
+
+KINFU_TARGET_SSSE3
+static void encode_positions_ssse3(const float* points, uint16_t* dst, int count,
+    const kinfu_quantized_cloud_t& header, quantize_error_t& error)
+{
+    const __m128 origin = _mm_setr_ps(header.origin[0], header.origin[1], header.origin[2], 0.f);
+    const __m128 scale = _mm_setr_ps(header.scale[0], header.scale[1], header.scale[2], 0.f);
+    const __m128 inv_scale = _mm_setr_ps(1.f / header.scale[0], 1.f / header.scale[1], 1.f / header.scale[2], 0.f);
+    const __m128 xyz_mask = _mm_castsi128_ps(_mm_setr_epi32(-1, -1, -1, 0));
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 max_q = _mm_set1_ps(QUANTIZE_MAX);
+    const __m128 half = _mm_set1_ps(0.5f);
+    const __m128i pack0 = pack_xyz_mask(0);
+    const __m128i pack1 = pack_xyz_mask(6);
+
+    __m128 max_error2 = _mm_setzero_ps();
+
+    int i = 0;
+    for (; i + 2 <= count; i += 2, points += 8, dst += 6)
+    {
+        const __m128 p0 = _mm_and_ps(_mm_loadu_ps(points + 0), xyz_mask);
+        const __m128 p1 = _mm_and_ps(_mm_loadu_ps(points + 4), xyz_mask);
+
+        // The division in the scalar kernel is a multiply here, which can round the other way at
+        // a half step; either way the point lands on one of its two nearest grid steps
+        const __m128 q0 = _mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_sub_ps(p0, origin), inv_scale), zero), max_q);
+        const __m128 q1 = _mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_sub_ps(p1, origin), inv_scale), zero), max_q);
+        const __m128i i0 = _mm_cvttps_epi32(_mm_add_ps(q0, half));
+        const __m128i i1 = _mm_cvttps_epi32(_mm_add_ps(q1, half));
+
+        const __m128i packed = _mm_or_si128(_mm_shuffle_epi8(i0, pack0), _mm_shuffle_epi8(i1, pack1));
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(dst), packed);
+        const int tail = _mm_cvtsi128_si32(_mm_srli_si128(packed, 8));
+        memcpy(dst + 4, &tail, sizeof(tail));
+
+        // Squared distance to the decoded positions, summed across x, y, z
+        const __m128 d0 = _mm_sub_ps(_mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(i0), scale), origin), p0);
+        const __m128 d1 = _mm_sub_ps(_mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(i1), scale), origin), p1);
+        const __m128 e = _mm_hadd_ps(_mm_mul_ps(d0, d0), _mm_mul_ps(d1, d1));
+        max_error2 = _mm_max_ps(max_error2, _mm_hadd_ps(e, e));
+    }
+
+    float lanes[4];
+    _mm_storeu_ps(lanes, max_error2);
+    error.max_position_error2 = std::max(error.max_position_error2, std::max(lanes[0], lanes[1]));
+
+    encode_positions_scalar(points, dst, count - i, header, error);
+}
+
+// The sign of each lane as +-1, treating zero as positive
+KINFU_TARGET_SSSE3
+static inline __m128 sign_not_zero_ps(__m128 v, __m128 sign_bit, __m128 one)
+{
+    return _mm_or_ps(_mm_and_ps(v, sign_bit), one);
+}
+
+KINFU_TARGET_SSSE3
+static inline __m128 select_ps(__m128 mask, __m128 a, __m128 b)
+{
+    return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+
+// Fold the lower hemisphere of the octahedron onto the upper one where mask is set
+KINFU_TARGET_SSSE3
+static inline void fold_octahedral_ps(__m128 mask, __m128& u, __m128& v)
+{
+    const __m128 sign_bit = _mm_set1_ps(-0.f);
+    const __m128 one = _mm_set1_ps(1.f);
+    const __m128 folded_u = _mm_mul_ps(_mm_sub_ps(one, _mm_andnot_ps(sign_bit, v)), sign_not_zero_ps(u, sign_bit, one));
+    const __m128 folded_v = _mm_mul_ps(_mm_sub_ps(one, _mm_andnot_ps(sign_bit, u)), sign_not_zero_ps(v, sign_bit, one));
+    u = select_ps(mask, folded_u, u);
+    v = select_ps(mask, folded_v, v);
+}
+
+// Decode octahedral codes u, v (0-255 in 32-bit lanes) into unit x, y, z
+KINFU_TARGET_SSSE3
+static inline void decode_octahedral_ps(__m128i qu, __m128i qv, __m128& x, __m128& y, __m128& z)
+{
+    const __m128 sign_bit = _mm_set1_ps(-0.f);
+    const __m128 one = _mm_set1_ps(1.f);
+    const __m128 to_unit = _mm_set1_ps(2.f / 255.f);
+
+    __m128 u = _mm_sub_ps(_mm_mul_ps(_mm_cvtepi32_ps(qu), to_unit), one);
+    __m128 v = _mm_sub_ps(_mm_mul_ps(_mm_cvtepi32_ps(qv), to_unit), one);
+    const __m128 w = _mm_sub_ps(_mm_sub_ps(one, _mm_andnot_ps(sign_bit, u)), _mm_andnot_ps(sign_bit, v));
+    fold_octahedral_ps(_mm_cmplt_ps(w, _mm_setzero_ps()), u, v);
+
+    const __m128 length = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(u, u), _mm_mul_ps(v, v)), _mm_mul_ps(w, w)));
+    x = _mm_div_ps(u, length);
+    y = _mm_div_ps(v, length);
+    z = _mm_div_ps(w, length);
+}
+
+KINFU_TARGET_SSSE3
+static void encode_normals_ssse3(const float* normals, uint16_t* dst, int count, quantize_error_t& error)
+{
+    const __m128 sign_bit = _mm_set1_ps(-0.f);
+    const __m128 half = _mm_set1_ps(0.5f);
+    const __m128 to_code = _mm_set1_ps(255.f);
+    const __m128 tiny = _mm_set1_ps(1e-20f);
+    const __m128i low16 = _mm_setr_epi8(0, 1, 4, 5, 8, 9, 12, 13, -1, -1, -1, -1, -1, -1, -1, -1);
+
+    __m128 min_dot = _mm_set1_ps(1.f);
+
+    int i = 0;
+    for (; i + 4 <= count; i += 4, normals += 16)
+    {
+        __m128 x = _mm_loadu_ps(normals + 0);
+        __m128 y = _mm_loadu_ps(normals + 4);
+        __m128 z = _mm_loadu_ps(normals + 8);
+        __m128 w = _mm_loadu_ps(normals + 12);
+        _MM_TRANSPOSE4_PS(x, y, z, w);
+
+        const __m128 l1 = _mm_max_ps(_mm_add_ps(_mm_add_ps(_mm_andnot_ps(sign_bit, x), _mm_andnot_ps(sign_bit, y)),
+                                         _mm_andnot_ps(sign_bit, z)),
+            tiny);
+        __m128 u = _mm_div_ps(x, l1);
+        __m128 v = _mm_div_ps(y, l1);
+        fold_octahedral_ps(_mm_cmplt_ps(z, _mm_setzero_ps()), u, v);
+
+        const __m128i qu = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(_mm_add_ps(_mm_mul_ps(u, half), half), to_code), half));
+        const __m128i qv = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(_mm_add_ps(_mm_mul_ps(v, half), half), to_code), half));
+        const __m128i codes = _mm_or_si128(qu, _mm_slli_epi32(qv, 8));
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(dst + i), _mm_shuffle_epi8(codes, low16));
+
+        // Angle to the decoded normal; zero-length normals give NaN, which min_ps drops
+        __m128 dx, dy, dz;
+        decode_octahedral_ps(qu, qv, dx, dy, dz);
+        const __m128 length = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)), _mm_mul_ps(z, z)));
+        const __m128 dot = _mm_div_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(x, dx), _mm_mul_ps(y, dy)), _mm_mul_ps(z, dz)), length);
+        min_dot = _mm_min_ps(dot, min_dot);
+    }
+
+    float lanes[4];
+    _mm_storeu_ps(lanes, min_dot);
+    for (int l = 0; l < 4; l++)
+        error.min_normal_dot = std::min(error.min_normal_dot, lanes[l]);
+
+    encode_normals_scalar(normals, dst + i, count - i, error);
+}
+
+KINFU_TARGET_SSSE3
+static void encode_colors_ssse3(const uint8_t* colors, uint16_t* dst, int count)
+{
+    const __m128i channel = _mm_set1_epi32(0xff);
+    const __m128i low16 = _mm_setr_epi8(0, 1, 4, 5, 8, 9, 12, 13, -1, -1, -1, -1, -1, -1, -1, -1);
+
+    int i = 0;
+    for (; i + 4 <= count; i += 4, colors += 16)
+    {
+        const __m128i rgba = _mm_loadu_si128(reinterpret_cast<const __m128i*>(colors));
+        const __m128i r = _mm_and_si128(rgba, channel);
+        const __m128i g = _mm_and_si128(_mm_srli_epi32(rgba, 8), channel);
+        const __m128i b = _mm_and_si128(_mm_srli_epi32(rgba, 16), channel);
+
+        const __m128i packed = _mm_or_si128(_mm_or_si128(_mm_slli_epi32(_mm_srli_epi32(r, 3), 11),
+                                                _mm_slli_epi32(_mm_srli_epi32(g, 2), 5)),
+            _mm_srli_epi32(b, 3));
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(dst + i), _mm_shuffle_epi8(packed, low16));
+    }
+
+    encode_colors_scalar(colors, dst + i, count - i);
+}
+
+KINFU_TARGET_SSSE3
+static void decode_positions_ssse3(const uint16_t* src, float* points, int count, const kinfu_quantized_cloud_t& header)
+{
+    const __m128 origin = _mm_setr_ps(header.origin[0], header.origin[1], header.origin[2], 0.f);
+    const __m128 scale = _mm_setr_ps(header.scale[0], header.scale[1], header.scale[2], 0.f);
+    const __m128i unpack0 = unpack_xyz_mask(0);
+    const __m128i unpack1 = unpack_xyz_mask(6);
+
+    int i = 0;
+    for (; i + 2 <= count; i += 2, src += 6, points += 6)
+    {
+        // Load exactly the 12 bytes of the two points, the data may end right after them
+        int tail;
+        memcpy(&tail, src + 4, sizeof(tail));
+        const __m128i packed = _mm_unpacklo_epi64(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(src)), _mm_cvtsi32_si128(tail));
+
+        const __m128 p0 = _mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(_mm_shuffle_epi8(packed, unpack0)), scale), origin);
+        const __m128 p1 = _mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(_mm_shuffle_epi8(packed, unpack1)), scale), origin);
+
+        // The first store spills one float that the second point overwrites
+        _mm_storeu_ps(points, p0);
+        _mm_storel_pi(reinterpret_cast<__m64*>(points + 3), p1);
+        _mm_store_ss(points + 5, _mm_movehl_ps(p1, p1));
+    }
+
+    decode_positions_scalar(src, points, count - i, header);
+}
+
+KINFU_TARGET_SSSE3
+static void decode_normals_ssse3(const uint16_t* src, float* normals, int count)
+{
+    const __m128i byte = _mm_set1_epi32(0xff);
+
+    int i = 0;
+    for (; i + 4 <= count; i += 4, normals += 12)
+    {
+        const __m128i codes = _mm_unpacklo_epi16(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(src + i)), _mm_setzero_si128());
+
+        __m128 x, y, z, w = _mm_setzero_ps();
+        decode_octahedral_ps(_mm_and_si128(codes, byte), _mm_srli_epi32(codes, 8), x, y, z);
+        _MM_TRANSPOSE4_PS(x, y, z, w);
+
+        // x..w now hold one normal each; overlapping stores keep to 3 floats per normal
+        _mm_storeu_ps(normals + 0, x);
+        _mm_storeu_ps(normals + 3, y);
+        _mm_storeu_ps(normals + 6, z);
+        _mm_storel_pi(reinterpret_cast<__m64*>(normals + 9), w);
+        _mm_store_ss(normals + 11, _mm_movehl_ps(w, w));
+    }
+
+    decode_normals_scalar(src + i, normals, count - i);
+}
+
+KINFU_TARGET_SSSE3
+static void decode_colors_ssse3(const uint16_t* src, uint8_t* colors, int count)
+{
+    const __m128i mask5 = _mm_set1_epi32(0x1f);
+    const __m128i mask6 = _mm_set1_epi32(0x3f);
+    const __m128i alpha = _mm_set1_epi32((int)0xff000000);
+
+    int i = 0;
+    for (; i + 4 <= count; i += 4, colors += 16)
+    {
+        const __m128i packed = _mm_unpacklo_epi16(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(src + i)), _mm_setzero_si128());
+        const __m128i r = _mm_and_si128(_mm_srli_epi32(packed, 11), mask5);
+        const __m128i g = _mm_and_si128(_mm_srli_epi32(packed, 5), mask6);
+        const __m128i b = _mm_and_si128(packed, mask5);
+
+        const __m128i r8 = _mm_or_si128(_mm_slli_epi32(r, 3), _mm_srli_epi32(r, 2));
+        const __m128i g8 = _mm_or_si128(_mm_slli_epi32(g, 2), _mm_srli_epi32(g, 4));
+        const __m128i b8 = _mm_or_si128(_mm_slli_epi32(b, 3), _mm_srli_epi32(b, 2));
+
+        const __m128i rgba = _mm_or_si128(_mm_or_si128(r8, _mm_slli_epi32(g8, 8)), _mm_or_si128(_mm_slli_epi32(b8, 16), alpha));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(colors), rgba);
+    }
+
+    decode_colors_scalar(src + i, colors, count - i);
+}
+
+#endif
+
+// Run fn over ranges of [0, count), across threads for large clouds
+template <typename Fn>
+static void for_each_stripe(int count, Fn fn)
+{
+    if (count <= QUANTIZE_STRIPE)
+    {
+        fn(cv::Range(0, count));
+        return;
+    }
+
+    cv::parallel_for_(cv::Range(0, count), fn, (double)count / QUANTIZE_STRIPE);
+}
+
+void encode_quantized_cloud(const float* points,
+    const float* normals,
+    const uint8_t* colors,
+    int count,
+    uint8_t* data,
+    kinfu_quantized_cloud_t* header,
+    simd_level_t level)
+{
+    void (*encode_positions)(const float*, uint16_t*, int, const kinfu_quantized_cloud_t&, quantize_error_t&) = encode_positions_scalar;
+    void (*encode_normals)(const float*, uint16_t*, int, quantize_error_t&) = encode_normals_scalar;
+    void (*encode_colors)(const uint8_t*, uint16_t*, int) = encode_colors_scalar;
+
+#if KINFU_SIMD_X86
+    if (level >= SIMD_SSSE3)
+    {
+        encode_positions = encode_positions_ssse3;
+        encode_normals = encode_normals_ssse3;
+        encode_colors = encode_colors_ssse3;
+    }
+#endif
+
+    header->count = (uint32_t)count;
+
+    const bool with_normals = (header->flags & KINFU_QUANTIZED_NORMALS) != 0;
+    const bool with_colors = (header->flags & KINFU_QUANTIZED_COLORS) != 0;
+
+    uint16_t* positions_out = reinterpret_cast<uint16_t*>(data);
+    uint16_t* normals_out = positions_out + (size_t)count * 3;
+    uint16_t* colors_out = normals_out + (with_normals ? (size_t)count : 0);
+
+    quantize_error_t total = { 0.f, 1.f };
+    std::mutex total_mutex;
+
+    for_each_stripe(count, [&](const cv::Range& range) {
+        const int n = range.end - range.start;
+        quantize_error_t error = { 0.f, 1.f };
+
+        encode_positions(points + (size_t)range.start * 4, positions_out + (size_t)range.start * 3, n, *header, error);
+
+        if (with_normals)
+            encode_normals(normals + (size_t)range.start * 4, normals_out + range.start, n, error);
+
+        if (with_colors)
+            encode_colors(colors + (size_t)range.start * 4, colors_out + range.start, n);
+
+        std::lock_guard<std::mutex> lock(total_mutex);
+        total.max_position_error2 = std::max(total.max_position_error2, error.max_position_error2);
+        total.min_normal_dot = std::min(total.min_normal_dot, error.min_normal_dot);
+    });
+
+    header->max_position_error = std::sqrt(total.max_position_error2);
+    header->max_normal_error = with_normals ? std::acos(std::min(std::max(total.min_normal_dot, -1.f), 1.f)) * (float)(180.0 / CV_PI) : 0.f;
+}
+
+void decode_quantized_cloud(const uint8_t* data,
+    const kinfu_quantized_cloud_t& header,
+    float* points,
+    float* normals,
+    uint8_t* colors,
+    simd_level_t level)
+{
+    void (*decode_positions)(const uint16_t*, float*, int, const kinfu_quantized_cloud_t&) = decode_positions_scalar;
+    void (*decode_normals)(const uint16_t*, float*, int) = decode_normals_scalar;
+    void (*decode_colors)(const uint16_t*, uint8_t*, int) = decode_colors_scalar;
+
+#if KINFU_SIMD_X86
+    if (level >= SIMD_SSSE3)
+    {
+        decode_positions = decode_positions_ssse3;
+        decode_normals = decode_normals_ssse3;
+        decode_colors = decode_colors_ssse3;
+    }
+#endif
+
+    const int count = (int)header.count;
+    const bool with_normals = (header.flags & KINFU_QUANTIZED_NORMALS) != 0;
+    const bool with_colors = (header.flags & KINFU_QUANTIZED_COLORS) != 0;
+
+    const uint16_t* positions_in = reinterpret_cast<const uint16_t*>(data);
+    const uint16_t* normals_in = positions_in + (size_t)count * 3;
+    const uint16_t* colors_in = normals_in + (with_normals ? (size_t)count : 0);
+
+    for_each_stripe(count, [&](const cv::Range& range) {
+        const int n = range.end - range.start;
+
+        decode_positions(positions_in + (size_t)range.start * 3, points + (size_t)range.start * 3, n, header);
+
+        if (with_normals && normals != NULL)
+            decode_normals(normals_in + range.start, normals + (size_t)range.start * 3, n);
+
+        if (with_colors && colors != NULL)
+            decode_colors(colors_in + range.start, colors + (size_t)range.start * 4, n);
+    });
+}
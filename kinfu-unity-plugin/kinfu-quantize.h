@@ -0,0 +1,44 @@
+#pragma once
+
+#include "kinfu-simd.h"
+#include "kinfu-unity.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+////
+//
+// Quantized point cloud encoding
+//
+// Positions become 3 x uint16 on a grid spanning the volume, normals are
+// octahedral-encoded into 2 x uint8 and colors packed into RGB565, so a
+// point with a normal takes 8 bytes instead of 24. Encoding measures the
+// error it introduced, so callers can check it against their tolerance.
+//
+////
+
+// Bytes needed for count points with the given kinfu_quantized_flags_t
+size_t quantized_cloud_size(int count, int flags);
+
+// Set the header's grid to span the box [min, max] with the full 16 bits on each axis
+void set_quantized_bounds(const float min[3], const float max[3], kinfu_quantized_cloud_t* header);
+
+// Encode count points (x, y, z, padding per point, as KinFu returns them) into data.
+// normals use the same layout and colors are RGBA32; each is only read if its flag is set in header->flags.
+// header's grid must be set, count and both error fields are filled in
+void encode_quantized_cloud(const float* points,
+    const float* normals,
+    const uint8_t* colors,
+    int count,
+    uint8_t* data,
+    kinfu_quantized_cloud_t* header,
+    simd_level_t level = get_simd_level());
+
+// Decode header->count points from data into x, y, z floats, and into normals (x, y, z floats)
+// and colors (RGBA32) when they are not NULL and present in the data
+void decode_quantized_cloud(const uint8_t* data,
+    const kinfu_quantized_cloud_t& header,
+    float* points,
+    float* normals,
+    uint8_t* colors,
+    simd_level_t level = get_simd_level());
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <opencv2/core/utility.hpp>
+
+////
+//
+// SIMD helpers shared by the per-frame kernels.
+//
+// Kernels are compiled for each instruction set and picked at runtime with
+// get_simd_level(), so the plugin still runs on CPUs without AVX2.
+// MSVC allows intrinsics in any function; GCC/Clang need the target attribute.
+//
+////
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define KINFU_SIMD_X86 1
+#else
+#define KINFU_SIMD_X86 0
+#endif
+
+#if KINFU_SIMD_X86
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define KINFU_TARGET_SSSE3
+#define KINFU_TARGET_AVX2
+#else
+#include <immintrin.h>
+#define KINFU_TARGET_SSSE3 __attribute__((target("ssse3")))
+#define KINFU_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+typedef enum
+{
+    SIMD_SCALAR, /**< Plain C++ loops */
+    SIMD_SSSE3,  /**< 128-bit shuffles */
+    SIMD_AVX2    /**< 256-bit integer and float ops */
+} simd_level_t;
+
+// Best instruction set supported by this CPU
+inline simd_level_t get_simd_level()
+{
+#if KINFU_SIMD_X86
+    static const simd_level_t level = cv::checkHardwareSupport(CV_CPU_AVX2)    ? SIMD_AVX2
+                                      : cv::checkHardwareSupport(CV_CPU_SSSE3) ? SIMD_SSSE3
+                                                                               : SIMD_SCALAR;
+    return level;
+#else
+    return SIMD_SCALAR;
+#endif
+}
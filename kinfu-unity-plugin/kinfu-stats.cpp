@@ -0,0 +1,192 @@
+#include "pch.h"
+#include "framework.h"
+#include "kinfu-stats.h"
+#include "kinfu-trace.h"
+
+#include <chrono>
+#include <string.h>
+
+// Histogram layout: bucket 0 holds everything under 1024 ns, then 8 buckets per power of two
+// from 2^10 ns (~1 us) up to 2^31 ns (~2 s), with anything slower in the last bucket
+#define STATS_SUB_BUCKET_BITS 3
+#define STATS_SUB_BUCKETS (1 << STATS_SUB_BUCKET_BITS)
+#define STATS_MIN_OCTAVE 10
+#define STATS_MAX_OCTAVE 30
+#define STATS_BUCKETS (1 + (STATS_MAX_OCTAVE - STATS_MIN_OCTAVE + 1) * STATS_SUB_BUCKETS)
+
+typedef struct _stage_histogram_t
+{
+    std::atomic<uint64_t> count;
+    std::atomic<uint64_t> total_ns;
+    std::atomic<uint64_t> max_ns;
+    std::atomic<uint64_t> last_ns;
+    std::atomic<uint32_t> buckets[STATS_BUCKETS];
+} stage_histogram_t;
+
+static stage_histogram_t stage_histograms[KINFU_STAGE_COUNT];
+static std::atomic<uint64_t> counters[COUNTER_COUNT];
+static std::atomic<bool> timing_enabled(true);
+
+uint64_t stats_now_ns()
+{
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+bool stats_enabled()
+{
+    return timing_enabled.load(std::memory_order_relaxed);
+}
+
+void set_stats_enabled(bool enabled)
+{
+    timing_enabled = enabled;
+}
+
+static int highest_bit(uint64_t value)
+{
+    int bit = 0;
+    while (value >>= 1)
+        bit++;
+    return bit;
+}
+
+static int bucket_for(uint64_t ns)
+{
+    if (ns < (1ull << STATS_MIN_OCTAVE))
+        return 0;
+
+    const int octave = highest_bit(ns);
+    if (octave > STATS_MAX_OCTAVE)
+        return STATS_BUCKETS - 1;
+
+    const int sub = (int)(ns >> (octave - STATS_SUB_BUCKET_BITS)) & (STATS_SUB_BUCKETS - 1);
+    return 1 + (octave - STATS_MIN_OCTAVE) * STATS_SUB_BUCKETS + sub;
+}
+
+// Middle of the range of times that land in a bucket
+static double bucket_midpoint_ns(int bucket)
+{
+    if (bucket == 0)
+        return (double)(1ull << (STATS_MIN_OCTAVE - 1));
+
+    const int octave = STATS_MIN_OCTAVE + (bucket - 1) / STATS_SUB_BUCKETS;
+    const int sub = (bucket - 1) % STATS_SUB_BUCKETS;
+    const double step = (double)(1ull << (octave - STATS_SUB_BUCKET_BITS));
+    return (STATS_SUB_BUCKETS + sub + 0.5) * step;
+}
+
+void record_stage_time(kinfu_stage_t stage, uint64_t start_ns)
+{
+    const uint64_t ns = stats_now_ns() - start_ns;
+    stage_histogram_t& histogram = stage_histograms[stage];
+
+    histogram.count.fetch_add(1, std::memory_order_relaxed);
+    histogram.total_ns.fetch_add(ns, std::memory_order_relaxed);
+    histogram.last_ns.store(ns, std::memory_order_relaxed);
+    histogram.buckets[bucket_for(ns)].fetch_add(1, std::memory_order_relaxed);
+
+    uint64_t max_ns = histogram.max_ns.load(std::memory_order_relaxed);
+    while (ns > max_ns && !histogram.max_ns.compare_exchange_weak(max_ns, ns, std::memory_order_relaxed))
+    {
+    }
+}
+
+uint64_t begin_stage()
+{
+    return stats_enabled() || trace_enabled() ? stats_now_ns() : 0;
+}
+
+void end_stage(kinfu_stage_t stage, uint64_t start_ns)
+{
+    if (stats_enabled())
+        record_stage_time(stage, start_ns);
+
+    if (trace_enabled())
+        trace_complete(stage_name(stage), start_ns, stats_now_ns());
+}
+
+const char* stage_name(kinfu_stage_t stage)
+{
+    static const char* names[KINFU_STAGE_COUNT] = {
+        "capture", "color", "remap", "register", "update", "get_cloud", "export", "frame"
+    };
+
+    return stage >= 0 && stage < KINFU_STAGE_COUNT ? names[stage] : "unknown";
+}
+
+void increment_counter(stats_counter_t counter)
+{
+    counters[counter].fetch_add(1, std::memory_order_relaxed);
+}
+
+// Time below which a fraction of the recorded samples fall, read off a copy of the histogram
+static float histogram_percentile_ms(const uint32_t* buckets, uint64_t count, double fraction)
+{
+    if (count == 0)
+        return 0.f;
+
+    const uint64_t rank = (uint64_t)(fraction * (count - 1)) + 1;
+    uint64_t seen = 0;
+    for (int b = 0; b < STATS_BUCKETS; b++)
+    {
+        seen += buckets[b];
+        if (seen >= rank)
+            return (float)(bucket_midpoint_ns(b) * 1e-6);
+    }
+
+    return (float)(bucket_midpoint_ns(STATS_BUCKETS - 1) * 1e-6);
+}
+
+void get_stats(kinfu_pipeline_stats_t* stats)
+{
+    memset(stats, 0, sizeof(*stats));
+
+    for (int s = 0; s < KINFU_STAGE_COUNT; s++)
+    {
+        const stage_histogram_t& histogram = stage_histograms[s];
+        kinfu_stage_stats_t& out = stats->stages[s];
+
+        // The writer may be mid-update, so count the copied buckets rather than trusting count
+        uint32_t buckets[STATS_BUCKETS];
+        uint64_t bucket_count = 0;
+        for (int b = 0; b < STATS_BUCKETS; b++)
+        {
+            buckets[b] = histogram.buckets[b].load(std::memory_order_relaxed);
+            bucket_count += buckets[b];
+        }
+
+        out.count = histogram.count.load(std::memory_order_relaxed);
+        out.last_ms = (float)(histogram.last_ns.load(std::memory_order_relaxed) * 1e-6);
+        out.max_ms = (float)(histogram.max_ns.load(std::memory_order_relaxed) * 1e-6);
+        out.mean_ms = out.count > 0 ? (float)(histogram.total_ns.load(std::memory_order_relaxed) * 1e-6 / out.count) : 0.f;
+        out.p50_ms = histogram_percentile_ms(buckets, bucket_count, 0.50);
+        out.p95_ms = histogram_percentile_ms(buckets, bucket_count, 0.95);
+        out.p99_ms = histogram_percentile_ms(buckets, bucket_count, 0.99);
+    }
+
+    stats->frames = counters[COUNTER_FRAMES].load(std::memory_order_relaxed);
+    stats->successful_updates = counters[COUNTER_UPDATES_SUCCEEDED].load(std::memory_order_relaxed);
+    stats->failed_updates = counters[COUNTER_UPDATES_FAILED].load(std::memory_order_relaxed);
+    stats->dropped_frames = counters[COUNTER_DROPPED_FRAMES].load(std::memory_order_relaxed);
+    stats->capture_timeouts = counters[COUNTER_CAPTURE_TIMEOUTS].load(std::memory_order_relaxed);
+    stats->capture_failures = counters[COUNTER_CAPTURE_FAILURES].load(std::memory_order_relaxed);
+    stats->color_failures = counters[COUNTER_COLOR_FAILURES].load(std::memory_order_relaxed);
+}
+
+void reset_stats()
+{
+    for (int s = 0; s < KINFU_STAGE_COUNT; s++)
+    {
+        stage_histogram_t& histogram = stage_histograms[s];
+        histogram.count = 0;
+        histogram.total_ns = 0;
+        histogram.max_ns = 0;
+        histogram.last_ns = 0;
+        for (int b = 0; b < STATS_BUCKETS; b++)
+            histogram.buckets[b] = 0;
+    }
+
+    for (int c = 0; c < COUNTER_COUNT; c++)
+        counters[c] = 0;
+}
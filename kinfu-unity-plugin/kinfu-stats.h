@@ -0,0 +1,76 @@
+#pragma once
+
+#include "kinfu-unity.h"
+
+#include <atomic>
+#include <stdint.h>
+
+////
+//
+// Pipeline instrumentation
+//
+// Each stage keeps a running count, total, max and a log-spaced histogram
+// (8 buckets per power of two, so percentiles are within about 6%), all as
+// relaxed atomics so the capture thread records while Unity reads. Recording
+// a stage costs two clock reads and a handful of uncontended atomic adds.
+//
+////
+
+// Events counted alongside the stage timings
+typedef enum
+{
+    COUNTER_FRAMES,             /**< Captures that went through the pipeline */
+    COUNTER_UPDATES_SUCCEEDED,  /**< kf->update tracked the frame */
+    COUNTER_UPDATES_FAILED,     /**< kf->update lost tracking or had no depth */
+    COUNTER_DROPPED_FRAMES,     /**< Fused but not published because Unity had not drained the ring */
+    COUNTER_CAPTURE_TIMEOUTS,   /**< No capture within TIMEOUT_IN_MS */
+    COUNTER_CAPTURE_FAILURES,   /**< Device or recording read failed */
+    COUNTER_COLOR_FAILURES,     /**< Capture had no usable color image */
+    COUNTER_COUNT
+} stats_counter_t;
+
+// Monotonic clock in nanoseconds
+uint64_t stats_now_ns();
+
+// Whether stage timing is on; counters are always kept
+bool stats_enabled();
+void set_stats_enabled(bool enabled);
+
+// Record a stage that started at start_ns (from stats_now_ns)
+void record_stage_time(kinfu_stage_t stage, uint64_t start_ns);
+
+// Start time for a stage, or 0 when neither stage timing nor tracing is on
+uint64_t begin_stage();
+
+// Finish a stage from begin_stage, recording its time and its trace event
+void end_stage(kinfu_stage_t stage, uint64_t start_ns);
+
+// Name of a stage as it appears in traces and benchmark output
+const char* stage_name(kinfu_stage_t stage);
+
+void increment_counter(stats_counter_t counter);
+
+// Snapshot every stage and counter, computing percentiles from the histograms
+void get_stats(kinfu_pipeline_stats_t* stats);
+
+void reset_stats();
+
+// Times and traces a stage from construction until it goes out of scope
+class StageTimer
+{
+public:
+    explicit StageTimer(kinfu_stage_t stage)
+        : stage(stage), start(begin_stage())
+    {
+    }
+
+    ~StageTimer()
+    {
+        if (start != 0)
+            end_stage(stage, start);
+    }
+
+private:
+    kinfu_stage_t stage;
+    uint64_t start;
+};
@@ -0,0 +1,206 @@
+#include "pch.h"
+#include "framework.h"
+#include "kinfu-trace.h"
+
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+typedef struct _trace_event_t
+{
+    const char* name;  /**< String literal */
+    uint64_t start_ns; /**< stats_now_ns() at the start */
+    uint64_t duration_ns;
+    bool instant;      /**< Instant event, duration unused */
+} trace_event_t;
+
+typedef struct _trace_ring_t
+{
+    char name[64];
+    std::vector<trace_event_t> events;  /**< TRACE_EVENTS_PER_THREAD slots, sized when tracing is first enabled */
+    std::atomic<uint64_t> written;      /**< Events ever written, the next slot is written % size */
+} trace_ring_t;
+
+static trace_ring_t rings[TRACE_MAX_THREADS];
+static int ring_count = 0;
+
+// Guards claiming rings and reading them out, never taken while recording
+static std::mutex ring_mutex;
+
+static std::atomic<bool> tracing(false);
+static bool rings_allocated = false;
+
+// Ring of the calling thread, claimed on its first event
+static thread_local trace_ring_t* thread_ring = nullptr;
+static thread_local bool thread_ring_claimed = false;
+
+bool trace_enabled()
+{
+    return tracing.load(std::memory_order_relaxed);
+}
+
+void set_trace_enabled(bool enabled)
+{
+    if (enabled)
+    {
+        std::lock_guard<std::mutex> lock(ring_mutex);
+        if (!rings_allocated)
+        {
+            for (int i = 0; i < TRACE_MAX_THREADS; i++)
+                rings[i].events.resize(TRACE_EVENTS_PER_THREAD);
+            rings_allocated = true;
+        }
+    }
+
+    tracing = enabled;
+}
+
+// Find the ring with this name, or claim a new one. Called with ring_mutex held
+static trace_ring_t* claim_ring(const char* name)
+{
+    for (int i = 0; i < ring_count; i++)
+    {
+        if (strcmp(rings[i].name, name) == 0)
+            return &rings[i];
+    }
+
+    if (ring_count == TRACE_MAX_THREADS)
+        return nullptr;
+
+    trace_ring_t* ring = &rings[ring_count++];
+    snprintf(ring->name, sizeof(ring->name), "%s", name);
+    ring->written = 0;
+    return ring;
+}
+
+void trace_set_thread_name(const char* name)
+{
+    std::lock_guard<std::mutex> lock(ring_mutex);
+    thread_ring = claim_ring(name);
+    thread_ring_claimed = true;
+}
+
+static trace_ring_t* get_thread_ring()
+{
+    if (!thread_ring_claimed)
+    {
+        std::lock_guard<std::mutex> lock(ring_mutex);
+
+        char name[32];
+        snprintf(name, sizeof(name), "Thread %d", ring_count + 1);
+        thread_ring = claim_ring(name);
+        thread_ring_claimed = true;
+    }
+
+    return thread_ring;
+}
+
+static void trace_event(const char* name, uint64_t start_ns, uint64_t duration_ns, bool instant)
+{
+    trace_ring_t* ring = get_thread_ring();
+    if (ring == nullptr || ring->events.empty())
+        return;
+
+    // Only this thread writes the ring, so a relaxed read of our own count is enough
+    const uint64_t index = ring->written.load(std::memory_order_relaxed);
+    trace_event_t& event = ring->events[index % ring->events.size()];
+    event.name = name;
+    event.start_ns = start_ns;
+    event.duration_ns = duration_ns;
+    event.instant = instant;
+
+    ring->written.store(index + 1, std::memory_order_release);
+}
+
+void trace_complete(const char* name, uint64_t start_ns, uint64_t end_ns)
+{
+    trace_event(name, start_ns, end_ns - start_ns, false);
+}
+
+void trace_instant(const char* name)
+{
+    if (trace_enabled())
+        trace_event(name, stats_now_ns(), 0, true);
+}
+
+int write_trace(const char* path)
+{
+    std::lock_guard<std::mutex> lock(ring_mutex);
+
+    FILE* file = fopen(path, "w");
+    if (file == NULL)
+        return -1;
+
+    // Timestamps are relative to the oldest event so they stay readable
+    uint64_t epoch = UINT64_MAX;
+    std::vector<std::vector<trace_event_t>> snapshots(ring_count);
+    for (int i = 0; i < ring_count; i++)
+    {
+        trace_ring_t& ring = rings[i];
+        const uint64_t size = ring.events.size();
+        if (size == 0)
+            continue;
+
+        // Copy while the owner may still be writing, then drop anything it overwrote meanwhile
+        const uint64_t before = ring.written.load(std::memory_order_acquire);
+        const uint64_t first = before > size ? before - size : 0;
+        std::vector<trace_event_t>& copy = snapshots[i];
+        for (uint64_t e = first; e < before; e++)
+            copy.push_back(ring.events[e % size]);
+
+        // The owner may also be part way through event after, whose slot holds event after - size
+        const uint64_t after = ring.written.load(std::memory_order_acquire);
+        const uint64_t overwritten = after >= size ? after - size + 1 : 0;
+        if (overwritten > first)
+            copy.erase(copy.begin(), copy.begin() + (size_t)std::min<uint64_t>(overwritten - first, copy.size()));
+
+        for (const trace_event_t& event : copy)
+            epoch = std::min(epoch, event.start_ns);
+    }
+
+    int written = 0;
+    fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    fprintf(file, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"kinfu-unity\"}}");
+
+    for (int i = 0; i < ring_count; i++)
+    {
+        const int tid = i + 1;
+        fprintf(file, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+            tid, rings[i].name);
+
+        for (const trace_event_t& event : snapshots[i])
+        {
+            const double ts = (event.start_ns - epoch) * 1e-3;
+            if (event.instant)
+            {
+                fprintf(file, ",\n{\"name\":\"%s\",\"cat\":\"kinfu\",\"ph\":\"i\",\"s\":\"t\",\"ts\":%.3f,\"pid\":1,\"tid\":%d}",
+                    event.name, ts, tid);
+            }
+            else
+            {
+                fprintf(file, ",\n{\"name\":\"%s\",\"cat\":\"kinfu\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%d}",
+                    event.name, ts, event.duration_ns * 1e-3, tid);
+            }
+            written++;
+        }
+    }
+
+    fprintf(file, "\n]}\n");
+
+    if (fclose(file) != 0)
+        return -1;
+
+    return written;
+}
+
+void clear_trace()
+{
+    std::lock_guard<std::mutex> lock(ring_mutex);
+
+    // Rewinding a ring under its owner could lose the event being written, which is fine for a clear
+    for (int i = 0; i < ring_count; i++)
+        rings[i].written = 0;
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include "kinfu-stats.h"
+
+#include <stdint.h>
+
+////
+//
+// Chrome Trace Event recording of the native pipeline
+//
+// Each thread records complete (begin + duration) and instant events into its
+// own preallocated ring, so recording never allocates or locks and only the
+// most recent events are kept. Rings are claimed by thread name, so a capture
+// thread that is stopped and restarted keeps writing to the same track.
+// write_trace() dumps every ring as Chrome Trace JSON for chrome://tracing or
+// ui.perfetto.dev.
+//
+////
+
+// Events kept per thread, and threads that can record
+#define TRACE_EVENTS_PER_THREAD (1 << 15)
+#define TRACE_MAX_THREADS 8
+
+bool trace_enabled();
+
+// Allocates every ring the first time it is turned on, so call it off the frame path
+void set_trace_enabled(bool enabled);
+
+// Name the calling thread's track. Threads that never call this get "Thread <n>"
+void trace_set_thread_name(const char* name);
+
+// Event names are stored by pointer, so they must be string literals
+void trace_complete(const char* name, uint64_t start_ns, uint64_t end_ns);
+void trace_instant(const char* name);
+
+// Write every recorded event as Chrome Trace JSON, returning the number written or -1
+int write_trace(const char* path);
+
+// Drop every recorded event, keeping the rings and thread names
+void clear_trace();
+
+// Records a complete event from construction until it goes out of scope
+class TraceScope
+{
+public:
+    explicit TraceScope(const char* name)
+        : name(name), start(trace_enabled() ? stats_now_ns() : 0)
+    {
+    }
+
+    ~TraceScope()
+    {
+        if (start != 0)
+            trace_complete(name, start, stats_now_ns());
+    }
+
+private:
+    const char* name;
+    uint64_t start;
+};
@@ -4,29 +4,219 @@
 #include "pch.h"
 #include "framework.h"
 #include "kinfu-helpers.h"
+#include "kinfu-cloud.h"
+#include "kinfu-color.h"
+#include "kinfu-frame-ring.h"
+#include "kinfu-fusion.h"
+#include "kinfu-lut-cache.h"
+#include "kinfu-quality.h"
+#include "kinfu-quantize.h"
+#include "kinfu-stats.h"
+#include "kinfu-trace.h"
 
 #include "kinfu-unity.h"
 
+#include <k4arecord/playback.h>
+#include <opencv2/imgproc.hpp>
+
+#include <atomic>
+#include <cfloat>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
 #include <sstream>
+#include <thread>
+#include <vector>
 
 const int32_t TIMEOUT_IN_MS = 1000;
 
 // The currently connected device
 k4a_device_t device = NULL;
 
+// Recording played back in place of the device, see openPlayback()
+k4a_playback_t playback = NULL;
+bool playbackRealtime = false;
+std::atomic<bool> playbackFinished(false);
+
+// Wall clock and device time of the first played back frame, for real-time pacing
+std::chrono::steady_clock::time_point playbackStartTime;
+int64_t playbackStartTimestamp = -1;
+
+// Whether captures carry a color image the pipeline can convert
+bool colorAvailable = true;
+
+// Camera modes the next setupConfigAndCalibrate applies, only touched by the Unity thread
+kinfu_capture_profile_t captureProfile = {
+    K4A_DEPTH_MODE_NFOV_UNBINNED, K4A_COLOR_RESOLUTION_1080P, K4A_IMAGE_FORMAT_COLOR_BGRA32, K4A_FRAMES_PER_SECOND_5, 0, 0
+};
+
 // Configure the depth mode and fps
 k4a_device_configuration_t config = K4A_DEVICE_CONFIG_INIT_DISABLE_ALL;
 k4a_calibration_t calibration;
-k4a_image_t lut = NULL;
+undistortion_lut_t lut;
 
 pinhole_t pinhole;
 interpolation_t interpolation_type = INTERPOLATION_BILINEAR_DEPTH;
 
-Ptr<kinfu::KinFu> kf;
+// Registers color to the depth camera for colored volumes, NULL otherwise
+k4a_transformation_t colorTransformation = NULL;
+
+// Buffers reused by every frame, and a count of their re-allocations
+frame_pool_t framePool;
+std::atomic<uint64_t> pipelineAllocations(0);
+
+// KinFu, LargeKinfu or ColoredKinFu, whichever volume type was started.
+// Only assigned under volumeMutex, threads other than its owner read it through currentFusion
+Ptr<FusionBackend> kf;
+
+// Flip the color image vertically while swizzling it
+std::atomic<bool> flipColorImage(false);
 
+// Capacity of the point buffers passed to capturePointCloud, captureFrame and pollFrame.
+// Larger clouds are read through getPointCloudSize and copyPointCloud instead
 const int maxPoints = 1000000;
-auto out_points = new float[maxPoints * 3];
-auto out_normals = new float[maxPoints * 3];
+
+// Floats per point written by capturePointCloud and pollFrame
+cloud_layout_t cloudLayout = CLOUD_LAYOUT_XYZ;
+
+// Bumped whenever the volume changes, so a cloud extracted at the same generation is still current
+std::atomic<uint64_t> fusionGeneration(0);
+
+// Whether extracted clouds also carry normals, for vertex formats that ask for them
+std::atomic<bool> cloudNormals(false);
+
+// KinectFusion is not thread safe, so updates, resets and cloud extraction take turns on the volume
+std::mutex volumeMutex;
+
+// Newest extracted cloud, swapped in by whichever thread runs KinectFusion
+std::mutex cloudMutex;
+std::shared_ptr<cloud_snapshot_t> latestCloud;
+
+// Cell sizes of the LODs built with each cloud, finest first. Guarded by cloudMutex
+std::vector<float> lodCellSizes;
+
+// Edge of the blocks each cloud is partitioned into for getPointCloudDelta, 0 for none. Guarded by cloudMutex
+float cloudBlockSize = 0.f;
+
+// Smallest block edge, finer blocks would cost more to track than the points they save
+const float MIN_BLOCK_SIZE = 0.01f;
+
+// Block hashes of the newest partitioned cloud, which each extraction is compared against
+std::mutex blockHistoryMutex;
+cloud_block_history_t blockHistory;
+
+// Cloud pinned by getPointCloudSize for copyPointCloud, only touched by the Unity thread
+std::shared_ptr<cloud_snapshot_t> pinnedCloud;
+
+// Blocks of the delta pinned by getPointCloudDelta, only touched by the Unity thread
+std::vector<kinfu_cloud_block_t> pinnedBlocks;
+
+// Level getPointCloudSize pins, 0 for the full cloud and n for lods[n - 1]. Unity thread only
+int pinnedLod = 0;
+
+// Newest fused depth frame and the pose it was fused at, for the depth frame export.
+// Only kept once exportDepthFrameCloud has been called
+std::atomic<bool> keepLatestDepth(false);
+std::mutex depthMutex;
+Mat latestDepth;
+Matx44f latestDepthPose;
+
+// Cloud last handed out by pollFrame, so unchanged clouds are not copied again
+std::shared_ptr<cloud_snapshot_t> polledCloud;
+
+// A finished frame published by the capture thread.
+// The color buffer is sized once in startCaptureThread() and reused,
+// the cloud is shared with the cache rather than copied.
+typedef struct _captured_frame_t
+{
+    std::vector<uint8_t> color;
+    std::shared_ptr<cloud_snapshot_t> cloud;
+    float pose[16];
+
+    int numPoints;
+    bool colorOk;
+    bool updateOk;
+} captured_frame_t;
+
+// Native acquisition thread and the ring it publishes into
+std::thread captureThread;
+std::atomic<bool> captureThreadRunning(false);
+std::atomic<bool> captureThreadFailed(false);
+std::atomic<bool> resetRequested(false);
+
+FrameRing<captured_frame_t, 3> frameRing;
+// Written instead of a ring slot when Unity has not drained the ring
+captured_frame_t droppedFrame;
+
+// Background cloud extraction, run alongside the capture thread.
+// Woken after each update, it extracts once enough frames were integrated and the rate limit allows
+std::thread cloudThread;
+std::atomic<bool> cloudThreadRunning(false);
+std::mutex cloudWakeMutex;
+std::condition_variable cloudWake;
+std::atomic<float> cloudMaxRateHz(4.f);
+std::atomic<int> cloudMinIntegratedFrames(1);
+
+// Preview renders, run by requestPreview on a thread of their own. Everything below is guarded by previewMutex
+std::thread previewThread;
+std::mutex previewMutex;
+std::condition_variable previewWake;
+bool previewThreadRunning = false;
+bool previewRequested = false;
+int previewWidth = 0;
+int previewHeight = 0;
+bool previewAtCurrentPose = true;
+Matx44f previewPose;
+// Newest finished render as RGBA32, its size, and how many renders finished / were polled
+std::vector<uint8_t> previewImage;
+int previewImageWidth = 0;
+int previewImageHeight = 0;
+uint64_t previewRendered = 0;
+uint64_t previewPolled = 0;
+
+// Volume the next startKinectFusion creates, only touched by the Unity thread
+kinfu_volume_params_t volumeParams = { KINFU_VOLUME_TSDF, 0.f, 0, 0, 0.f };
+
+// KinFu's TsdfVoxel is an int8 distance and a uint8 weight
+const int TSDF_VOXEL_BYTES = 2;
+
+// ColoredKinFu's RGBTsdfVoxel adds int16 r, g and b
+const int COLORED_TSDF_VOXEL_BYTES = 8;
+
+// KinFu always builds hash volumes from units of 16 x 16 x 16 voxels, LargeKinfu submaps can use others
+const int HASH_UNIT_RESOLUTION = 16;
+
+// Whether a volume type is a fixed cube of voxels, sized by volume_resolution
+inline bool denseVolume(int volumeType)
+{
+    return volumeType == KINFU_VOLUME_TSDF || volumeType == KINFU_VOLUME_COLORED_TSDF;
+}
+
+// Volume the running KinFu was started with, zero fields resolved to what it uses
+kinfu_volume_params_t startedVolume = {};
+
+// LargeKinfu reads back and raycasts only the current submap, in that submap's own frame, while its
+// pose is global. The two only line up until the first new submap, and the submap poses are private
+inline bool submapLocalVolume()
+{
+    return startedVolume.volume_type == KINFU_VOLUME_SUBMAPS;
+}
+
+// Adaptive quality controller and the level changes Unity has not polled yet
+std::mutex qualityMutex;
+QualityController quality;
+std::deque<kinfu_quality_event_t> qualityEvents;
+const size_t MAX_QUALITY_EVENTS = 64;
+
+// Frame stride of the current quality level
+std::atomic<int> frameStride(1);
+// Frames skipped since the last fused one, only touched by the capture path
+int framesSinceFused = 0;
+
+// Largest preview either way, KinFu renders at the depth resolution and this is only resized from it
+const int MAX_PREVIEW_SIZE = 4096;
 
 ///
 ///
@@ -57,17 +247,107 @@ void registerPrintMessageCallback(PrintMessageCallback callback, int level)
 ///
 
 /// <summary>
-/// Capture color image from Kinect
+/// Read the next capture that has a depth image from the recording,
+/// first sleeping to keep the recorded frame timing when playing back in real time
+/// </summary>
+k4a_wait_result_t getNextPlaybackCapture(k4a_capture_t *capture)
+{
+    while (true)
+    {
+        switch (k4a_playback_get_next_capture(playback, capture))
+        {
+        case K4A_STREAM_RESULT_SUCCEEDED:
+            break;
+        case K4A_STREAM_RESULT_EOF:
+            PrintMessage(K4A_LOG_LEVEL_INFO, "Reached the end of the recording\n");
+            playbackFinished = true;
+            return K4A_WAIT_RESULT_FAILED;
+
+        default:
+            PrintMessage(K4A_LOG_LEVEL_CRITICAL, "Failed to read a capture from the recording\n");
+            return K4A_WAIT_RESULT_FAILED;
+        }
+
+        // Recordings can hold captures with only a color image, fusion has no use for those
+        k4a_image_t depth_image = k4a_capture_get_depth_image(*capture);
+        if (depth_image == NULL)
+        {
+            k4a_capture_release(*capture);
+            *capture = NULL;
+            continue;
+        }
+
+        const int64_t timestamp = (int64_t)k4a_image_get_device_timestamp_usec(depth_image);
+        k4a_image_release(depth_image);
+
+        if (playbackRealtime)
+        {
+            if (playbackStartTimestamp < 0)
+            {
+                playbackStartTime = std::chrono::steady_clock::now();
+                playbackStartTimestamp = timestamp;
+            }
+            else
+            {
+                std::this_thread::sleep_until(playbackStartTime +
+                                              std::chrono::microseconds(timestamp - playbackStartTimestamp));
+            }
+        }
+
+        return K4A_WAIT_RESULT_SUCCEEDED;
+    }
+}
+
+/// <summary>
+/// Get the next capture from the recording if one is being played back, otherwise from the device
+/// </summary>
+k4a_wait_result_t getNextCapture(k4a_capture_t *capture)
+{
+    StageTimer timer(KINFU_STAGE_CAPTURE);
+
+    k4a_wait_result_t result = playback != NULL ? getNextPlaybackCapture(capture)
+                                                : k4a_device_get_capture(device, capture, TIMEOUT_IN_MS);
+
+    switch (result)
+    {
+    case K4A_WAIT_RESULT_SUCCEEDED:
+        increment_counter(COUNTER_FRAMES);
+        break;
+    case K4A_WAIT_RESULT_TIMEOUT:
+        increment_counter(COUNTER_CAPTURE_TIMEOUTS);
+        break;
+
+    case K4A_WAIT_RESULT_FAILED:
+        // Running out of recording is not a failure
+        if (!playbackFinished)
+            increment_counter(COUNTER_CAPTURE_FAILURES);
+        if (playback == NULL)
+            PrintMessage(K4A_LOG_LEVEL_CRITICAL, "Failed to read a capture\n");
+        break;
+    }
+
+    return result;
+}
+
+///
+///
+
+/// <summary>
+/// Connect to the default device, configure it with profile (the last one set if NULL) and start the cameras
 /// </summary>
 /// <returns>Status of the update
 /// 0: Connected and started OK
 /// -1: Failed to connect to Default device
 /// -2: Failed to setup and calibrate
 /// -3: Failed to start the device cameras
+/// -4: The profile is not supported by the device
 /// </returns>
 
-int connectAndStartCameras()
+int connectAndStartCameras(const kinfu_capture_profile_t *profile)
 {
+    if (profile != NULL && !setCaptureProfile(profile))
+        return -4;
+
     if (!connectToDefaultDevice())
         return -1;
     if (!setupConfigAndCalibrate())
@@ -78,12 +358,101 @@ int connectAndStartCameras()
     return 0;
 }
 
+/// <summary>
+/// Number of frame pool re-allocations since the cameras started.
+/// Stays constant once the pool is warm. It does not see allocations inside OpenCV or k4a,
+/// or the clouds and LODs built by each extraction
+/// </summary>
+uint64_t getAllocationCount()
+{
+    return pipelineAllocations;
+}
+
+/// <summary>
+/// Copy the per-stage timings and counters, without blocking the capture thread
+/// </summary>
+void getPipelineStats(kinfu_pipeline_stats_t *stats)
+{
+    get_stats(stats);
+}
+
+/// <summary>
+/// Clear the per-stage timings and counters
+/// </summary>
+void resetPipelineStats()
+{
+    reset_stats();
+}
+
+/// <summary>
+/// Turn stage timing on or off. Counters are kept either way
+/// </summary>
+void setPipelineStatsEnabled(bool enabled)
+{
+    set_stats_enabled(enabled);
+}
+
+/// <summary>
+/// Turn trace event recording on or off.
+/// The per-thread buffers are allocated the first time it is turned on, recording itself never allocates
+/// </summary>
+void setTracingEnabled(bool enabled)
+{
+    set_trace_enabled(enabled);
+}
+
+/// <summary>
+/// Write the recorded trace events as a Chrome Trace Event JSON file,
+/// for chrome://tracing or ui.perfetto.dev. Recording carries on while it is written
+/// </summary>
+/// <returns>Number of events written, or -1 if the file could not be written</returns>
+int writeTrace(const char *path)
+{
+    const int events = write_trace(path);
+    if (events < 0)
+        PrintMessage(K4A_LOG_LEVEL_ERROR, "Failed to write trace file\n");
+
+    return events;
+}
+
+/// <summary>
+/// Drop every recorded trace event
+/// </summary>
+void clearTrace()
+{
+    clear_trace();
+}
+
+/// <summary>
+/// Choose whether color images are flipped vertically for Unity textures
+/// </summary>
+void setColorImageFlip(bool flip)
+{
+    flipColorImage = flip;
+}
+
+/// <summary>
+/// Take a reference to the running KinectFusion, NULL before it starts.
+/// A quality rebuild replaces kf on the capture thread, so other threads read it through this
+/// and the backend they got stays alive until they are done with it
+/// </summary>
+Ptr<FusionBackend> currentFusion()
+{
+    std::lock_guard<std::mutex> volume(volumeMutex);
+    return kf;
+}
+
 /// <summary>
 /// Capture camera 6DOF matrix from last capture frame
 /// </summary>
 void requestPose(unsigned char *matrix_data)
 {
-    auto pose = kf->getPose();
+    // The capture thread moves the pose with every update
+    Affine3f pose;
+    {
+        std::lock_guard<std::mutex> volume(volumeMutex);
+        pose = kf->getPose();
+    }
     memcpy(matrix_data, pose.matrix.val, sizeof(float) * 16);
 }
 
@@ -96,187 +465,1196 @@ void requestPose(unsigned char *matrix_data)
 /// </returns>
 bool captureColorImage(k4a_capture_t capture, unsigned char *data)
 {
+    StageTimer timer(KINFU_STAGE_COLOR);
+
     // Retrieve color image
     k4a_image_t color_image = k4a_capture_get_color_image(capture);
     if (color_image == NULL)
     {
         PrintMessage(K4A_LOG_LEVEL_WARNING, "No color image fetched\n");
+        increment_counter(COUNTER_COLOR_FAILURES);
         return false;
     }
 
-    // Create frame from color buffer
+    const k4a_image_format_t format = k4a_image_get_format(color_image);
+    const int width = k4a_image_get_width_pixels(color_image);
+    const int height = k4a_image_get_height_pixels(color_image);
+    const int stride = k4a_image_get_stride_bytes(color_image);
     uint8_t *buffer = k4a_image_get_buffer(color_image);
 
-    //
-    // image comes in upside down for our case
-    // So we read it backwards and add into a new buffer
-    size_t size = k4a_image_get_size(color_image);
+    if (format == K4A_IMAGE_FORMAT_COLOR_BGRA32)
+    {
+        // Swizzle BGRA into RGBA straight into the caller's buffer.
+        // The image comes in upside down for Unity, so optionally flip it on the way
+        swizzle_bgra_to_rgba(buffer, stride, data, width, height, flipColorImage);
+    }
+    else if (format == K4A_IMAGE_FORMAT_COLOR_NV12 || format == K4A_IMAGE_FORMAT_COLOR_YUY2)
+    {
+        // Convert YUV straight into the caller's buffer as well, then flip it in place
+        Mat rgba(height, width, CV_8UC4, data);
+        if (format == K4A_IMAGE_FORMAT_COLOR_NV12)
+            cvtColor(Mat(height * 3 / 2, width, CV_8UC1, buffer, stride), rgba, COLOR_YUV2RGBA_NV12);
+        else
+            cvtColor(Mat(height, width, CV_8UC2, buffer, stride), rgba, COLOR_YUV2RGBA_YUY2);
+
+        if (flipColorImage)
+            flip(rgba, rgba, 0);
+    }
+    else
+    {
+        PrintMessage(K4A_LOG_LEVEL_WARNING, "Color image is not BGRA32, NV12 or YUY2\n");
+        k4a_image_release(color_image);
+        increment_counter(COUNTER_COLOR_FAILURES);
+        return false;
+    }
+
+    k4a_image_release(color_image);
 
-    // This should be smarter (i.e stride / width to get bytes per pixel)
-    // But I want something now and I know it's 4 bytes
-    uint8_t *flipped = new uint8_t[size];
-    std::memset(flipped, 0x0, size);
+    return true;
+}
 
-    for (int i = 0; i < size - 4; i += 4)
+/// <summary>
+/// Choose the layout capturePointCloud and pollFrame write points in:
+/// 3 floats per point (x, y, z) or 4 (x, y, z, 1).
+/// Cannot be changed while the capture thread is running, its buffers are sized for the current layout
+/// </summary>
+/// <returns>true if the layout was applied</returns>
+bool setPointCloudLayout(int floatsPerPoint)
+{
+    if (floatsPerPoint != CLOUD_LAYOUT_XYZ && floatsPerPoint != CLOUD_LAYOUT_XYZW)
     {
-        // Blue Channel
-        flipped[i + 2] = buffer[i + 0];
-        // Green
-        flipped[i + 1] = buffer[i + 1];
-        // Red (because the image is in BGRA not RGBA)
-        flipped[i + 0] = buffer[i + 2];
-        // Alpha
-        flipped[i + 3] = buffer[i + 3];
+        PrintMessage(K4A_LOG_LEVEL_ERROR, "Point cloud layout must be 3 or 4 floats per point\n");
+        return false;
     }
 
-    std::memcpy(data, flipped, size);
-
-    delete[] flipped;
-    k4a_image_release(color_image);
+    if (captureThreadRunning)
+    {
+        PrintMessage(K4A_LOG_LEVEL_ERROR, "Stop the capture thread before changing the point cloud layout\n");
+        return false;
+    }
 
+    cloudLayout = (cloud_layout_t)floatsPerPoint;
     return true;
 }
 
 /// <summary>
-/// Capture the point cloud from the last Kinect Fusion frame
-/// Will only store up to a max of 1,000,000 3D points
+/// Whether a cloud was built with exactly these LODs
 /// </summary>
-/// <param name="point_data">Pointer to memory to store the data</param>
-/// <returns>Size of the points rendered</returns>
-int capturePointCloud(unsigned char *point_data)
+bool lodsMatch(const cloud_snapshot_t &cloud, const std::vector<float> &cellSizes)
 {
-    // get cloud
-    Mat points, normals;
-    kf->getCloud(points, normals);
+    if (cloud.lods.size() != cellSizes.size())
+        return false;
 
-    int size = points.rows;
-    memset(point_data, 0x0, maxPoints);
-    memset(out_normals, 0x0, maxPoints);
+    for (size_t i = 0; i < cellSizes.size(); i++)
+    {
+        if (cloud.lods[i]->cell_size != cellSizes[i])
+            return false;
+    }
 
-    if (size > maxPoints)
+    return true;
+}
+
+/// <summary>
+/// Set the voxel-grid LODs built alongside every extracted cloud, one per cell size.
+/// Each level keeps one point per cell and is filtered from the level before it, so all of them
+/// come from a single getCloud pass. Takes effect from the next extraction
+/// </summary>
+/// <param name="cellSizes">Cell size of each level in metres, increasing</param>
+/// <param name="count">Number of levels, up to 4, or 0 for none</param>
+/// <returns>true if the levels were applied</returns>
+bool setPointCloudLods(const float *cellSizes, int count)
+{
+    if (count < 0 || count > CLOUD_MAX_LODS)
     {
         std::stringstream error;
-        error << "Cloud Size exceeds max points!! " << size << " vs " << maxPoints << std::endl;
-        PrintMessage(K4A_LOG_LEVEL_CRITICAL, error.str().c_str());
-        return -size;
+        error << "Point cloud LOD count must be between 0 and " << CLOUD_MAX_LODS << std::endl;
+        PrintMessage(K4A_LOG_LEVEL_ERROR, error.str().c_str());
+        return false;
     }
 
-    for (int i = 0; i < size; i++)
+    for (int i = 0; i < count; i++)
     {
-        out_points[i * 3 + 0] = points.at<float>(i, 0);
-        out_points[i * 3 + 1] = points.at<float>(i, 1);
-        out_points[i * 3 + 2] = points.at<float>(i, 2);
-
-        //out_normals[i * 3 + 0] = normals.at<float>(i, 0);
-        //out_normals[i * 3 + 1] = normals.at<float>(i, 1);
-        //out_normals[i * 3 + 2] = normals.at<float>(i, 2);
+        if (!(cellSizes[i] > 0.f) || (i > 0 && cellSizes[i] <= cellSizes[i - 1]))
+        {
+            PrintMessage(K4A_LOG_LEVEL_ERROR, "Point cloud LOD cell sizes must be positive and increasing\n");
+            return false;
+        }
     }
 
-    memcpy(point_data, out_points, sizeof(float) * size);
-
-    return size;
+    std::lock_guard<std::mutex> lock(cloudMutex);
+    lodCellSizes.assign(cellSizes, cellSizes + count);
+    return true;
 }
 
 /// <summary>
-/// Update the KinectFusion frame
+/// Choose the level getPointCloudSize pins for copyPointCloud, exportPointCloudVertices
+/// and exportQuantizedPointCloud, so coarse levels can be read often and the full cloud rarely
 /// </summary>
-/// <returns>Status of the update
-/// 1: Update successful
-/// 0: Update unsuccessful, can still process
-/// -2: Fatal issue and close device
-/// </returns>
-bool updateKinectFusion(k4a_capture_t capture)
+/// <param name="level">0 for the full cloud, n for the nth level set by setPointCloudLods</param>
+/// <returns>true if the level exists</returns>
+bool selectPointCloudLod(int level)
 {
-    k4a_image_t depth_image = NULL;
-    k4a_image_t undistorted_depth_image = NULL;
+    {
+        std::lock_guard<std::mutex> lock(cloudMutex);
+        if (level < 0 || level > (int)lodCellSizes.size())
+        {
+            PrintMessage(K4A_LOG_LEVEL_ERROR, "No such point cloud LOD, set the levels with setPointCloudLods\n");
+            return false;
+        }
+    }
 
-    const int width = calibration.depth_camera_calibration.resolution_width;
-    const int height = calibration.depth_camera_calibration.resolution_height;
+    pinnedLod = level;
+    return true;
+}
 
-    // Retrieve depth image
-    depth_image = k4a_capture_get_depth_image(capture);
-    if (depth_image == NULL)
+/// <summary>
+/// Build the depth camera's view frustum as a cull region
+/// </summary>
+/// <param name="pose">4x4 row-major camera to volume matrix, or NULL for the current pose</param>
+/// <param name="near_distance">Closest distance kept, in metres</param>
+/// <param name="far_distance">Furthest distance kept, in metres</param>
+/// <returns>false if KinectFusion has not started or the distances are out of order</returns>
+bool getFrustumCullRegion(const float *pose, float near_distance, float far_distance, kinfu_cull_region_t *region)
+{
+    const Ptr<FusionBackend> fusion = currentFusion();
+    if (fusion == NULL || !(near_distance >= 0.f && far_distance > near_distance))
+        return false;
+
+    // A frustum at a global pose would cut a submap-local cloud in the wrong place
+    if (submapLocalVolume())
     {
-        PrintMessage(K4A_LOG_LEVEL_CRITICAL, "k4a_capture_get_depth_image returned NULL\n");
+        PrintMessage(K4A_LOG_LEVEL_ERROR, "Frustum culling is not available for submap volumes\n");
         return false;
     }
 
-    k4a_image_create(K4A_IMAGE_FORMAT_DEPTH16,
-                     pinhole.width,
-                     pinhole.height,
-                     pinhole.width * (int)sizeof(uint16_t),
-                     &undistorted_depth_image);
+    Matx44f cameraPose;
+    if (pose != NULL)
+    {
+        cameraPose = Matx44f(pose);
+    }
+    else
+    {
+        // The capture thread moves the pose with every update
+        std::lock_guard<std::mutex> volume(volumeMutex);
+        cameraPose = fusion->getPose().matrix;
+    }
 
-    remap(depth_image, lut, undistorted_depth_image, interpolation_type);
+    const kinfu::Params params = fusion->getParams();
+    make_frustum_region(cameraPose, params.intr, params.frameSize, near_distance, far_distance, *region);
+    return true;
+}
 
-    // Create frame from depth buffer
-    uint8_t *buffer = k4a_image_get_buffer(undistorted_depth_image);
-    uint16_t *depth_buffer = reinterpret_cast<uint16_t *>(buffer);
-    UMat undistortedFrame;
-    create_mat_from_buffer(depth_buffer, width, height, 1).copyTo(undistortedFrame);
+/// <summary>
+/// Build an oriented box as a cull region
+/// </summary>
+/// <param name="pose">4x4 row-major box to volume matrix, the box is centred on its origin</param>
+/// <param name="half_extents">Half the box size along its x, y and z axes, in metres</param>
+void getBoxCullRegion(const float *pose, const float *half_extents, kinfu_cull_region_t *region)
+{
+    make_box_region(Matx44f(pose), half_extents, *region);
+}
 
-    if (undistortedFrame.empty())
+/// <summary>
+/// Replace the cloud pinned by getPointCloudSize with its points inside region,
+/// so copyPointCloud and the other exports only read what is visible or in the working area
+/// </summary>
+/// <returns>Number of points left, or -1 if the region has no planes or too many</returns>
+int cullPointCloud(const kinfu_cull_region_t *region)
+{
+    if (region->plane_count < 1 || region->plane_count > KINFU_MAX_CULL_PLANES)
     {
-        PrintMessage(K4A_LOG_LEVEL_CRITICAL, "Undistorted frame is empty\n");
-        k4a_image_release(depth_image);
-        k4a_image_release(undistorted_depth_image);
-        return false;
+        PrintMessage(K4A_LOG_LEVEL_ERROR, "Cull region needs 1 to 8 planes\n");
+        return -1;
     }
 
-    // Update KinectFusion
-    if (!kf->update(undistortedFrame))
+    if (!pinnedCloud)
+        return 0;
+
+    StageTimer timer(KINFU_STAGE_EXPORT);
+    std::shared_ptr<cloud_snapshot_t> culled = std::make_shared<cloud_snapshot_t>();
+    cull_cloud(*pinnedCloud, *region, *culled);
+
+    pinnedCloud = culled;
+    return pinnedCloud->points.rows;
+}
+
+/// <summary>
+/// Extract the cloud of the current volume, or reuse the cached one if nothing was fused since.
+/// Safe to call from any thread, it waits for an update in progress to finish
+/// </summary>
+std::shared_ptr<cloud_snapshot_t> extractPointCloud()
+{
+    std::vector<float> cellSizes;
+    float blockSize;
     {
-        PrintMessage(K4A_LOG_LEVEL_INFO, "Did not update from frame\n");
-        //        kf->reset();
-        k4a_image_release(depth_image);
-        k4a_image_release(undistorted_depth_image);
-        return false;
+        std::lock_guard<std::mutex> lock(cloudMutex);
+        cellSizes = lodCellSizes;
+        blockSize = cloudBlockSize;
+
+        const bool hasNormals = !latestCloud || latestCloud->normals.rows == latestCloud->points.rows;
+        if (latestCloud && latestCloud->generation == fusionGeneration && (hasNormals || !cloudNormals) &&
+            lodsMatch(*latestCloud, cellSizes) && latestCloud->block_size == blockSize)
+            return latestCloud;
     }
 
-    k4a_image_release(depth_image);
-    k4a_image_release(undistorted_depth_image);
+    std::shared_ptr<cloud_snapshot_t> cloud = std::make_shared<cloud_snapshot_t>();
+    Mat colors;
+    {
+        StageTimer timer(KINFU_STAGE_GET_CLOUD);
+        {
+            std::lock_guard<std::mutex> volume(volumeMutex);
+            cloud->generation = fusionGeneration;
+
+            // Unless they were asked for, skip the normals getCloud would also compute.
+            // Colors only come with getCloud, so colored volumes always get normals too
+            if (kf->hasColor())
+                kf->getCloud(cloud->points, cloud->normals, colors);
+            else if (cloudNormals)
+                kf->getCloud(cloud->points, cloud->normals);
+            else
+                kf->getPoints(cloud->points);
+        }
+
+        if (!colors.empty())
+        {
+            cloud->colors.create(colors.rows, 1, CV_8UC4);
+            pack_point_colors(colors.ptr<float>(), colors.rows, cloud->colors.ptr<uint8_t>());
+        }
+
+        // Blocks and LODs only read the extracted cloud, so the next update can use the volume meanwhile
+        if (blockSize > 0.f)
+        {
+            partition_cloud_blocks(*cloud, blockSize);
+
+            std::lock_guard<std::mutex> lock(blockHistoryMutex);
+            update_block_history(blockHistory, *cloud);
+        }
+
+        build_cloud_lods(*cloud, cellSizes.data(), (int)cellSizes.size());
+    }
 
-    return true;
+    std::lock_guard<std::mutex> lock(cloudMutex);
+    latestCloud = cloud;
+    return cloud;
 }
 
 /// <summary>
-/// Combine Colour image capture, frame update, point cloud capture,
-/// and pose fetchin a single call
+/// Capture the point cloud from the last Kinect Fusion frame
+/// Will only store up to a max of 1,000,000 3D points, written in the layout set by setPointCloudLayout
 /// </summary>
-/// <returns>Status of the update
-/// 1: Update successful
-/// 0: Update unsuccessful, can still process
-/// -2: Fatal issue and close device
-/// </returns>
-int captureFrame(
-    unsigned char *color_data,
-    unsigned char *point_data,
-    unsigned char *matrix_data)
+/// <param name="point_data">Pointer to memory to store the data, or NULL to only count the points</param>
+/// <returns>Size of the points rendered, negative if it did not fit</returns>
+int capturePointCloud(unsigned char *point_data)
 {
-    k4a_capture_t capture = NULL;
+    std::shared_ptr<cloud_snapshot_t> cloud = extractPointCloud();
+
+    StageTimer timer(KINFU_STAGE_EXPORT);
+
+    int size = cloud->points.rows;
+    if (point_data == NULL)
+        return size;
 
-    switch (k4a_device_get_capture(device, &capture, TIMEOUT_IN_MS))
+    if (size > maxPoints)
     {
-    case K4A_WAIT_RESULT_SUCCEEDED:
-        break;
-    case K4A_WAIT_RESULT_TIMEOUT:
-        PrintMessage(K4A_LOG_LEVEL_INFO, "Timed out waiting for a capture\n");
-        return 0;
+        std::stringstream error;
+        error << "Cloud Size exceeds max points!! " << size << " vs " << maxPoints
+              << ", read it with getPointCloudSize and copyPointCloud" << std::endl;
+        PrintMessage(K4A_LOG_LEVEL_CRITICAL, error.str().c_str());
+        return -size;
+    }
 
-    case K4A_WAIT_RESULT_FAILED:
-        PrintMessage(K4A_LOG_LEVEL_CRITICAL, "Failed to read a capture\n");
-        closeDevice();
-        return -2;
+    // Convert in one pass straight into the caller's buffer
+    export_cloud_range(*cloud, 0, size, reinterpret_cast<float *>(point_data), cloudLayout);
+
+    return size;
+}
+
+/// <summary>
+/// The newest full point cloud, the capture thread's or one extracted now if the volume changed since the last one
+/// </summary>
+std::shared_ptr<cloud_snapshot_t> newestCloud()
+{
+    if (captureThreadRunning)
+    {
+        std::lock_guard<std::mutex> lock(cloudMutex);
+        return latestCloud;
     }
 
-    bool colorOk = captureColorImage(capture, color_data);
-    bool updateOk = updateKinectFusion(capture);
-    int numPoints = 0;
+    return currentFusion() != NULL ? extractPointCloud() : nullptr;
+}
+
+/// <summary>
+/// Pin the newest point cloud, at the level chosen by selectPointCloudLod, for copyPointCloud and report its size.
+/// Without the capture thread this extracts the cloud if the volume changed since the last one
+/// </summary>
+/// <param name="generation">Set to the fusion generation of the cloud, unchanged generations mean an unchanged cloud</param>
+/// <returns>Number of points in the pinned cloud</returns>
+int getPointCloudSize(uint64_t *generation)
+{
+    pinnedCloud = newestCloud();
+
+    // A cloud extracted before its levels were set falls back to the full cloud
+    if (pinnedCloud && pinnedLod > 0 && pinnedLod <= (int)pinnedCloud->lods.size())
+        pinnedCloud = pinnedCloud->lods[pinnedLod - 1];
+
+    *generation = pinnedCloud ? pinnedCloud->generation : 0;
+
+    return pinnedCloud ? pinnedCloud->points.rows : 0;
+}
+
+/// <summary>
+/// Set the edge of the blocks clouds are partitioned into for getPointCloudDelta, 0 to stop partitioning
+/// </summary>
+/// <returns>False for a size below MIN_BLOCK_SIZE</returns>
+bool setPointCloudBlockSize(float blockSize)
+{
+    if (!(blockSize == 0.f || blockSize >= MIN_BLOCK_SIZE))
+    {
+        std::stringstream error;
+        error << "Point cloud blocks must be 0 or at least " << MIN_BLOCK_SIZE << " m, not " << blockSize << std::endl;
+        PrintMessage(K4A_LOG_LEVEL_ERROR, error.str().c_str());
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(cloudMutex);
+    cloudBlockSize = blockSize;
+    return true;
+}
+
+/// <summary>
+/// Pin the blocks of the newest cloud added or changed after a generation, in place of the cloud,
+/// and list them along with the blocks removed since. Only the full cloud is partitioned, so the LOD is ignored
+/// </summary>
+/// <param name="since">Generation of the last delta applied, 0 for every block</param>
+/// <param name="delta">Filled with the generation to pass next time and the size of the delta</param>
+/// <returns>Number of points pinned, -1 if the newest cloud was extracted without blocks</returns>
+int getPointCloudDelta(uint64_t since, kinfu_cloud_delta_t *delta)
+{
+    memset(delta, 0, sizeof(*delta));
+    delta->since = since;
+    pinnedBlocks.clear();
+
+    pinnedCloud = newestCloud();
+    if (!pinnedCloud)
+        return 0;
+
+    if (pinnedCloud->block_size <= 0.f)
+        return -1;
+
+    StageTimer timer(KINFU_STAGE_EXPORT);
+
+    std::shared_ptr<cloud_snapshot_t> changed = std::make_shared<cloud_snapshot_t>();
+    extract_cloud_delta(*pinnedCloud, since, *changed, pinnedBlocks, *delta);
+
+    pinnedCloud = changed;
+    return pinnedCloud->points.rows;
+}
+
+/// <summary>
+/// Copy the block list of the delta pinned by getPointCloudDelta
+/// </summary>
+/// <param name="blocks">Room for count blocks</param>
+/// <param name="offset">First block to copy</param>
+/// <param name="count">Most blocks to copy</param>
+/// <returns>Number of blocks copied, 0 past the end, -1 for a negative offset or count</returns>
+int copyPointCloudBlocks(kinfu_cloud_block_t *blocks, int offset, int count)
+{
+    if (offset < 0 || count < 0)
+        return -1;
+
+    const int available = std::max((int)pinnedBlocks.size() - offset, 0);
+    count = std::min(count, available);
+    if (count > 0)
+        memcpy(blocks, pinnedBlocks.data() + offset, (size_t)count * sizeof(kinfu_cloud_block_t));
+
+    return count;
+}
+
+/// <summary>
+/// Copy part of the cloud pinned by getPointCloudSize, in the layout set by setPointCloudLayout.
+/// The pinned cloud never changes underneath, so a large cloud can be read in several chunks
+/// </summary>
+/// <param name="point_data">Room for count points</param>
+/// <param name="offset">First point to copy</param>
+/// <param name="count">Most points to copy</param>
+/// <returns>Number of points copied, 0 past the end, -1 for a negative offset or count</returns>
+int copyPointCloud(unsigned char *point_data, int offset, int count)
+{
+    if (!pinnedCloud)
+        return 0;
+
+    StageTimer timer(KINFU_STAGE_EXPORT);
+    return export_cloud_range(*pinnedCloud, offset, count, reinterpret_cast<float *>(point_data), cloudLayout);
+}
+
+/// <summary>
+/// Copy the colors of part of the cloud pinned by getPointCloudSize, point for point with copyPointCloud
+/// </summary>
+/// <param name="color_data">Room for count RGBA32 colors</param>
+/// <param name="offset">First point to copy</param>
+/// <param name="count">Most colors to copy</param>
+/// <returns>Number of colors copied, 0 past the end or without colors, -1 for a negative offset or count</returns>
+int copyPointCloudColors(unsigned char *color_data, int offset, int count)
+{
+    if (offset < 0 || count < 0)
+        return -1;
+
+    if (!pinnedCloud || pinnedCloud->colors.rows != pinnedCloud->points.rows)
+        return 0;
+
+    count = std::min(count, std::max(pinnedCloud->colors.rows - offset, 0));
+    if (count > 0)
+    {
+        StageTimer timer(KINFU_STAGE_EXPORT);
+        memcpy(color_data, pinnedCloud->colors.ptr<uint8_t>(offset), (size_t)count * 4);
+    }
+
+    return count;
+}
+
+/// <summary>
+/// Choose whether point clouds are extracted with their normals (getCloud) or without (getPoints).
+/// Takes effect from the next extraction
+/// </summary>
+void setPointCloudNormals(bool enabled)
+{
+    cloudNormals = enabled;
+}
+
+/// <summary>
+/// Write part of the cloud pinned by getPointCloudSize as interleaved vertices,
+/// flipping it into Unity's axes on the way so the buffer can be uploaded as is
+/// </summary>
+/// <param name="vertex_data">Room for count vertices of format->stride bytes</param>
+/// <param name="offset">First point to write</param>
+/// <param name="count">Most points to write</param>
+/// <param name="format">Layout of one vertex</param>
+/// <returns>Number of vertices written, 0 past the end, -1 if the format or range is invalid</returns>
+int exportPointCloudVertices(unsigned char *vertex_data, int offset, int count, const kinfu_vertex_format_t *format)
+{
+    const char *error = NULL;
+    if (!validate_vertex_format(*format, &error))
+    {
+        std::stringstream message;
+        message << error << std::endl;
+        PrintMessage(K4A_LOG_LEVEL_ERROR, message.str().c_str());
+        return -1;
+    }
+
+    if (!pinnedCloud)
+        return 0;
+
+    if (format->normal_offset >= 0 && pinnedCloud->normals.rows != pinnedCloud->points.rows)
+    {
+        PrintMessage(K4A_LOG_LEVEL_ERROR, "Vertex format has normals, call setPointCloudNormals(true) first\n");
+        return -1;
+    }
+
+    StageTimer timer(KINFU_STAGE_EXPORT);
+    return export_cloud_vertices(*pinnedCloud, offset, count, vertex_data, *format);
+}
+
+/// <summary>
+/// Quantize the cloud pinned by getPointCloudSize onto a 16-bit grid spanning the volume,
+/// with octahedral normals if asked for. The header reports the error that introduced
+/// </summary>
+/// <param name="data">Room for capacity bytes</param>
+/// <param name="capacity">Size of data in bytes</param>
+/// <param name="flags">kinfu_quantized_flags_t to include</param>
+/// <param name="header">Filled with the grid, point count and errors needed to decode data</param>
+/// <returns>Bytes written, 0 if there is no cloud or normals were asked for without setPointCloudNormals(true),
+/// or minus the bytes needed if capacity is too small</returns>
+int exportQuantizedPointCloud(unsigned char *data, int capacity, int flags, kinfu_quantized_cloud_t *header)
+{
+    memset(header, 0, sizeof(*header));
+
+    const Ptr<FusionBackend> fusion = currentFusion();
+    if (!pinnedCloud || fusion == NULL)
+        return 0;
+
+    const int count = pinnedCloud->points.rows;
+    if ((flags & KINFU_QUANTIZED_COLORS) && pinnedCloud->colors.rows != count)
+    {
+        PrintMessage(K4A_LOG_LEVEL_WARNING, "Only colored volumes have point colors, exporting without them\n");
+        flags &= ~KINFU_QUANTIZED_COLORS;
+    }
+
+    if ((flags & KINFU_QUANTIZED_NORMALS) && pinnedCloud->normals.rows != count)
+    {
+        PrintMessage(K4A_LOG_LEVEL_ERROR, "Quantized normals need setPointCloudNormals(true) first\n");
+        return 0;
+    }
+
+    const size_t needed = quantized_cloud_size(count, flags);
+    if (needed > (size_t)std::max(capacity, 0))
+        return -(int)needed;
+
+    const kinfu::Params params = fusion->getParams();
+    float min[3] = { FLT_MAX, FLT_MAX, FLT_MAX };
+    float max[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+    if (!denseVolume(startedVolume.volume_type))
+    {
+        // Hash volumes and submaps have no edges, so the grid spans the cloud itself
+        for (int i = 0; i < count; i++)
+        {
+            const float *point = pinnedCloud->points.ptr<float>(i);
+            for (int c = 0; c < 3; c++)
+            {
+                min[c] = std::min(min[c], point[c]);
+                max[c] = std::max(max[c], point[c]);
+            }
+        }
+    }
+    else
+    {
+        // Every fused point lies inside the volume, so its bounding box in world space is the grid
+        const cv::Vec3f extent = cv::Vec3f(params.volumeDims) * params.voxelSize;
+        for (int corner = 0; corner < 8; corner++)
+        {
+            const cv::Vec3f local((corner & 1) ? extent[0] : 0.f, (corner & 2) ? extent[1] : 0.f, (corner & 4) ? extent[2] : 0.f);
+            const cv::Vec3f world = params.volumePose * local;
+            for (int c = 0; c < 3; c++)
+            {
+                min[c] = std::min(min[c], world[c]);
+                max[c] = std::max(max[c], world[c]);
+            }
+        }
+    }
+
+    header->flags = (uint32_t)flags;
+    set_quantized_bounds(min, max, header);
+
+    StageTimer timer(KINFU_STAGE_EXPORT);
+    encode_quantized_cloud(pinnedCloud->points.ptr<float>(),
+        (flags & KINFU_QUANTIZED_NORMALS) ? pinnedCloud->normals.ptr<float>() : NULL,
+        (flags & KINFU_QUANTIZED_COLORS) ? pinnedCloud->colors.ptr<uint8_t>() : NULL, count, data, header);
+
+    return (int)needed;
+}
+
+/// <summary>
+/// Decode a cloud from exportQuantizedPointCloud
+/// </summary>
+/// <param name="points">Room for header->count x, y, z floats</param>
+/// <param name="normals">Room for header->count x, y, z floats, or NULL to skip normals</param>
+/// <param name="colors">Room for header->count RGBA32 colors, or NULL to skip colors</param>
+/// <returns>Number of points decoded</returns>
+int decodeQuantizedPointCloud(const unsigned char *data, const kinfu_quantized_cloud_t *header,
+    float *points, float *normals, unsigned char *colors)
+{
+    decode_quantized_cloud(data, *header, points, normals, colors);
+    return (int)header->count;
+}
+
+/// <summary>
+/// Size of the organized maps exportDepthFrameCloud writes at a downsample factor
+/// </summary>
+/// <returns>false if KinectFusion has not started or downsample is not 1 to 8</returns>
+bool getDepthFrameCloudSize(int downsample, int *width, int *height)
+{
+    const Ptr<FusionBackend> fusion = currentFusion();
+    if (fusion == NULL || downsample < 1 || downsample > 8)
+        return false;
+
+    const Size size = organized_map_size(fusion->getParams().frameSize, downsample);
+    *width = size.width;
+    *height = size.height;
+    return true;
+}
+
+/// <summary>
+/// Write the newest fused depth frame as organized vertex and normal maps in volume coordinates.
+/// Vertices are the raw depth back-projected at the pose the frame was fused at, not a raycast of the
+/// fused surface: KinFu keeps its volume and raycasts to itself, so there is none to ask for at another
+/// pose. Normals come from the volume at those vertices. The cost depends on the sensor resolution and
+/// not on how much has been scanned
+/// </summary>
+/// <param name="points">Room for width x height float4 from getDepthFrameCloudSize</param>
+/// <param name="normals">Same size as points, or NULL to skip the normals</param>
+/// <param name="downsample">Keep every nth pixel on both axes, 1 to 8</param>
+/// <param name="pose">Set to the 4x4 row-major camera pose of the frame if not NULL</param>
+/// <returns>Number of pixels written, 0 until a frame has been fused since the first call, -1 for a bad downsample</returns>
+int exportDepthFrameCloud(float *points, float *normals, int downsample, float *pose)
+{
+    int width, height;
+    if (!getDepthFrameCloudSize(downsample, &width, &height))
+    {
+        PrintMessage(K4A_LOG_LEVEL_ERROR, "Depth frame cloud downsample must be 1 to 8, after KinectFusion has started\n");
+        return -1;
+    }
+
+    // The vertices are at the global pose, the submap's normals would be looked up in its own frame
+    if (normals != NULL && submapLocalVolume())
+    {
+        PrintMessage(K4A_LOG_LEVEL_ERROR, "Depth frame cloud normals are not available for submap volumes\n");
+        return -1;
+    }
+
+    // Start keeping frames, the next fused one can be exported
+    keepLatestDepth = true;
+
+    StageTimer timer(KINFU_STAGE_EXPORT);
+    const kinfu::Params params = currentFusion()->getParams();
+    Mat pointMap(height, width, CV_32FC4, points);
+    {
+        std::lock_guard<std::mutex> lock(depthMutex);
+        if (latestDepth.empty())
+            return 0;
+
+        backproject_depth(latestDepth, params.intr, params.depthFactor, latestDepthPose, downsample, points);
+        if (pose != NULL)
+            memcpy(pose, latestDepthPose.val, sizeof(float) * 16);
+    }
+
+    if (normals != NULL)
+    {
+        // Writes straight into the caller's buffer, which already has the size and type asked for
+        Mat normalMap(height, width, CV_32FC4, normals);
+        std::lock_guard<std::mutex> volume(volumeMutex);
+        kf->getNormals(pointMap, normalMap);
+    }
+
+    return width * height;
+}
+
+/// <summary>
+/// Shade the volume with KinFu::render and write it as RGBA32, resized to width x height and flipped like the color image
+/// </summary>
+/// <param name="pose">Camera to volume pose to render from, or NULL for the current pose</param>
+/// <param name="rendered">Reused buffer for KinFu's render at the depth resolution</param>
+/// <param name="resized">Reused buffer for the resize</param>
+void renderVolume(int width, int height, const Matx44f *pose, Mat &rendered, Mat &resized, uint8_t *rgba)
+{
+    {
+        // Raycasting reads the volume, so it takes its turn with the updates
+        std::lock_guard<std::mutex> volume(volumeMutex);
+        if (pose != NULL)
+            kf->render(rendered, *pose);
+        else
+            kf->render(rendered);
+    }
+
+    Mat bgra = rendered;
+    if (rendered.cols != width || rendered.rows != height)
+    {
+        resize(rendered, resized, Size(width, height), 0, 0, width < rendered.cols ? INTER_AREA : INTER_LINEAR);
+        bgra = resized;
+    }
+
+    swizzle_bgra_to_rgba(bgra.ptr<uint8_t>(), (int)bgra.step, rgba, width, height, flipColorImage);
+    set_opaque_alpha(rgba, width * height);
+}
+
+bool validPreviewSize(int width, int height)
+{
+    if (width < 1 || height < 1 || width > MAX_PREVIEW_SIZE || height > MAX_PREVIEW_SIZE)
+    {
+        PrintMessage(K4A_LOG_LEVEL_ERROR, "Preview size must be between 1 and 4096 pixels either way\n");
+        return false;
+    }
+
+    return true;
+}
+
+bool validPreviewPose(const float *pose)
+{
+    // LargeKinfu would raycast its current submap as if the pose were in that submap's frame
+    if (pose != NULL && submapLocalVolume())
+    {
+        PrintMessage(K4A_LOG_LEVEL_ERROR, "Submap volumes only render from the current pose\n");
+        return false;
+    }
+
+    return true;
+}
+
+/// <summary>
+/// Render a shaded preview of the volume into a texture buffer, without pulling any geometry across.
+/// Blocks until done, use requestPreview to render on a worker instead
+/// </summary>
+/// <param name="rgba">Room for width x height RGBA32 pixels</param>
+/// <param name="pose">4x4 row-major camera to volume pose, or NULL for the current pose</param>
+/// <returns>1 if rendered, 0 if KinectFusion has not started, -1 for a bad size or a pose with submaps</returns>
+int renderPreview(unsigned char *rgba, int width, int height, const float *pose)
+{
+    if (!validPreviewSize(width, height) || !validPreviewPose(pose))
+        return -1;
+
+    if (currentFusion() == NULL)
+        return 0;
+
+    TraceScope scope("preview");
+    Mat rendered, resized;
+    const Matx44f cameraPose = pose != NULL ? Matx44f(pose) : Matx44f::eye();
+    renderVolume(width, height, pose != NULL ? &cameraPose : NULL, rendered, resized, rgba);
+    return 1;
+}
+
+void previewThreadLoop()
+{
+    trace_set_thread_name("KinFu preview");
+
+    Mat rendered, resized;
+    std::vector<uint8_t> rgba;
+
+    std::unique_lock<std::mutex> lock(previewMutex);
+    while (true)
+    {
+        previewWake.wait(lock, []() { return !previewThreadRunning || previewRequested; });
+        if (!previewThreadRunning)
+            break;
+
+        const int width = previewWidth, height = previewHeight;
+        const bool atCurrentPose = previewAtCurrentPose;
+        const Matx44f pose = previewPose;
+        previewRequested = false;
+
+        lock.unlock();
+        rgba.resize((size_t)width * height * 4);
+        {
+            TraceScope scope("preview");
+            renderVolume(width, height, atCurrentPose ? NULL : &pose, rendered, resized, rgba.data());
+        }
+        lock.lock();
+
+        // Hand the finished image over and keep the old one's memory for the next render
+        previewImage.swap(rgba);
+        previewImageWidth = width;
+        previewImageHeight = height;
+        previewRendered++;
+    }
+}
+
+void stopPreviewThread()
+{
+    {
+        std::lock_guard<std::mutex> lock(previewMutex);
+        previewThreadRunning = false;
+    }
+    previewWake.notify_one();
+
+    if (previewThread.joinable())
+        previewThread.join();
+}
+
+/// <summary>
+/// Ask the preview thread to render, replacing a request it has not started yet.
+/// The thread starts on the first request and keeps the volume to itself only while raycasting
+/// </summary>
+/// <param name="pose">4x4 row-major camera to volume pose, or NULL for the pose when the render starts</param>
+/// <returns>false if KinectFusion has not started or the size is bad</returns>
+bool requestPreview(int width, int height, const float *pose)
+{
+    if (!validPreviewSize(width, height) || !validPreviewPose(pose) || currentFusion() == NULL)
+        return false;
+
+    {
+        std::lock_guard<std::mutex> lock(previewMutex);
+        previewWidth = width;
+        previewHeight = height;
+        previewAtCurrentPose = pose == NULL;
+        if (pose != NULL)
+            previewPose = Matx44f(pose);
+        previewRequested = true;
+
+        if (!previewThreadRunning)
+        {
+            previewThreadRunning = true;
+            previewThread = std::thread(previewThreadLoop);
+        }
+    }
+    previewWake.notify_one();
+
+    return true;
+}
+
+/// <summary>
+/// Copy the newest render from requestPreview, if it is newer than the last one copied
+/// </summary>
+/// <param name="rgba">Room for width x height RGBA32 pixels</param>
+/// <returns>1 if a new image was copied, 0 if there is none yet, -1 if it is not width x height</returns>
+int pollPreview(unsigned char *rgba, int width, int height)
+{
+    std::lock_guard<std::mutex> lock(previewMutex);
+    if (previewRendered == previewPolled)
+        return 0;
+
+    if (previewImageWidth != width || previewImageHeight != height)
+        return -1;
+
+    memcpy(rgba, previewImage.data(), previewImage.size());
+    previewPolled = previewRendered;
+    return 1;
+}
+
+/// <summary>
+/// Size the volume of KinFu or ColoredKinFu params, keeping their defaults where a field is 0
+/// </summary>
+template <typename KinFuParams>
+void applyVolumeParams(KinFuParams &params, const kinfu_volume_params_t &volume)
+{
+    // KinFu's defaults are a 3 m cube, kept when only the resolution changes
+    const float defaultSize = params.volumeDims[0] * params.voxelSize;
+    if (denseVolume(volume.volume_type) && volume.volume_resolution > 0)
+        params.volumeDims = Vec3i::all(volume.volume_resolution);
+
+    params.voxelSize = volume.voxel_size > 0.f ? volume.voxel_size : defaultSize / params.volumeDims[0];
+    params.tsdf_trunc_dist = volume.truncation_distance > 0.f ? volume.truncation_distance : 7.f * params.voxelSize;
+
+    // Centre the cube in front of the camera as KinFu does, now that its size may have changed
+    const float size = params.volumeDims[0] * params.voxelSize;
+    params.volumePose = Affine3f().translate(Vec3f(-size / 2.f, -size / 2.f, 0.5f));
+}
+
+/// <summary>
+/// Size the submaps of LargeKinfu params, keeping its defaults where a field is 0
+/// </summary>
+void applySubmapParams(large_kinfu::Params &params, const kinfu_volume_params_t &volume)
+{
+    kinfu::VolumeParams &submap = params.volumeParams;
+    if (volume.voxel_size > 0.f)
+        submap.voxelSize = volume.voxel_size;
+    if (volume.unit_resolution > 0)
+        submap.unitResolution = volume.unit_resolution;
+    submap.tsdfTruncDist = volume.truncation_distance > 0.f ? volume.truncation_distance : 7.f * submap.voxelSize;
+}
+
+/// <summary>
+/// Set the tracking and fusion knobs of a quality level on KinFu or ColoredKinFu params
+/// </summary>
+template <typename KinFuParams>
+void applyQualityParams(KinFuParams &params, const kinfu_quality_state_t &knobs)
+{
+    params.icpIterations.assign(knobs.icp_iterations, knobs.icp_iterations + knobs.pyramid_levels);
+    params.pyramidLevels = knobs.pyramid_levels;
+    params.bilateral_kernel_size = knobs.bilateral_kernel_size;
+    params.raycast_step_factor = knobs.raycast_step_factor;
+    params.tsdf_min_camera_movement = knobs.min_camera_movement;
+}
+
+/// <summary>
+/// Set the tracking and fusion knobs of a quality level on LargeKinfu params, whose raycast step is per submap
+/// </summary>
+void applyQualityParams(large_kinfu::Params &params, const kinfu_quality_state_t &knobs)
+{
+    params.icpIterations.assign(knobs.icp_iterations, knobs.icp_iterations + knobs.pyramid_levels);
+    params.pyramidLevels = knobs.pyramid_levels;
+    params.bilateral_kernel_size = knobs.bilateral_kernel_size;
+    params.volumeParams.raycastStepFactor = knobs.raycast_step_factor;
+    params.tsdf_min_camera_movement = knobs.min_camera_movement;
+}
+
+/// <summary>
+/// Create the backend for a volume, its type already resolved, from the pinhole model.
+/// Level 0 keeps each volume type's own defaults, higher levels set their knobs
+/// </summary>
+Ptr<FusionBackend> createFusionBackend(const kinfu_volume_params_t &volume, int qualityLevel)
+{
+    const int width = calibration.depth_camera_calibration.resolution_width;
+    const int height = calibration.depth_camera_calibration.resolution_height;
+    const Matx33f intr(pinhole.fx, 0.0f, pinhole.px, 0.0f, pinhole.fy, pinhole.py, 0.0f, 0.0f, 1.0f);
+
+    kinfu_quality_state_t knobs;
+    get_quality_level(qualityLevel, knobs);
+
+    // Initialize kinfu parameters, a dense cube unless a hash volume, submaps or color were asked for
+    if (volume.volume_type == KINFU_VOLUME_SUBMAPS)
+    {
+        Ptr<large_kinfu::Params> largeParams = large_kinfu::Params::hashTSDFParams(false);
+        applySubmapParams(*largeParams, volume);
+        largeParams->frameSize = Size(width, height);
+        largeParams->intr = intr;
+        largeParams->depthFactor = 1000.0f;
+        if (qualityLevel > 0)
+            applyQualityParams(*largeParams, knobs);
+
+        return create_large_kinfu_backend(largeParams);
+    }
+
+    if (volume.volume_type == KINFU_VOLUME_COLORED_TSDF)
+    {
+        Ptr<colored_kinfu::Params> coloredParams = colored_kinfu::Params::coloredTSDFParams(false);
+        applyVolumeParams(*coloredParams, volume);
+        coloredParams->frameSize = Size(width, height);
+        coloredParams->intr = intr;
+        coloredParams->depthFactor = 1000.0f;
+
+        // Color arrives registered and undistorted onto the depth pinhole, so it shares its size and intrinsics
+        coloredParams->rgb_frameSize = coloredParams->frameSize;
+        coloredParams->rgb_intr = intr;
+        if (qualityLevel > 0)
+            applyQualityParams(*coloredParams, knobs);
+
+        return create_colored_kinfu_backend(coloredParams);
+    }
+
+    Ptr<kinfu::Params> params =
+        volume.volume_type == KINFU_VOLUME_HASH_TSDF ? kinfu::Params::hashTSDFParams(false) : kinfu::Params::defaultParams();
+    applyVolumeParams(*params, volume);
+    initialize_kinfu_params(
+        *params, width, height, pinhole.fx, pinhole.fy, pinhole.px, pinhole.py);
+    if (qualityLevel > 0)
+        applyQualityParams(*params, knobs);
+
+    return create_kinfu_backend(params);
+}
+
+/// <summary>
+/// Reset KinectFusion, recreating it when the quality level has moved since it was created.
+/// Only called by whichever thread owns kf, the capture thread while it runs. The replaced
+/// backend is freed once the last currentFusion reference to it goes
+/// </summary>
+void resetFusion()
+{
+    int level, created;
+    {
+        std::lock_guard<std::mutex> lock(qualityMutex);
+        level = quality.level();
+        created = quality.createdLevel();
+    }
+
+    if (same_creation_knobs(level, created))
+    {
+        std::lock_guard<std::mutex> volume(volumeMutex);
+        kf->reset();
+        fusionGeneration++;
+    }
+    else
+    {
+        // Allocate the new volume before taking the lock, so readers only wait for the swap
+        Ptr<FusionBackend> rebuilt = createFusionBackend(startedVolume, level);
+        std::lock_guard<std::mutex> volume(volumeMutex);
+        kf.swap(rebuilt);
+        fusionGeneration++;
+    }
+
+    std::lock_guard<std::mutex> lock(qualityMutex);
+    quality.setCreatedLevel(level);
+}
+
+/// <summary>
+/// Feed one frame's fusion time to the quality controller, logging any level change it makes.
+/// The frame stride follows at once, the other knobs at the next reset or straight away when rebuilding
+/// </summary>
+void observeFusionTime(float frameMs)
+{
+    kinfu_quality_event_t event;
+    bool rebuild;
+    {
+        std::lock_guard<std::mutex> lock(qualityMutex);
+        if (!quality.observe(frameMs, event))
+            return;
+
+        const bool sameKnobs = same_creation_knobs(event.to_level, quality.createdLevel());
+        rebuild = quality.getPolicy().rebuild && !sameKnobs;
+        event.applied = rebuild || sameKnobs ? 1 : 0;
+
+        qualityEvents.push_back(event);
+        if (qualityEvents.size() > MAX_QUALITY_EVENTS)
+            qualityEvents.pop_front();
+    }
+
+    kinfu_quality_state_t knobs;
+    get_quality_level(event.to_level, knobs);
+    frameStride = knobs.frame_stride;
+
+    std::stringstream message;
+    message << "Quality level " << event.from_level << " -> " << event.to_level << " at " << event.frame_ms
+            << " ms for a " << event.target_ms << " ms budget"
+            << (event.applied ? "" : ", tracking knobs wait for the next reset") << std::endl;
+    PrintMessage(K4A_LOG_LEVEL_INFO, message.str().c_str());
+    trace_instant("quality_level");
+
+    if (rebuild)
+    {
+        if (captureThreadRunning)
+            resetRequested = true;
+        else
+            resetFusion();
+    }
+}
+
+/// <summary>
+/// Register the capture's color image to its depth image, then undistort it like the depth into the frame pool.
+/// The SDK's transformation reprojects the color through the color camera's calibration and brings it down
+/// to the depth resolution in one pass
+/// </summary>
+/// <returns>false if the capture has no color image or it could not be registered</returns>
+bool registerColorImage(k4a_capture_t capture, k4a_image_t depth_image)
+{
+    StageTimer timer(KINFU_STAGE_REGISTER);
+
+    k4a_image_t color_image = k4a_capture_get_color_image(capture);
+    if (color_image == NULL || k4a_image_get_format(color_image) != K4A_IMAGE_FORMAT_COLOR_BGRA32)
+    {
+        PrintMessage(K4A_LOG_LEVEL_WARNING, "No BGRA32 color image to fuse with the depth\n");
+        if (color_image != NULL)
+            k4a_image_release(color_image);
+        increment_counter(COUNTER_COLOR_FAILURES);
+        return false;
+    }
+
+    // Wrap the pooled buffer so the transformation writes straight into it
+    Mat &registered = framePool.registered_color;
+    k4a_image_t registered_image = NULL;
+    const bool registeredOk =
+        K4A_RESULT_SUCCEEDED == k4a_image_create_from_buffer(K4A_IMAGE_FORMAT_COLOR_BGRA32,
+                                                             registered.cols,
+                                                             registered.rows,
+                                                             (int)registered.step,
+                                                             registered.data,
+                                                             registered.total() * registered.elemSize(),
+                                                             NULL,
+                                                             NULL,
+                                                             &registered_image) &&
+        K4A_RESULT_SUCCEEDED ==
+            k4a_transformation_color_image_to_depth_camera(colorTransformation, depth_image, color_image, registered_image);
+
+    if (registered_image != NULL)
+        k4a_image_release(registered_image);
+    k4a_image_release(color_image);
+
+    if (!registeredOk)
+    {
+        PrintMessage(K4A_LOG_LEVEL_WARNING, "Failed to register the color image to depth\n");
+        increment_counter(COUNTER_COLOR_FAILURES);
+        return false;
+    }
+
+    remap_color(registered.data, &lut, framePool.undistorted_color.data);
+    return true;
+}
+
+/// <summary>
+/// Update the KinectFusion frame
+/// </summary>
+/// <returns>Status of the update
+/// 1: Update successful
+/// 0: Update unsuccessful, can still process
+/// -2: Fatal issue and close device
+/// </returns>
+bool updateKinectFusion(k4a_capture_t capture)
+{
+    // Over budget the quality controller fuses one frame in frameStride, the others only reach Unity
+    if (++framesSinceFused < frameStride)
+        return false;
+    framesSinceFused = 0;
+
+    const uint64_t fusionStart = stats_now_ns();
+    k4a_image_t depth_image = NULL;
+
+    // Retrieve depth image
+    depth_image = k4a_capture_get_depth_image(capture);
+    if (depth_image == NULL)
+    {
+        PrintMessage(K4A_LOG_LEVEL_CRITICAL, "k4a_capture_get_depth_image returned NULL\n");
+        increment_counter(COUNTER_UPDATES_FAILED);
+        return false;
+    }
+
+    // Only allocates if the pool was not sized at startCameras()
+    pipelineAllocations += create_frame_pool(framePool, pinhole);
+    if (colorTransformation != NULL)
+    {
+        pipelineAllocations += create_color_frame_pool(framePool, pinhole,
+            k4a_image_get_width_pixels(depth_image), k4a_image_get_height_pixels(depth_image));
+    }
+
+    // Undistort straight into the pooled frame that KinectFusion consumes
+    {
+        StageTimer timer(KINFU_STAGE_REMAP);
+        Mat undistortedView = framePool.undistorted_depth.getMat(ACCESS_WRITE);
+        remap(depth_image, &lut, undistortedView.ptr<uint16_t>());
+    }
+
+    // A colored volume cannot fuse the depth alone, so frames without color are dropped
+    if (colorTransformation != NULL && !registerColorImage(capture, depth_image))
+    {
+        k4a_image_release(depth_image);
+        increment_counter(COUNTER_UPDATES_FAILED);
+        return false;
+    }
+
+    k4a_image_release(depth_image);
+
+    // Update KinectFusion
+    bool updated;
+    {
+        std::lock_guard<std::mutex> volume(volumeMutex);
+        StageTimer timer(KINFU_STAGE_UPDATE);
+        updated = kf->hasColor() ? kf->update(framePool.undistorted_depth, framePool.undistorted_color)
+                                 : kf->update(framePool.undistorted_depth);
+        if (updated)
+            fusionGeneration++;
+    }
+
+    observeFusionTime((stats_now_ns() - fusionStart) / 1e6f);
+
+    if (updated && keepLatestDepth)
+    {
+        std::lock_guard<std::mutex> lock(depthMutex);
+        pipelineAllocations += latestDepth.empty();
+        framePool.undistorted_depth.copyTo(latestDepth);
+        latestDepthPose = kf->getPose().matrix;
+    }
+
+    if (!updated)
+    {
+        PrintMessage(K4A_LOG_LEVEL_INFO, "Did not update from frame\n");
+        //        kf->reset();
+        increment_counter(COUNTER_UPDATES_FAILED);
+        return false;
+    }
+
+    increment_counter(COUNTER_UPDATES_SUCCEEDED);
+    return true;
+}
+
+/// <summary>
+/// Combine Colour image capture, frame update, point cloud capture,
+/// and pose fetchin a single call
+/// </summary>
+/// <returns>Status of the update
+/// 1: Update successful
+/// 0: Update unsuccessful, can still process
+/// -2: Fatal issue and close device
+/// -3: Playback reached the end of the recording
+/// </returns>
+int captureFrame(
+    unsigned char *color_data,
+    unsigned char *point_data,
+    unsigned char *matrix_data)
+{
+    k4a_capture_t capture = NULL;
+
+    switch (getNextCapture(&capture))
+    {
+    case K4A_WAIT_RESULT_SUCCEEDED:
+        break;
+    case K4A_WAIT_RESULT_TIMEOUT:
+        PrintMessage(K4A_LOG_LEVEL_INFO, "Timed out waiting for a capture\n");
+        return 0;
+
+    case K4A_WAIT_RESULT_FAILED:
+        // Running out of recording is not a failure, the caller closes the device as it does after pollFrame
+        if (playbackFinished)
+            return -3;
+        closeDevice();
+        return -2;
+    }
 
-    if (updateOk)
+    int numPoints = 0;
     {
-        requestPose(matrix_data);
-        numPoints = capturePointCloud(point_data);
+        StageTimer timer(KINFU_STAGE_FRAME);
+
+        bool colorOk = colorAvailable && captureColorImage(capture, color_data);
+        bool updateOk = updateKinectFusion(capture);
+
+        if (updateOk)
+        {
+            requestPose(matrix_data);
+            numPoints = capturePointCloud(point_data);
+        }
     }
 
     k4a_capture_release(capture);
@@ -291,12 +1669,13 @@ int captureFrame(
 /// 1: Capture successful
 /// 0: Capture unsuccessful, can still process
 /// -2: Fatal issue and close device
+/// -3: Playback reached the end of the recording
 /// </returns>
 int captureColorImage(unsigned char *color_data)
 {
     k4a_capture_t capture = NULL;
 
-    switch (k4a_device_get_capture(device, &capture, TIMEOUT_IN_MS))
+    switch (getNextCapture(&capture))
     {
     case K4A_WAIT_RESULT_SUCCEEDED:
         break;
@@ -305,12 +1684,14 @@ int captureColorImage(unsigned char *color_data)
         return 0;
 
     case K4A_WAIT_RESULT_FAILED:
-        PrintMessage(K4A_LOG_LEVEL_CRITICAL, "Failed to read a capture\n");
+        // Running out of recording is not a failure, the caller closes the device as it does after pollFrame
+        if (playbackFinished)
+            return -3;
         closeDevice();
         return -2;
     }
 
-    bool colorOk = captureColorImage(capture, color_data);
+    bool colorOk = colorAvailable && captureColorImage(capture, color_data);
 
     k4a_capture_release(capture);
 
@@ -324,13 +1705,14 @@ int captureColorImage(unsigned char *color_data)
 /// 1: Update successful
 /// 0: Update unsuccessful, can still process
 /// -2: Fatal issue and close device
+/// -3: Playback reached the end of the recording
 /// </returns>
 int updateKinectFusion()
 {
 
     k4a_capture_t capture = NULL;
 
-    switch (k4a_device_get_capture(device, &capture, TIMEOUT_IN_MS))
+    switch (getNextCapture(&capture))
     {
     case K4A_WAIT_RESULT_SUCCEEDED:
         break;
@@ -339,7 +1721,9 @@ int updateKinectFusion()
         return 0;
 
     case K4A_WAIT_RESULT_FAILED:
-        PrintMessage(K4A_LOG_LEVEL_CRITICAL, "Failed to read a capture\n");
+        // Running out of recording is not a failure, the caller closes the device as it does after pollFrame
+        if (playbackFinished)
+            return -3;
         closeDevice();
         return -2;
     }
@@ -350,6 +1734,281 @@ int updateKinectFusion()
     return updateOk ? 1 : 0;
 }
 
+/// <summary>
+/// Body of the native capture thread.
+/// Pulls captures from the device as fast as they arrive, runs the fusion
+/// update and publishes the finished frame into the ring for Unity to drain.
+/// </summary>
+void captureThreadLoop()
+{
+    trace_set_thread_name("KinFu capture");
+
+    while (captureThreadRunning)
+    {
+        k4a_capture_t capture = NULL;
+
+        switch (getNextCapture(&capture))
+        {
+        case K4A_WAIT_RESULT_SUCCEEDED:
+            break;
+        case K4A_WAIT_RESULT_TIMEOUT:
+            PrintMessage(K4A_LOG_LEVEL_INFO, "Timed out waiting for a capture\n");
+            continue;
+
+        case K4A_WAIT_RESULT_FAILED:
+            // Leave closing the device to the Unity thread, it will see the failure on its next poll.
+            // Running out of recording is not a failure, the frames already published can still be read
+            captureThreadFailed = !playbackFinished;
+            captureThreadRunning = false;
+            return;
+        }
+
+        if (resetRequested.exchange(false))
+        {
+            trace_instant("reset");
+            resetFusion();
+        }
+
+        // If Unity has not drained the ring keep tracking, but drop the result
+        captured_frame_t *frame = frameRing.beginWrite();
+        bool dropped = frame == nullptr;
+        if (dropped)
+            frame = &droppedFrame;
+
+        {
+            StageTimer timer(KINFU_STAGE_FRAME);
+
+            // Nobody reads a dropped frame, so only its fusion update is worth doing
+            frame->colorOk = !dropped && colorAvailable && captureColorImage(capture, frame->color.data());
+            frame->updateOk = updateKinectFusion(capture);
+            frame->numPoints = 0;
+            frame->cloud.reset();
+
+            // The cloud thread extracts in the background, so publish whichever cloud is newest
+            if (frame->updateOk && !dropped)
+            {
+                requestPose(reinterpret_cast<unsigned char *>(frame->pose));
+
+                std::lock_guard<std::mutex> lock(cloudMutex);
+                frame->cloud = latestCloud;
+                frame->numPoints = frame->cloud ? frame->cloud->points.rows : 0;
+            }
+        }
+
+        k4a_capture_release(capture);
+
+        // Taking the lock orders the notify after the cloud thread's check, so no wake is lost
+        if (frame->updateOk)
+        {
+            {
+                std::lock_guard<std::mutex> lock(cloudWakeMutex);
+            }
+            cloudWake.notify_one();
+        }
+
+        if (dropped)
+        {
+            trace_instant("dropped_frame");
+            increment_counter(COUNTER_DROPPED_FRAMES);
+        }
+        else
+            frameRing.endWrite();
+    }
+}
+
+/// <summary>
+/// Body of the background cloud thread.
+/// Extracts the point cloud once cloudMinIntegratedFrames updates were fused since the last one,
+/// at most cloudMaxRateHz times a second, so the capture thread never pays for getPoints.
+/// </summary>
+void cloudThreadLoop()
+{
+    trace_set_thread_name("KinFu cloud");
+
+    uint64_t extractedGeneration = fusionGeneration;
+    std::chrono::steady_clock::time_point nextExtraction = std::chrono::steady_clock::now();
+
+    std::unique_lock<std::mutex> lock(cloudWakeMutex);
+    while (cloudThreadRunning)
+    {
+        // Sleep until enough frames were fused (a reset also counts, so the cloud empties promptly)
+        cloudWake.wait(lock, [&]() {
+            return !cloudThreadRunning || fusionGeneration - extractedGeneration >= (uint64_t)std::max(1, cloudMinIntegratedFrames.load());
+        });
+
+        // Then for the rate limit, still waking at once to stop
+        cloudWake.wait_until(lock, nextExtraction, [&]() { return !cloudThreadRunning; });
+        if (!cloudThreadRunning)
+            break;
+
+        lock.unlock();
+        std::shared_ptr<cloud_snapshot_t> cloud = extractPointCloud();
+        lock.lock();
+
+        extractedGeneration = cloud->generation;
+
+        const float rate = cloudMaxRateHz;
+        nextExtraction = std::chrono::steady_clock::now();
+        if (rate > 0.f)
+            nextExtraction += std::chrono::microseconds((int64_t)(1e6f / rate));
+    }
+}
+
+/// <summary>
+/// How often the capture thread's point cloud is refreshed in the background
+/// </summary>
+/// <param name="maxRateHz">Most extractions per second, 0 for no limit</param>
+/// <param name="minIntegratedFrames">Fused frames needed before the cloud counts as changed</param>
+void setCloudExtractionPolicy(float maxRateHz, int minIntegratedFrames)
+{
+    cloudMaxRateHz = std::max(maxRateHz, 0.f);
+    cloudMinIntegratedFrames = std::max(minIntegratedFrames, 1);
+}
+
+/// <summary>
+/// Whether a newer point cloud than the given generation has been extracted
+/// </summary>
+bool pointCloudChangedSince(uint64_t generation)
+{
+    std::lock_guard<std::mutex> lock(cloudMutex);
+    return latestCloud && latestCloud->generation > generation;
+}
+
+/// <summary>
+/// Start the native capture thread.
+/// The cameras must already be started (see connectAndStartCameras)
+/// </summary>
+/// <returns>true if the thread is running</returns>
+bool startCaptureThread()
+{
+    if (captureThreadRunning)
+        return true;
+
+    if ((device == nullptr && playback == NULL) || currentFusion() == NULL)
+    {
+        PrintMessage(K4A_LOG_LEVEL_ERROR, "Cameras or playback must be started before the capture thread\n");
+        return false;
+    }
+
+    // Join a thread that stopped itself after a failed capture, and its cloud thread
+    if (captureThread.joinable())
+        stopCaptureThread();
+
+    // Size every slot up front so neither thread allocates while running
+    const size_t colorSize = colorAvailable ? (size_t)calibration.color_camera_calibration.resolution_width *
+                                                  (size_t)calibration.color_camera_calibration.resolution_height * 4
+                                            : 0;
+
+    for (size_t i = 0; i < frameRing.capacity() + 1; i++)
+    {
+        captured_frame_t &frame = i < frameRing.capacity() ? frameRing.slot(i) : droppedFrame;
+        frame.color.resize(colorSize);
+        frame.cloud.reset();
+        frame.numPoints = 0;
+        frame.colorOk = false;
+        frame.updateOk = false;
+    }
+
+    frameRing.clear();
+    captureThreadFailed = false;
+    resetRequested = false;
+
+    polledCloud.reset();
+
+    captureThreadRunning = true;
+    captureThread = std::thread(captureThreadLoop);
+
+    cloudThreadRunning = true;
+    cloudThread = std::thread(cloudThreadLoop);
+
+    return true;
+}
+
+/// <summary>
+/// Stop the native capture thread and wait for the current frame to finish
+/// </summary>
+void stopCaptureThread()
+{
+    captureThreadRunning = false;
+
+    if (captureThread.joinable())
+        captureThread.join();
+
+    {
+        std::lock_guard<std::mutex> lock(cloudWakeMutex);
+        cloudThreadRunning = false;
+    }
+    cloudWake.notify_one();
+
+    if (cloudThread.joinable())
+        cloudThread.join();
+}
+
+/// <summary>
+/// Copy the newest frame published by the capture thread, if there is one.
+/// Never blocks; older unread frames are skipped.
+/// Pass NULL point_data to only get the point count, and read the cloud with getPointCloudSize and copyPointCloud.
+/// num_points is 0 while the background cloud has not changed since the previous poll
+/// </summary>
+/// <returns>Status of the poll
+/// 1: A new frame was copied into the buffers
+/// 0: No new frame since the last poll
+/// -2: The capture thread stopped on a fatal error, close the device
+/// -3: Playback reached the end of the recording and every frame has been read
+/// </returns>
+int pollFrame(
+    unsigned char *color_data,
+    unsigned char *point_data,
+    unsigned char *matrix_data,
+    int *num_points)
+{
+    *num_points = 0;
+
+    captured_frame_t *frame = frameRing.beginReadLatest();
+    if (frame == nullptr)
+    {
+        if (captureThreadFailed)
+            return -2;
+
+        if (!playbackFinished || captureThreadRunning)
+            return 0;
+
+        // The thread publishes its last frame before stopping, so look again once it has stopped
+        frame = frameRing.beginReadLatest();
+        if (frame == nullptr)
+            return -3;
+    }
+
+    TraceScope trace("poll_frame");
+
+    if (frame->colorOk)
+        memcpy(color_data, frame->color.data(), frame->color.size());
+
+    if (frame->updateOk)
+        memcpy(matrix_data, frame->pose, sizeof(frame->pose));
+
+    // Clouds larger than maxPoints are reported negative, as captureFrame does.
+    // The cloud is refreshed in the background, so only report it when it changed
+    int numPoints = frame->cloud != polledCloud ? frame->numPoints : 0;
+    polledCloud = frame->cloud;
+
+    if (numPoints > maxPoints)
+    {
+        numPoints = -numPoints;
+    }
+    else if (numPoints > 0 && point_data != NULL)
+    {
+        StageTimer timer(KINFU_STAGE_EXPORT);
+        export_cloud_range(*frame->cloud, 0, numPoints, reinterpret_cast<float *>(point_data), cloudLayout);
+    }
+
+    *num_points = numPoints;
+
+    frameRing.endRead();
+
+    return 1;
+}
+
 ///
 /// Below are the raw calls to the Kinect k4a functions
 /// and can be called individually if required.
@@ -380,13 +2039,66 @@ bool connectToDevice(int deviceIndex)
     return true;
 }
 
+/// <summary>
+/// Check a capture profile against the modes the Azure Kinect supports
+/// </summary>
+/// <param name="error">Set to the reason when it is not valid</param>
+bool validCaptureProfile(const kinfu_capture_profile_t &profile, std::string &error)
+{
+    const bool color = !profile.depth_only;
+    const bool yuv = profile.color_format == K4A_IMAGE_FORMAT_COLOR_NV12 || profile.color_format == K4A_IMAGE_FORMAT_COLOR_YUY2;
+
+    if (profile.depth_mode < K4A_DEPTH_MODE_NFOV_2X2BINNED || profile.depth_mode > K4A_DEPTH_MODE_WFOV_UNBINNED)
+        error = "depth mode must be NFOV or WFOV, binned or unbinned";
+    else if (profile.fps < K4A_FRAMES_PER_SECOND_5 || profile.fps > K4A_FRAMES_PER_SECOND_30)
+        error = "unknown fps";
+    else if (profile.depth_mode == K4A_DEPTH_MODE_WFOV_UNBINNED && profile.fps == K4A_FRAMES_PER_SECOND_30)
+        error = "WFOV unbinned depth runs at up to 15 fps";
+    else if (color && (profile.color_resolution < K4A_COLOR_RESOLUTION_720P || profile.color_resolution > K4A_COLOR_RESOLUTION_3072P))
+        error = "color resolution must be 720p to 3072p, or set depth_only";
+    else if (color && profile.color_format != K4A_IMAGE_FORMAT_COLOR_BGRA32 && !yuv)
+        error = "color format must be BGRA32, NV12 or YUY2, MJPG would need a decoder";
+    else if (color && yuv && profile.color_resolution != K4A_COLOR_RESOLUTION_720P)
+        error = "NV12 and YUY2 are only captured at 720p";
+    else if (color && profile.color_resolution == K4A_COLOR_RESOLUTION_3072P && profile.fps == K4A_FRAMES_PER_SECOND_30)
+        error = "3072p color runs at up to 15 fps";
+    else if (!color && profile.synchronized_images_only)
+        error = "synchronized images need the color camera";
+    else
+        error.clear();
+
+    return error.empty();
+}
+
+/// <summary>
+/// Choose the camera modes the next setupConfigAndCalibrate applies
+/// </summary>
+/// <returns>False if the device does not support the profile, keeping the previous one</returns>
+bool setCaptureProfile(const kinfu_capture_profile_t *profile)
+{
+    std::string error;
+    if (!validCaptureProfile(*profile, error))
+    {
+        PrintMessage(K4A_LOG_LEVEL_ERROR, ("Invalid capture profile, " + error + "\n").c_str());
+        return false;
+    }
+
+    captureProfile = *profile;
+    return true;
+}
+
 bool setupConfigAndCalibrate()
 {
     config = K4A_DEVICE_CONFIG_INIT_DISABLE_ALL;
-    config.color_format = K4A_IMAGE_FORMAT_COLOR_BGRA32;
-    config.color_resolution = K4A_COLOR_RESOLUTION_1080P;
-    config.depth_mode = K4A_DEPTH_MODE_NFOV_UNBINNED;
-    config.camera_fps = K4A_FRAMES_PER_SECOND_5;
+    config.depth_mode = (k4a_depth_mode_t)captureProfile.depth_mode;
+    config.camera_fps = (k4a_fps_t)captureProfile.fps;
+    if (!captureProfile.depth_only)
+    {
+        config.color_format = (k4a_image_format_t)captureProfile.color_format;
+        config.color_resolution = (k4a_color_resolution_t)captureProfile.color_resolution;
+        config.synchronized_images_only = captureProfile.synchronized_images_only != 0;
+    }
+    colorAvailable = !captureProfile.depth_only;
 
     // Retrive calibration
     if (K4A_RESULT_SUCCEEDED !=
@@ -400,19 +2112,193 @@ bool setupConfigAndCalibrate()
     return true;
 }
 
-bool startCameras()
+/// <summary>
+/// Describe what the running device or recording was configured with
+/// </summary>
+bool getCaptureInfo(kinfu_capture_info_t *info)
 {
-    stopCameras();
+    memset(info, 0, sizeof(*info));
+    if ((device == nullptr && playback == NULL) || currentFusion() == NULL)
+        return false;
 
-    if (K4A_RESULT_SUCCEEDED != k4a_device_start_cameras(device, &config))
+    info->depth_mode = config.depth_mode;
+    info->depth_width = calibration.depth_camera_calibration.resolution_width;
+    info->depth_height = calibration.depth_camera_calibration.resolution_height;
+    info->fps = config.camera_fps == K4A_FRAMES_PER_SECOND_30 ? 30 : config.camera_fps == K4A_FRAMES_PER_SECOND_15 ? 15 : 5;
+    info->synchronized_images_only = config.synchronized_images_only ? 1 : 0;
+
+    if (colorAvailable && config.color_resolution != K4A_COLOR_RESOLUTION_OFF)
     {
-        PrintMessage(K4A_LOG_LEVEL_CRITICAL, "Failed to start device\n");
-        closeDevice();
+        info->color_resolution = config.color_resolution;
+        info->color_width = calibration.color_camera_calibration.resolution_width;
+        info->color_height = calibration.color_camera_calibration.resolution_height;
+        info->color_format = config.color_format;
+    }
+
+    return true;
+}
+
+/// <summary>
+/// Check volume params against the ranges setVolumeParams accepts
+/// </summary>
+/// <param name="error">Set to the reason when they are not valid</param>
+bool validVolumeParams(const kinfu_volume_params_t &volume, std::string &error)
+{
+    const bool submaps = volume.volume_type == KINFU_VOLUME_SUBMAPS;
+    const bool unitSupported = volume.unit_resolution == 0 || volume.unit_resolution == HASH_UNIT_RESOLUTION ||
+        (submaps && (volume.unit_resolution == 8 || volume.unit_resolution == 32));
+
+    if (!denseVolume(volume.volume_type) && volume.volume_type != KINFU_VOLUME_HASH_TSDF && !submaps)
+        error = "unknown volume type";
+    else if (!(volume.voxel_size == 0.f || (volume.voxel_size >= 0.001f && volume.voxel_size <= 0.1f)))
+        error = "voxel size must be 0 or 1 mm to 10 cm";
+    else if (!(volume.volume_resolution == 0 || (volume.volume_resolution >= 16 && volume.volume_resolution <= 1024)))
+        error = "volume resolution must be 0 or 16 to 1024";
+    else if (!unitSupported)
+        error = submaps ? "submap units must be 8, 16 or 32 voxels" : "KinFu only builds hash volumes with 16 voxel units";
+    else
+        error.clear();
+
+    if (!error.empty())
+        return false;
+
+    // Below a few voxels the band the depth is fused into leaves holes
+    const int resolution = denseVolume(volume.volume_type) && volume.volume_resolution > 0 ? volume.volume_resolution : 512;
+    const float voxelSize = volume.voxel_size > 0.f ? volume.voxel_size : 3.f / resolution;
+    if (!(volume.truncation_distance == 0.f || volume.truncation_distance >= 3.f * voxelSize))
+    {
+        error = "truncation distance must be 0 or at least 3 voxels";
+        return false;
+    }
+
+    return true;
+}
+
+/// <summary>
+/// Choose the volume the next startCameras or openPlayback creates
+/// </summary>
+/// <returns>False if the params are out of range, keeping the previous ones</returns>
+bool setVolumeParams(const kinfu_volume_params_t *params)
+{
+    std::string error;
+    if (!validVolumeParams(*params, error))
+    {
+        PrintMessage(K4A_LOG_LEVEL_ERROR, ("Invalid volume params, " + error + "\n").c_str());
+        return false;
+    }
+
+    volumeParams = *params;
+    return true;
+}
+
+/// <summary>
+/// Describe the running volume and the memory its voxels take.
+/// A hash volume cannot be asked for its units, so they are counted around the newest cloud's surface
+/// </summary>
+bool getVolumeInfo(kinfu_volume_info_t *info)
+{
+    memset(info, 0, sizeof(*info));
+    const Ptr<FusionBackend> fusion = currentFusion();
+    if (fusion == NULL)
+        return false;
+
+    const kinfu::Params params = fusion->getParams();
+    info->volume_type = startedVolume.volume_type;
+    info->voxel_size = params.voxelSize;
+    info->truncation_distance = params.tsdf_trunc_dist;
+
+    if (denseVolume(startedVolume.volume_type))
+    {
+        const int voxelBytes = startedVolume.volume_type == KINFU_VOLUME_COLORED_TSDF ? COLORED_TSDF_VOXEL_BYTES : TSDF_VOXEL_BYTES;
+        info->volume_resolution = params.volumeDims[0];
+        info->resident_bytes = (uint64_t)params.volumeDims[0] * params.volumeDims[1] * params.volumeDims[2] * voxelBytes;
+    }
+    else
+    {
+        // LargeKinfu only gives out the current submap's cloud, so submaps are measured one at a time
+        const int unit = startedVolume.unit_resolution;
+        info->unit_resolution = unit;
+
+        std::shared_ptr<cloud_snapshot_t> cloud = newestCloud();
+        if (cloud)
+            info->volume_units = count_volume_units(cloud->points, unit * params.voxelSize, params.tsdf_trunc_dist);
+
+        info->resident_bytes = (uint64_t)info->volume_units * unit * unit * unit * TSDF_VOXEL_BYTES;
+    }
+
+    return true;
+}
+
+/// <summary>
+/// Set the frame time budget the quality controller holds, 0 ms to turn it off
+/// </summary>
+/// <returns>False if the policy is out of range, keeping the previous one</returns>
+bool setQualityPolicy(const kinfu_quality_policy_t *policy)
+{
+    const char *error = NULL;
+    if (!valid_quality_policy(*policy, &error))
+    {
+        PrintMessage(K4A_LOG_LEVEL_ERROR, (std::string("Invalid quality policy, ") + error + "\n").c_str());
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(qualityMutex);
+    quality.setPolicy(*policy);
+    return true;
+}
+
+/// <summary>
+/// Describe the quality controller's level and knobs
+/// </summary>
+bool getQualityState(kinfu_quality_state_t *state)
+{
+    memset(state, 0, sizeof(*state));
+    if (currentFusion() == NULL)
         return false;
+
+    std::lock_guard<std::mutex> lock(qualityMutex);
+    state->level = quality.level();
+    state->created_level = quality.createdLevel();
+    state->frame_ms = quality.frameMs();
+    get_quality_level(state->level, *state);
+    return true;
+}
+
+/// <summary>
+/// Hand the oldest unpolled level changes to Unity
+/// </summary>
+/// <returns>Number of events copied</returns>
+int pollQualityEvents(kinfu_quality_event_t *events, int capacity)
+{
+    std::lock_guard<std::mutex> lock(qualityMutex);
+    int count = 0;
+    while (count < capacity && !qualityEvents.empty())
+    {
+        events[count++] = qualityEvents.front();
+        qualityEvents.pop_front();
     }
+    return count;
+}
 
-    // Generate a pinhole model for depth camera
-    pinhole = create_pinhole_from_xy_range(&calibration, K4A_CALIBRATION_TYPE_DEPTH);
+/// <summary>
+/// Build the undistortion LUT, frame pool and KinectFusion pipeline for the current calibration.
+/// Shared by the device and playback sources
+/// </summary>
+void startKinectFusion()
+{
+    // Reuse the pinhole model and LUT from an earlier start with the same calibration
+    const uint64_t lutKey = hash_undistortion_lut_key(&calibration, K4A_CALIBRATION_TYPE_DEPTH, interpolation_type);
+    const std::string lutCachePath = get_undistortion_lut_cache_path(lutKey);
+    if (!load_undistortion_lut_cache(lutCachePath.c_str(), lutKey, &pinhole, &lut))
+    {
+        // Generate a pinhole model for depth camera
+        pinhole = create_pinhole_from_xy_range(&calibration, K4A_CALIBRATION_TYPE_DEPTH);
+
+        create_undistortion_lut(&calibration, K4A_CALIBRATION_TYPE_DEPTH, &pinhole, &lut, interpolation_type);
+
+        if (!save_undistortion_lut_cache(lutCachePath.c_str(), lutKey, &pinhole, &lut))
+            PrintMessage(K4A_LOG_LEVEL_WARNING, "Failed to write the undistortion LUT cache\n");
+    }
 
     setUseOptimized(true);
 
@@ -421,11 +2307,26 @@ bool startCameras()
     const int width = calibration.depth_camera_calibration.resolution_width;
     const int height = calibration.depth_camera_calibration.resolution_height;
 
-    // Initialize kinfu parameters
-    Ptr<kinfu::Params> params;
-    params = kinfu::Params::defaultParams();
-    initialize_kinfu_params(
-        *params, width, height, pinhole.fx, pinhole.fy, pinhole.px, pinhole.py);
+    // Colored volumes need color to register, otherwise fall back to the same cube without it
+    kinfu_volume_params_t volume = volumeParams;
+    if (colorTransformation != NULL)
+    {
+        k4a_transformation_destroy(colorTransformation);
+        colorTransformation = NULL;
+    }
+    if (volume.volume_type == KINFU_VOLUME_COLORED_TSDF)
+    {
+        // Only BGRA32 can be registered to depth
+        if (colorAvailable && calibration.color_resolution != K4A_COLOR_RESOLUTION_OFF &&
+            config.color_format == K4A_IMAGE_FORMAT_COLOR_BGRA32)
+            colorTransformation = k4a_transformation_create(&calibration);
+
+        if (colorTransformation == NULL)
+        {
+            PrintMessage(K4A_LOG_LEVEL_WARNING, "Colored volumes need BGRA32 color, starting a TSDF volume instead\n");
+            volume.volume_type = KINFU_VOLUME_TSDF;
+        }
+    }
 
     // Distortion coefficients
     Matx<float, 1, 8> distCoeffs;
@@ -438,42 +2339,201 @@ bool startCameras()
     distCoeffs(6) = intrinsics->param.k5;
     distCoeffs(7) = intrinsics->param.k6;
 
-    k4a_image_create(K4A_IMAGE_FORMAT_CUSTOM,
-                     pinhole.width,
-                     pinhole.height,
-                     pinhole.width * (int)sizeof(coordinate_t),
-                     &lut);
+    // Size the per-frame buffers now so the capture loop never has to
+    create_frame_pool(framePool, pinhole);
+    if (colorTransformation != NULL)
+        create_color_frame_pool(framePool, pinhole, width, height);
+    pipelineAllocations = 0;
+
+    // Start at the level the controller is at, timing it afresh
+    int level;
+    {
+        std::lock_guard<std::mutex> lock(qualityMutex);
+        quality.restart();
+        level = quality.level();
+        quality.setCreatedLevel(level);
+    }
+    kinfu_quality_state_t knobs;
+    get_quality_level(level, knobs);
+    frameStride = knobs.frame_stride;
+    framesSinceFused = 0;
+
+    Ptr<FusionBackend> started = createFusionBackend(volume, level);
+    {
+        std::lock_guard<std::mutex> lock(volumeMutex);
+        kf = started;
+    }
+
+    const kinfu::Params &startedParams = started->getParams();
+    startedVolume = volume;
+    startedVolume.voxel_size = startedParams.voxelSize;
+    startedVolume.truncation_distance = startedParams.tsdf_trunc_dist;
+    startedVolume.volume_resolution = denseVolume(volume.volume_type) ? startedParams.volumeDims[0] : 0;
+    if (denseVolume(volume.volume_type))
+        startedVolume.unit_resolution = 0;
+    else
+        startedVolume.unit_resolution = volume.unit_resolution > 0 ? volume.unit_resolution : HASH_UNIT_RESOLUTION;
+}
+
+bool startCameras()
+{
+    // A restart replaces the LUT, frame pool and KinectFusion, so the threads reading them stop first
+    stopCaptureThread();
+    stopPreviewThread();
+    stopCameras();
 
-    create_undistortion_lut(&calibration, K4A_CALIBRATION_TYPE_DEPTH, &pinhole, lut, interpolation_type);
+    if (K4A_RESULT_SUCCEEDED != k4a_device_start_cameras(device, &config))
+    {
+        PrintMessage(K4A_LOG_LEVEL_CRITICAL, "Failed to start device\n");
+        closeDevice();
+        return false;
+    }
 
-    kf = kinfu::KinFu::create(params);
+    startKinectFusion();
 
     return true;
 }
 
 void reset()
 {
+    // The capture thread owns kf while it runs, so let it reset between frames
+    if (captureThreadRunning)
+    {
+        resetRequested = true;
+        return;
+    }
+
     if (kf != NULL)
-        kf->reset();
+        resetFusion();
 }
 
 bool stopCameras()
 {
-    k4a_device_stop_cameras(device);
+    if (device != NULL)
+        k4a_device_stop_cameras(device);
+
     return true;
 }
 
 void closeDevice()
 {
-    if (device == nullptr)
+    if (device == nullptr && playback == NULL)
         return;
 
-    if (lut != NULL)
+    // Never join ourselves if the capture thread hit a fatal error
+    if (captureThread.joinable() && captureThread.get_id() != std::this_thread::get_id())
+        stopCaptureThread();
+
+    // Renders need KinectFusion, so finish the one in progress first
+    stopPreviewThread();
+
+    // Release the LUT memory (or cache file mapping)
+    release_undistortion_lut(&lut);
+
+    if (colorTransformation != NULL)
+    {
+        k4a_transformation_destroy(colorTransformation);
+        colorTransformation = NULL;
+    }
+
+    if (playback != NULL)
+    {
+        k4a_playback_close(playback);
+        playback = NULL;
+    }
+
+    if (device != nullptr)
+    {
+        k4a_device_close(device);
+        device = nullptr;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(cloudMutex);
+        latestCloud.reset();
+    }
+    pinnedCloud.reset();
+    pinnedBlocks.clear();
+    polledCloud.reset();
+
+    // The next device starts a new history, so deltas from this one come back full
+    {
+        std::lock_guard<std::mutex> lock(blockHistoryMutex);
+        blockHistory = cloud_block_history_t();
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(depthMutex);
+        latestDepth.release();
+    }
+    keepLatestDepth = false;
+
+    colorAvailable = true;
+}
+
+/// <summary>
+/// Open an Azure Kinect recording (.mkv) and play it back in place of a device,
+/// through the same capture, fusion and capture thread paths.
+/// Calibration comes from the recording. Frames are either paced like the
+/// recording, or read as fast as fusion can take them to measure throughput.
+/// </summary>
+/// <returns>Status of the open
+/// 0: Opened and started OK
+/// -1: Failed to open the recording
+/// -2: Recording has no depth track or calibration
+/// </returns>
+int openPlayback(const char *path, bool realtime)
+{
+    closeDevice();
+
+    if (K4A_RESULT_SUCCEEDED != k4a_playback_open(path, &playback))
+    {
+        PrintMessage(K4A_LOG_LEVEL_CRITICAL, "Failed to open recording\n");
+        playback = NULL;
+        return -1;
+    }
+
+    k4a_record_configuration_t recordConfig;
+    if (K4A_RESULT_SUCCEEDED != k4a_playback_get_record_configuration(playback, &recordConfig) ||
+        !recordConfig.depth_track_enabled ||
+        K4A_RESULT_SUCCEEDED != k4a_playback_get_calibration(playback, &calibration))
+    {
+        PrintMessage(K4A_LOG_LEVEL_CRITICAL, "Recording has no depth track or calibration\n");
+        closeDevice();
+        return -2;
+    }
+
+    // Mirror the recorded configuration so everything is sized as for a device
+    config = K4A_DEVICE_CONFIG_INIT_DISABLE_ALL;
+    config.color_format = recordConfig.color_format;
+    config.color_resolution = recordConfig.color_resolution;
+    config.depth_mode = recordConfig.depth_mode;
+    config.camera_fps = recordConfig.camera_fps;
+
+    // The pipeline only takes BGRA32 color, so have the playback decode anything else
+    colorAvailable = recordConfig.color_track_enabled;
+    if (!colorAvailable)
+    {
+        PrintMessage(K4A_LOG_LEVEL_WARNING, "Recording has no color track, playing back depth only\n");
+    }
+    else if (recordConfig.color_format != K4A_IMAGE_FORMAT_COLOR_BGRA32)
     {
-        k4a_image_release(lut);
-        lut = NULL;
+        if (K4A_RESULT_SUCCEEDED == k4a_playback_set_color_conversion(playback, K4A_IMAGE_FORMAT_COLOR_BGRA32))
+        {
+            config.color_format = K4A_IMAGE_FORMAT_COLOR_BGRA32;
+        }
+        else
+        {
+            PrintMessage(K4A_LOG_LEVEL_WARNING, "Recording color can not be converted to BGRA32, playing back depth only\n");
+            colorAvailable = false;
+        }
     }
 
-    k4a_device_close(device);
-    device = nullptr;
+    playbackRealtime = realtime;
+    playbackFinished = false;
+    playbackStartTimestamp = -1;
+
+    startKinectFusion();
+
+    return 0;
 }
\ No newline at end of file
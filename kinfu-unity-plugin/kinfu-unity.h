@@ -1,23 +1,63 @@
+#pragma once
+
 // The following ifdef block is the standard way of creating macros which make exporting
 // from a DLL simpler. All files within this DLL are compiled with the KINFUUNITY_EXPORTS
 // symbol defined on the command line. This symbol should not be defined on any project
 // that uses this DLL. This way any other project whose source files include this file see
 // KINFUUNITY_API functions as being imported from a DLL, whereas this DLL sees symbols
 // defined with this macro as being exported.
-#ifdef KINFUUNITY_EXPORTS
+// Off Windows (the headless benchmark) the symbols are only given default visibility.
+#if !defined(_WIN32)
+#define KINFUUNITY_API __attribute__((visibility("default")))
+#elif defined(KINFUUNITY_EXPORTS)
 #define KINFUUNITY_API __declspec(dllexport)
 #else
 #define KINFUUNITY_API __declspec(dllimport)
 #endif
 
+#include <stdint.h>
+
 extern "C"
 {
 	// Register callback to print messages on the Unity side
 	typedef void (*PrintMessageCallback)(int level, const char *);
 	KINFUUNITY_API void registerPrintMessageCallback(PrintMessageCallback callback, int level);
 
-	// Connect to the Default device, configure, and start the cameras
-	KINFUUNITY_API int connectAndStartCameras();
+	// Camera modes for connectAndStartCameras, values are the k4a enums
+	typedef struct
+	{
+		int depth_mode;					// k4a_depth_mode_t, NFOV or WFOV, binned or unbinned
+		int color_resolution;			// k4a_color_resolution_t, ignored when depth_only
+		int color_format;				// k4a_image_format_t: BGRA32, or NV12 / YUY2 at 720p. Colored volumes need BGRA32
+		int fps;						// k4a_fps_t, 30 fps needs neither WFOV unbinned depth nor 3072p color
+		int depth_only;					// Non-zero to leave the color camera off
+		int synchronized_images_only;	// Non-zero to only get captures holding both images, needs color
+	} kinfu_capture_profile_t;
+
+	// Choose the camera modes the next setupConfigAndCalibrate uses (5 fps NFOV unbinned with 1080p BGRA32 until set).
+	// Returns false, keeping the last profile, for a combination the device does not support
+	KINFUUNITY_API bool setCaptureProfile(const kinfu_capture_profile_t *profile);
+
+	// Connect to the Default device, configure it with profile (or the last profile if NULL), and start the cameras.
+	// Returns 0 on success, -1 to -3 if connecting, configuring or starting failed, -4 for an invalid profile
+	KINFUUNITY_API int connectAndStartCameras(const kinfu_capture_profile_t *profile);
+
+	// What the running device or recording was configured with, to size buffers from
+	typedef struct
+	{
+		int depth_mode;					// k4a_depth_mode_t
+		int depth_width;				// Depth image size, also the size KinFu works at
+		int depth_height;
+		int color_resolution;			// k4a_color_resolution_t, K4A_COLOR_RESOLUTION_OFF without color
+		int color_width;				// Size of the RGBA32 images captureFrame and pollFrame write, 0 without color
+		int color_height;
+		int color_format;				// k4a_image_format_t captured, converted to RGBA32 for Unity
+		int fps;						// Frames per second
+		int synchronized_images_only;	// Non-zero if every capture holds both images
+	} kinfu_capture_info_t;
+
+	// Describe the running capture. Returns false before a device or recording is started
+	KINFUUNITY_API bool getCaptureInfo(kinfu_capture_info_t *info);
 
 	/// <summary>
 	/// Combine Colour image capture, frame update, point cloud capture,
@@ -27,22 +67,388 @@ extern "C"
 	/// 1: Update successful
 	/// 0: Update unsuccessful, can still process
 	/// -2: Fatal issue and close device
+	/// -3: End of the recording being played back
 	/// </returns>
 	KINFUUNITY_API int captureFrame(
 		unsigned char *color_data,
 		unsigned char *point_data,
 		unsigned char *matrix_data);
 
-	// Captures the color image from the device
+	/// <summary>
+	/// Play back an Azure Kinect recording (.mkv) in place of a device,
+	/// either paced like the recording (realtime) or as fast as possible
+	/// </summary>
+	/// <returns>Status of the open
+	/// 0: Opened and started OK
+	/// -1: Failed to open the recording
+	/// -2: Recording has no depth track or calibration
+	/// </returns>
+	KINFUUNITY_API int openPlayback(const char *path, bool realtime);
+
+	// Start the native capture thread, which captures and fuses frames
+	// continuously and publishes them for pollFrame.
+	// (assuming the cameras have been started first)
+	KINFUUNITY_API bool startCaptureThread();
+
+	// Stop the native capture thread
+	KINFUUNITY_API void stopCaptureThread();
+
+	/// <summary>
+	/// Copy the newest frame from the capture thread without blocking.
+	/// point_data may be NULL to only report the count, num_points is negative if it exceeds 1,000,000
+	/// </summary>
+	/// <returns>Status of the poll
+	/// 1: New frame copied, num_points holds the point count
+	/// 0: No new frame since the last poll
+	/// -2: Fatal issue and close device
+	/// -3: End of the recording being played back
+	/// </returns>
+	KINFUUNITY_API int pollFrame(
+		unsigned char *color_data,
+		unsigned char *point_data,
+		unsigned char *matrix_data,
+		int *num_points);
+
+	// Flip color images vertically (row 0 at the bottom, as Unity textures expect)
+	KINFUUNITY_API void setColorImageFlip(bool flip);
+
+	// Captures the color image from the device, returning the same statuses as captureFrame
 	KINFUUNITY_API int captureColorImage(unsigned char *color_data);
 
-	// Updates the KinectFusion object with the latest undistorted frame
+	// Updates the KinectFusion object with the latest undistorted frame, returning the same statuses as captureFrame
 	KINFUUNITY_API int updateKinectFusion();
 
-	// Captures the point cloud data from the latest frame
+	// Captures the point cloud data from the latest frame, or only counts it if point_data is NULL
 	// (assuming updateKinectFusion has been called first)
 	KINFUUNITY_API int capturePointCloud(unsigned char *point_data);
 
+	// Floats per point written by capturePointCloud and pollFrame: 3 (xyz, default) or 4 (xyzw, w = 1).
+	// Point buffers must hold maxPoints times this many floats
+	KINFUUNITY_API bool setPointCloudLayout(int floatsPerPoint);
+
+	// Pin the newest point cloud, at the level from selectPointCloudLod, and return its point count, whatever its size.
+	// generation changes whenever the cloud does
+	KINFUUNITY_API int getPointCloudSize(uint64_t *generation);
+
+	// Copy up to count points from offset of the cloud pinned by getPointCloudSize,
+	// returns the number of points copied
+	KINFUUNITY_API int copyPointCloud(unsigned char *point_data, int offset, int count);
+
+	// Copy the RGBA32 colors of up to count points from offset of the pinned cloud, in the order copyPointCloud
+	// writes them. Returns the number copied, 0 if the volume is not colored, -1 for a negative offset or count
+	KINFUUNITY_API int copyPointCloudColors(unsigned char *color_data, int offset, int count);
+
+	// While the capture thread runs the cloud is extracted in the background, at most maxRateHz
+	// times a second (0 for no limit) and once minIntegratedFrames frames were fused. Defaults to 4 Hz, 1 frame
+	KINFUUNITY_API void setCloudExtractionPolicy(float maxRateHz, int minIntegratedFrames);
+
+	// Whether a cloud newer than the given generation (from getPointCloudSize) is available
+	KINFUUNITY_API bool pointCloudChangedSince(uint64_t generation);
+
+	// Build up to 4 voxel-grid LODs with every extracted cloud, keeping one point per cell of each
+	// (increasing) cell size in metres. count 0 turns them off. Returns false if the sizes are invalid
+	KINFUUNITY_API bool setPointCloudLods(const float *cell_sizes, int count);
+
+	// Level getPointCloudSize pins from now on: 0 for the full cloud, n for the nth LOD.
+	// Returns false if that level was not set
+	KINFUUNITY_API bool selectPointCloudLod(int level);
+
+	// Most planes in a kinfu_cull_region_t
+#define KINFU_MAX_CULL_PLANES 8
+
+	// Convex region bounded by planes, a point is inside where a * x + b * y + c * z + d >= 0 for every
+	// plane (a, b, c, d). Planes are in volume coordinates, as the points and camera pose are
+	typedef struct
+	{
+		int plane_count;							// Planes used, 1 to KINFU_MAX_CULL_PLANES
+		float planes[KINFU_MAX_CULL_PLANES][4];		// a, b, c, d per plane
+	} kinfu_cull_region_t;
+
+	// Fill region with the depth camera's view frustum between near and far metres, at pose
+	// (4x4 row-major camera to volume, as requestPose returns) or at the current pose if pose is NULL.
+	// Returns false for submap volumes, whose clouds are not in requestPose's frame
+	KINFUUNITY_API bool getFrustumCullRegion(const float *pose, float near_distance, float far_distance, kinfu_cull_region_t *region);
+
+	// Fill region with an oriented box of the given half extents, placed by pose (4x4 row-major box to volume)
+	KINFUUNITY_API void getBoxCullRegion(const float *pose, const float *half_extents, kinfu_cull_region_t *region);
+
+	// Narrow the cloud pinned by getPointCloudSize down to its points inside region, so the copy
+	// and export functions only read those. Returns the number of points left, or -1 if region is invalid
+	KINFUUNITY_API int cullPointCloud(const kinfu_cull_region_t *region);
+
+	// Partition each extracted cloud into cubes of block_size metres for getPointCloudDelta, or 0 (the default) not to.
+	// Takes effect from the next extraction and starts the block history over. Returns false below 1 cm
+	KINFUUNITY_API bool setPointCloudBlockSize(float block_size);
+
+	// Describes the delta pinned by getPointCloudDelta
+	typedef struct
+	{
+		uint64_t generation;	// Generation of the cloud the delta leads to, the next since
+		uint64_t since;			// Generation the delta starts from
+		int full;				// Non-zero if since is older than the block history, so every block is listed and older ones should be dropped
+		int block_count;		// Blocks listed, the changed and added ones first, then the removed ones
+		int removed_count;		// Removed blocks at the end of the list
+		int point_count;		// Points of the changed blocks, the pinned cloud
+		float block_size;		// Block edge in metres
+	} kinfu_cloud_delta_t;
+
+	// One block of a delta, a cube from (x, y, z) * block_size in volume coordinates
+	typedef struct
+	{
+		int x;
+		int y;
+		int z;
+		int first_point;		// First point of the block in the pinned cloud
+		int point_count;		// Points in the block, 0 if removed
+		int removed;			// Non-zero if the block left the cloud
+		uint64_t hash;			// Hash of the block's points, equal hashes mean equal points
+	} kinfu_cloud_block_t;
+
+	// Pin the blocks of the newest cloud that were added or changed after generation since (0 for all of them)
+	// in place of the cloud, block after block, so the copy and export functions only read those.
+	// Returns the number of points pinned, or -1 if the cloud has no blocks yet
+	KINFUUNITY_API int getPointCloudDelta(uint64_t since, kinfu_cloud_delta_t *delta);
+
+	// Copy up to count block descriptions from offset of the delta pinned by getPointCloudDelta.
+	// Returns the number copied, or -1 for a negative offset or count
+	KINFUUNITY_API int copyPointCloudBlocks(kinfu_cloud_block_t *blocks, int offset, int count);
+
+	// Size of the organized maps from exportDepthFrameCloud when keeping every downsample-th pixel (1 to 8)
+	KINFUUNITY_API bool getDepthFrameCloudSize(int downsample, int *width, int *height);
+
+	// Write the newest fused depth frame as organized width x height maps of float4 (x, y, z, 0) vertices
+	// and normals in volume coordinates, NaN where there is no depth. The vertices are the raw depth
+	// back-projected at the pose it was fused at, not a raycast of the fused surface, and the normals are
+	// the volume's at those vertices. Costs the same however large the volume is. Frames are kept from
+	// the first call on, so it returns 0 until one more frame is fused.
+	// pose (if not NULL) is set to the frame's 4x4 row-major camera pose. Returns the pixels written, or -1
+	// for a bad downsample or normals with submap volumes
+	KINFUUNITY_API int exportDepthFrameCloud(float *points, float *normals, int downsample, float *pose);
+
+	// Render a shaded (Phong) preview of the volume into width x height RGBA32 pixels, from pose
+	// (4x4 row-major camera to volume) or the current pose if NULL. Returns 1 if rendered, 0 if not started,
+	// -1 for a bad size or a pose with submap volumes, which only render from the current pose
+	KINFUUNITY_API int renderPreview(unsigned char *rgba, int width, int height, const float *pose);
+
+	// Same as renderPreview on a worker thread, replacing a request it has not started yet.
+	// pollPreview copies the result once it is done
+	KINFUUNITY_API bool requestPreview(int width, int height, const float *pose);
+
+	// Copy the newest render from requestPreview. Returns 1 if a new image was copied,
+	// 0 if there is none, -1 if it is not width x height
+	KINFUUNITY_API int pollPreview(unsigned char *rgba, int width, int height);
+
+	// Vertex color encodings for kinfu_vertex_format_t::color_format
+	typedef enum
+	{
+		KINFU_VERTEX_COLOR_RGBA32,		// 4 x uint8, as Unity's UNorm8 x 4 vertex color
+		KINFU_VERTEX_COLOR_RGBA_FLOAT,	// 4 x float, as RGBAFloat textures
+	} kinfu_vertex_color_format_t;
+
+	// Caller-described interleaved vertex, so the export can go straight into a GraphicsBuffer,
+	// mesh vertex buffer or texture. Offsets are in bytes from the start of the vertex, -1 leaves an attribute out
+	typedef struct
+	{
+		int stride;				// Bytes from one vertex to the next
+		int position_offset;	// float x, y, z
+		int normal_offset;		// float x, y, z, needs setPointCloudNormals(true)
+		int color_offset;		// color in color_format
+		int color_format;		// kinfu_vertex_color_format_t
+		int size_offset;		// float point size
+		float size;				// Point size written to size_offset
+		uint32_t color;			// Color written to color_offset when the cloud has none, 0xAABBGGRR so RGBA32 bytes are R, G, B, A
+		int flip_y;				// Non-zero to negate y of positions and normals, OpenCV's +Y is down and Unity's is up
+	} kinfu_vertex_format_t;
+
+	// Also extract normals with the point cloud (off by default, they double the extraction cost)
+	KINFUUNITY_API void setPointCloudNormals(bool enabled);
+
+	// Write up to count vertices from offset of the cloud pinned by getPointCloudSize in an interleaved format,
+	// returns the number of vertices written or -1 if the format is invalid
+	KINFUUNITY_API int exportPointCloudVertices(unsigned char *vertex_data, int offset, int count, const kinfu_vertex_format_t *format);
+
+	// Optional parts of a quantized cloud
+	typedef enum
+	{
+		KINFU_QUANTIZED_NORMALS = 1,	// Octahedral normals, 2 bytes per point
+		KINFU_QUANTIZED_COLORS = 2,		// RGB565 colors, 2 bytes per point
+	} kinfu_quantized_flags_t;
+
+	// Describes a quantized cloud. Its data is every position (3 x uint16), then every normal (uint16)
+	// and every color (uint16) if flagged. A position decodes to origin + q * scale per axis
+	typedef struct
+	{
+		uint32_t count;				// Points in the cloud
+		uint32_t flags;				// kinfu_quantized_flags_t present in the data
+		float origin[3];			// Position of q = 0, the low corner of the volume
+		float scale[3];				// Metres per step on each axis
+		float max_position_error;	// Largest distance between a point and its decoded position, in metres
+		float max_normal_error;		// Largest angle between a normal and its decoded normal, in degrees
+	} kinfu_quantized_cloud_t;
+
+	// Quantize the cloud pinned by getPointCloudSize into data (about 3x smaller than floats), filling header.
+	// Returns the bytes written, or minus the bytes needed if capacity is too small
+	KINFUUNITY_API int exportQuantizedPointCloud(unsigned char *data, int capacity, int flags, kinfu_quantized_cloud_t *header);
+
+	// Decode a quantized cloud into x, y, z floats, and normals (x, y, z) and RGBA32 colors if not NULL.
+	// Returns the number of points decoded
+	KINFUUNITY_API int decodeQuantizedPointCloud(const unsigned char *data, const kinfu_quantized_cloud_t *header,
+		float *points, float *normals, unsigned char *colors);
+
+	// Volume backends for kinfu_volume_params_t::volume_type
+	typedef enum
+	{
+		KINFU_VOLUME_TSDF,		// Dense voxel cube, memory fixed by its resolution
+		KINFU_VOLUME_HASH_TSDF,	// Hashed units of voxels, allocated only near observed surfaces
+		KINFU_VOLUME_SUBMAPS,	// LargeKinfu: hashed submaps added as the camera moves on, joined by a pose graph.
+								// Clouds, renders and volume info cover the current submap, in that submap's own
+								// frame, while requestPose is global: they only line up until the first new submap.
+								// Frustum culling, posed renders and depth frame normals are refused
+		KINFU_VOLUME_COLORED_TSDF,	// ColoredKinFu: a dense cube that also fuses the color image, so clouds carry
+									// per-point colors. 8 bytes a voxel (1 GB at 512), needs the color camera
+	} kinfu_volume_type_t;
+
+	// Volume KinFu is started with. Zero fields keep KinFu's defaults
+	typedef struct
+	{
+		int volume_type;			// kinfu_volume_type_t
+		float voxel_size;			// Voxel edge in metres, 0 for 3 m / 512 (or 3 m / volume_resolution for TSDF)
+		int volume_resolution;		// Voxels per side of a (colored) TSDF volume, 16 to 1024, 0 for 512. Hash volumes ignore it
+		int unit_resolution;		// Voxels per side of a hash volume unit, 0 or 16 (the only size KinFu builds), or 8 or 32 for submaps
+		float truncation_distance;	// TSDF truncation in metres, 0 for 7 voxels
+	} kinfu_volume_params_t;
+
+	// Set the volume the next startCameras or openPlayback creates. Returns false, keeping the last ones, for invalid params
+	KINFUUNITY_API bool setVolumeParams(const kinfu_volume_params_t *params);
+
+	// The running volume and the memory its voxels take
+	typedef struct
+	{
+		int volume_type;			// kinfu_volume_type_t
+		float voxel_size;			// Voxel edge in metres
+		float truncation_distance;	// TSDF truncation in metres
+		int volume_resolution;		// Voxels per side of a TSDF volume, 0 for hash
+		int unit_resolution;		// Voxels per side of a hash volume unit, 0 for TSDF
+		int volume_units;			// Hash units within truncation of the newest cloud (the current submap's), 0 for TSDF
+		uint64_t resident_bytes;	// Voxel memory, exact for TSDF and estimated from volume_units otherwise
+	} kinfu_volume_info_t;
+
+	// Describe the running volume. Hash volumes are measured from the newest cloud, extracting it if needed.
+	// Returns false before KinFu is started
+	KINFUUNITY_API bool getVolumeInfo(kinfu_volume_info_t *info);
+
+	// Frame time budget for the adaptive quality controller. It walks a ladder of levels from KinFu's defaults
+	// (0) down to coarse tracking that fuses one frame in two, holding the smoothed fusion time per captured frame
+	typedef struct
+	{
+		float target_ms;			// Fusion time to hold per captured frame (remap, registration and update, skipped frames
+									// counting as 0), 0 turns the controller off
+		float raise_fraction;		// Quality only goes back up once the time is under target_ms * raise_fraction, 0.3 to 0.95
+		int lower_frames;			// Frames in a row over target_ms before quality goes down, and the wait after any change
+		int raise_frames;			// Frames in a row under the raise threshold before quality goes up
+		int rebuild;				// Non-zero to recreate KinFu as soon as a level changes its creation-time knobs, dropping
+									// the model. Otherwise those knobs wait for the next reset, and the controller skips the
+									// levels that only change them, moving on frame_stride alone
+	} kinfu_quality_policy_t;
+
+	// Set the quality policy, off until set. Returns false, keeping the last one, for out of range values
+	KINFUUNITY_API bool setQualityPolicy(const kinfu_quality_policy_t *policy);
+
+	// Where the controller stands and the knobs of its level
+	typedef struct
+	{
+		int level;					// Current level, 0 for KinFu's defaults
+		int created_level;			// Level the running KinFu was created with, behind level until its next reset
+		float frame_ms;				// Smoothed fusion time per captured frame the controller holds against the target
+		int icp_iterations[4];		// ICP iterations per pyramid level, finest first
+		int pyramid_levels;			// Pyramid levels tracked, the entries of icp_iterations in use
+		int bilateral_kernel_size;	// Depth smoothing kernel
+		float raycast_step_factor;	// Raycast step in voxels
+		float min_camera_movement;	// Frames moving the camera less than this are tracked but not integrated
+		int frame_stride;			// Fuse one frame in frame_stride, the others only reach Unity
+	} kinfu_quality_state_t;
+
+	// Describe the controller's level. Returns false before KinFu is started
+	KINFUUNITY_API bool getQualityState(kinfu_quality_state_t *state);
+
+	// One level change made by the controller
+	typedef struct
+	{
+		uint64_t frame;				// Frames the controller had seen when it changed level
+		float frame_ms;				// Smoothed fusion time per captured frame that moved it
+		float target_ms;			// Budget at the time
+		int from_level;
+		int to_level;
+		int applied;				// Non-zero if every knob of to_level took effect, 0 if some wait for a reset
+	} kinfu_quality_event_t;
+
+	// Copy up to capacity of the oldest level changes not polled yet, removing them (the newest 64 are kept).
+	// Returns the number copied
+	KINFUUNITY_API int pollQualityEvents(kinfu_quality_event_t *events, int capacity);
+
+	// Number of times the frame pool's buffers (undistorted depth and color, registered color and
+	// the kept depth frame) were re-allocated since the cameras started. Constant between two samples
+	// means the pool was reused; OpenCV, k4a and the per-extraction clouds still allocate on their own
+	KINFUUNITY_API uint64_t getAllocationCount();
+
+	// Pipeline stages timed by the plugin, indexing kinfu_pipeline_stats_t::stages
+	typedef enum
+	{
+		KINFU_STAGE_CAPTURE,	// Waiting for and reading a capture from the device or recording
+		KINFU_STAGE_COLOR,		// Color conversion to RGBA into the frame buffer
+		KINFU_STAGE_REMAP,		// Depth undistortion
+		KINFU_STAGE_REGISTER,	// Color registration to depth, colored volumes only
+		KINFU_STAGE_UPDATE,		// kf->update
+		KINFU_STAGE_GET_CLOUD,	// kf->getCloud
+		KINFU_STAGE_EXPORT,		// Copying the cloud into the frame buffer
+		KINFU_STAGE_FRAME,		// Everything after the capture arrived
+		KINFU_STAGE_COUNT
+	} kinfu_stage_t;
+
+	// Timings of one stage in milliseconds. Percentiles come from a log histogram (within ~6%)
+	typedef struct _kinfu_stage_stats_t
+	{
+		uint64_t count;
+		float last_ms;
+		float mean_ms;
+		float max_ms;
+		float p50_ms;
+		float p95_ms;
+		float p99_ms;
+	} kinfu_stage_stats_t;
+
+	// Stage timings and event counters since the last resetPipelineStats
+	typedef struct _kinfu_pipeline_stats_t
+	{
+		kinfu_stage_stats_t stages[KINFU_STAGE_COUNT];
+
+		uint64_t frames;
+		uint64_t successful_updates;
+		uint64_t failed_updates;
+		uint64_t dropped_frames;
+		uint64_t capture_timeouts;
+		uint64_t capture_failures;
+		uint64_t color_failures;
+	} kinfu_pipeline_stats_t;
+
+	// Copy the current pipeline stats, safe to call while the capture thread runs
+	KINFUUNITY_API void getPipelineStats(kinfu_pipeline_stats_t *stats);
+
+	// Clear all stage timings and counters
+	KINFUUNITY_API void resetPipelineStats();
+
+	// Turn stage timing on or off (on by default); counters are always kept
+	KINFUUNITY_API void setPipelineStatsEnabled(bool enabled);
+
+	// Turn per-thread trace event recording on or off (off by default)
+	KINFUUNITY_API void setTracingEnabled(bool enabled);
+
+	// Write the recorded events as Chrome Trace Event JSON, returns the event count or -1
+	KINFUUNITY_API int writeTrace(const char *path);
+
+	// Drop every recorded trace event
+	KINFUUNITY_API void clearTrace();
+
 	// Captures the camera pose matrix from the  latest frame
 	// (assuming captureFrame has been called first)
 	KINFUUNITY_API void requestPose(unsigned char *matrix_data);
@@ -63,10 +469,10 @@ extern "C"
 	// Connect to a specific device
 	KINFUUNITY_API bool connectToDevice(int deviceIndex);
 
-	// setup and configure device
+	// setup and configure device with the profile from setCaptureProfile
 	KINFUUNITY_API bool setupConfigAndCalibrate();
 
-	// start connected device cameras
+	// start connected device cameras, stopping the capture thread first if it is running
 	KINFUUNITY_API bool startCameras();
 
 	// Resets the KinectFusion algorithm
@@ -76,6 +482,6 @@ extern "C"
 	// stop connected device cameras
 	KINFUUNITY_API bool stopCameras();
 
-	// close device and release device handle
+	// close device (or playback) and release its handle
 	KINFUUNITY_API void closeDevice();
 }